@@ -0,0 +1,50 @@
+#!/bin/sh
+# Linux build, mirrors build.bat. Needs the Vulkan SDK headers (VULKAN_SDK or system), Xlib and a C/C++ toolchain.
+
+rootDir=$(pwd)
+mkdir -p build
+
+debug=false
+
+if [ "$debug" = true ]; then
+    echo "Compiling in debug mode."
+    debugFlags="-O0 -g -DAURORA_DEBUG"
+else
+    echo "Compiling in release mode."
+    debugFlags="-O2 -g -ffast-math"
+fi
+
+output=aurora
+flags="-DVK_NO_PROTOTYPES -DVK_USE_PLATFORM_XLIB_KHR -D_GNU_SOURCE"
+includeDirs="-I$rootDir/src -I$rootDir/third_party"
+# Our own code is built with warnings on, third party headers are pulled in as system headers so only src reports
+srcIncludeDirs="-I$rootDir/src -isystem $rootDir/third_party"
+warnings="-Wall -Wextra"
+if [ -n "$VULKAN_SDK" ]; then
+    includeDirs="$includeDirs -I$VULKAN_SDK/include"
+    srcIncludeDirs="$srcIncludeDirs -isystem $VULKAN_SDK/include"
+fi
+source="$rootDir/src/*.c $rootDir/src/resource/*.c $rootDir/src/gfx/*.c $rootDir/src/core/*.c $rootDir/src/client/*.c $rootDir/src/audio/*.c"
+links="-lX11 -lpthread -ldl -lm -lstdc++"
+
+cd build
+if [ ! -f libvolk.a ]; then
+    cc $includeDirs $flags -O2 -w -c $rootDir/third_party/volk.c -o volk.o && ar rcs libvolk.a volk.o
+fi
+if [ ! -f libvma.a ]; then
+    c++ $includeDirs $flags -O2 -w -c $rootDir/third_party/vma.cpp -o vma.o && ar rcs libvma.a vma.o
+fi
+if [ ! -f libspirv_reflect.a ]; then
+    cc $includeDirs $flags -O2 -w -c $rootDir/third_party/spirv_reflect.c -o spirv_reflect.o && ar rcs libspirv_reflect.a spirv_reflect.o
+fi
+if [ ! -f libstb_image.a ]; then
+    cc -O2 -w -c $rootDir/third_party/stb_image.c -o stb_image.o && ar rcs libstb_image.a stb_image.o
+fi
+if [ ! -f libcgltf.a ]; then
+    cc -O2 -w -c $rootDir/third_party/cgltf.c -o cgltf.o && ar rcs libcgltf.a cgltf.o
+fi
+cc -std=gnu11 $warnings $srcIncludeDirs $debugFlags $flags -o $output $source -L. -lvolk -lvma -lspirv_reflect -lstb_image -lcgltf $links
+cd ..
+
+echo
+echo "Build finished."
@@ -8,12 +8,17 @@ call %VULKAN_SDK%/bin/glslc.exe --target-spv=spv1.3 --target-env=vulkan1.2 -g -O
 call %VULKAN_SDK%/bin/glslc.exe --target-spv=spv1.3 --target-env=vulkan1.2 -g -O %rootDir%/shaders/gbuffer.mesh                 -o gbuffer.mesh.spv
 call %VULKAN_SDK%/bin/glslc.exe --target-spv=spv1.3 --target-env=vulkan1.2 -g -O %rootDir%/shaders/gbuffer.frag                 -o gbuffer.frag.spv
 call %VULKAN_SDK%/bin/glslc.exe --target-spv=spv1.3 --target-env=vulkan1.2 -g -O %rootDir%/shaders/gbuffer.task                 -o gbuffer.task.spv
+call %VULKAN_SDK%/bin/glslc.exe --target-spv=spv1.3 --target-env=vulkan1.2 -g -O %rootDir%/shaders/gbuffer.vert                 -o gbuffer.vert.spv
 call %VULKAN_SDK%/bin/glslc.exe --target-spv=spv1.3 --target-env=vulkan1.2 -g -O %rootDir%/shaders/fxaa.vert                    -o fxaa.vert.spv
 call %VULKAN_SDK%/bin/glslc.exe --target-spv=spv1.3 --target-env=vulkan1.2 -g -O %rootDir%/shaders/fxaa.frag                    -o fxaa.frag.spv
 call %VULKAN_SDK%/bin/glslc.exe --target-spv=spv1.3 --target-env=vulkan1.2 -g -O %rootDir%/shaders/equirectangular_cubemap.comp -o equirectangular_cubemap.comp.spv
 call %VULKAN_SDK%/bin/glslc.exe --target-spv=spv1.3 --target-env=vulkan1.2 -g -O %rootDir%/shaders/irradiance.comp              -o irradiance.comp.spv
 call %VULKAN_SDK%/bin/glslc.exe --target-spv=spv1.3 --target-env=vulkan1.2 -g -O %rootDir%/shaders/prefilter.comp               -o prefilter.comp.spv
 call %VULKAN_SDK%/bin/glslc.exe --target-spv=spv1.3 --target-env=vulkan1.2 -g -O %rootDir%/shaders/brdf.comp                    -o brdf.comp.spv
+call %VULKAN_SDK%/bin/glslc.exe --target-spv=spv1.3 --target-env=vulkan1.2 -g -O %rootDir%/shaders/light_cull.comp              -o light_cull.comp.spv
+call %VULKAN_SDK%/bin/glslc.exe --target-spv=spv1.3 --target-env=vulkan1.2 -g -O %rootDir%/shaders/depth_pyramid.comp           -o depth_pyramid.comp.spv
+call %VULKAN_SDK%/bin/glslc.exe --target-spv=spv1.3 --target-env=vulkan1.2 -g -O %rootDir%/shaders/draw_cull.comp               -o draw_cull.comp.spv
+call %VULKAN_SDK%/bin/glslc.exe --target-spv=spv1.3 --target-env=vulkan1.2 -g -O %rootDir%/shaders/meshlet_cull.comp            -o meshlet_cull.comp.spv
 call %VULKAN_SDK%/bin/glslc.exe --target-spv=spv1.3 --target-env=vulkan1.2 -g -O %rootDir%/shaders/skybox.vert                  -o skybox.vert.spv
 call %VULKAN_SDK%/bin/glslc.exe --target-spv=spv1.3 --target-env=vulkan1.2 -g -O %rootDir%/shaders/skybox.frag                  -o skybox.frag.spv
 popd
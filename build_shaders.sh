@@ -0,0 +1,27 @@
+#!/bin/sh
+
+rootDir=$(pwd)
+
+cd shaders
+glslc --target-spv=spv1.3 --target-env=vulkan1.2 -g -O $rootDir/shaders/deferred.vert                -o deferred.vert.spv
+glslc --target-spv=spv1.3 --target-env=vulkan1.2 -g -O $rootDir/shaders/deferred.frag                -o deferred.frag.spv
+glslc --target-spv=spv1.3 --target-env=vulkan1.2 -g -O $rootDir/shaders/gbuffer.mesh                 -o gbuffer.mesh.spv
+glslc --target-spv=spv1.3 --target-env=vulkan1.2 -g -O $rootDir/shaders/gbuffer.frag                 -o gbuffer.frag.spv
+glslc --target-spv=spv1.3 --target-env=vulkan1.2 -g -O $rootDir/shaders/gbuffer.task                 -o gbuffer.task.spv
+glslc --target-spv=spv1.3 --target-env=vulkan1.2 -g -O $rootDir/shaders/gbuffer.vert                 -o gbuffer.vert.spv
+glslc --target-spv=spv1.3 --target-env=vulkan1.2 -g -O $rootDir/shaders/fxaa.vert                    -o fxaa.vert.spv
+glslc --target-spv=spv1.3 --target-env=vulkan1.2 -g -O $rootDir/shaders/fxaa.frag                    -o fxaa.frag.spv
+glslc --target-spv=spv1.3 --target-env=vulkan1.2 -g -O $rootDir/shaders/equirectangular_cubemap.comp -o equirectangular_cubemap.comp.spv
+glslc --target-spv=spv1.3 --target-env=vulkan1.2 -g -O $rootDir/shaders/irradiance.comp              -o irradiance.comp.spv
+glslc --target-spv=spv1.3 --target-env=vulkan1.2 -g -O $rootDir/shaders/prefilter.comp               -o prefilter.comp.spv
+glslc --target-spv=spv1.3 --target-env=vulkan1.2 -g -O $rootDir/shaders/brdf.comp                    -o brdf.comp.spv
+glslc --target-spv=spv1.3 --target-env=vulkan1.2 -g -O $rootDir/shaders/light_cull.comp              -o light_cull.comp.spv
+glslc --target-spv=spv1.3 --target-env=vulkan1.2 -g -O $rootDir/shaders/depth_pyramid.comp           -o depth_pyramid.comp.spv
+glslc --target-spv=spv1.3 --target-env=vulkan1.2 -g -O $rootDir/shaders/draw_cull.comp               -o draw_cull.comp.spv
+glslc --target-spv=spv1.3 --target-env=vulkan1.2 -g -O $rootDir/shaders/meshlet_cull.comp            -o meshlet_cull.comp.spv
+glslc --target-spv=spv1.3 --target-env=vulkan1.2 -g -O $rootDir/shaders/skybox.vert                  -o skybox.vert.spv
+glslc --target-spv=spv1.3 --target-env=vulkan1.2 -g -O $rootDir/shaders/skybox.frag                  -o skybox.frag.spv
+cd ..
+
+mkdir -p build/shaders
+cp shaders/*.spv build/shaders/
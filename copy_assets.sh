@@ -0,0 +1,4 @@
+#!/bin/sh
+
+mkdir -p build
+cp -r assets build/
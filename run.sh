@@ -0,0 +1,5 @@
+#!/bin/sh
+
+cd build
+./aurora "$@"
+cd ..
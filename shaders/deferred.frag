@@ -1,14 +1,20 @@
 #version 460
 
 #define PI 3.14159265359
-#define MAX_LIGHTS 512
+
+// Keep in sync with the RENDER_GRAPH_CLUSTER_* defines and light_cull.comp
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define MAX_LIGHTS_PER_CLUSTER 128
+#define CLUSTER_SPLIT_NEAR 0.1
 
 struct PointLight
 {
     vec3 position;
-    float pad;
+    float radius;
     vec3 color;
-    float pad2;
+    float pad;
 };
 
 layout (location = 0) out vec4 OutColor;
@@ -24,12 +30,22 @@ layout (binding = 5, set = 0) uniform textureCube   Cubemap;
 layout (binding = 6, set = 0) uniform textureCube   Irradiance;
 layout (binding = 7, set = 0) uniform textureCube   Prefilter;
 layout (binding = 8, set = 0) uniform texture2D     BRDF;
-layout (binding = 0, set = 1) uniform sampler       SamplerHeap[512];
+layout (binding = 0, set = 1) uniform sampler       SamplerHeap[1024];
+
+layout (binding = 0, set = 2) readonly buffer Lights {
+    uint light_count;
+    uint _light_pad0;
+    uint _light_pad1;
+    uint _light_pad2;
+    PointLight lights[];
+};
 
-layout (binding = 0, set = 2) uniform Lights {
-    PointLight lights[MAX_LIGHTS];
-    int light_count;
-    vec3 _light_pad;
+layout (binding = 1, set = 2) readonly buffer ClusterCounts {
+    uint cluster_counts[];
+};
+
+layout (binding = 2, set = 2) readonly buffer ClusterLights {
+    uint cluster_lights[];
 };
 
 layout (binding = 0, set = 3) uniform RenderParams {
@@ -38,6 +54,17 @@ layout (binding = 0, set = 3) uniform RenderParams {
     vec2 pad;
 } params;
 
+layout (binding = 0, set = 4) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 pos;
+    float pad;
+    vec4 frustrum_planes[6];
+    float z_near;
+    float z_far;
+    vec2 pad2;
+} camera;
+
 layout (push_constant) uniform CameraConstants {
     vec3 fCameraPos;
     float pad;
@@ -83,6 +110,15 @@ vec3 FresnelSchlick(float cosTheta, vec3 F0)
     return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
 }
 
+uint ClusterSlice(float depth)
+{
+    if (depth < CLUSTER_SPLIT_NEAR)
+        return 0u;
+
+    float slice = log(depth / CLUSTER_SPLIT_NEAR) / log(camera.z_far / CLUSTER_SPLIT_NEAR) * float(CLUSTER_Z - 1);
+    return min(1 + uint(slice), uint(CLUSTER_Z - 1));
+}
+
 vec3 FresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness)
 {
     return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
@@ -113,12 +149,24 @@ void main()
 
     vec3 Lo = vec3(0.0);
 
-    for (int i = 0; i < light_count; i++)
+    // Only the lights the cull pass assigned to this pixel's cluster
+    vec2 screen_size = vec2(textureSize(sampler2D(gPosition, SamplerHeap[0]), 0));
+    uvec2 tile = min(uvec2(gl_FragCoord.xy / screen_size * vec2(CLUSTER_X, CLUSTER_Y)), uvec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+    float view_depth = -(camera.view * vec4(FragPos, 1.0)).z;
+    uint cluster = tile.x + tile.y * CLUSTER_X + ClusterSlice(view_depth) * CLUSTER_X * CLUSTER_Y;
+    uint cluster_light_count = cluster_counts[cluster];
+
+    for (uint c = 0; c < cluster_light_count; c++)
     {
+        uint i = cluster_lights[cluster * MAX_LIGHTS_PER_CLUSTER + c];
+
         vec3 L = normalize(lights[i].position - FragPos);
         vec3 H = normalize(V + L);
         float distance = length(lights[i].position - FragPos);
-        float attenuation = 1.0 / (distance * distance);
+
+        // Windowed so the light reaches exactly zero at its radius and the culling is invisible
+        float falloff = clamp(1.0 - pow(distance / lights[i].radius, 4.0), 0.0, 1.0);
+        float attenuation = falloff * falloff / (distance * distance);
         vec3 radiance = lights[i].color * attenuation;
 
         // Cook-Torrance BRDF
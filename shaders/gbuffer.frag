@@ -6,6 +6,7 @@ layout (location = 0) in PerVertexData {
     vec3 fNormals;
     vec3 fCameraPos;
     vec3 fMeshletColor;
+    flat uint fMaterialIndex;
 } FragmentIn;
 
 layout (location = 0) out vec3 gPosition;
@@ -13,14 +14,20 @@ layout (location = 1) out vec3 gNormal;
 layout (location = 2) out vec4 gAlbedo;
 layout (location = 3) out vec4 gMetallicRoughness;
 
-layout (binding = 0, set = 1) uniform texture2D TextureHeap[512];
-layout (binding = 0, set = 2) uniform sampler   SamplerHeap[512];
-layout (binding = 0, set = 3) uniform BindlessMaterial {
+layout (binding = 0, set = 1) uniform texture2D TextureHeap[4096];
+layout (binding = 0, set = 2) uniform sampler   SamplerHeap[1024];
+struct Material
+{
     uvec4 BindlessIndex; // x = albedo, y = normal, z = mr, w = albedo sampler
     vec3 color_factor;
     float metallic_factor;
     float roughness_factor;
-    vec3 pad0;
+    float pad0[3];
+};
+
+// Every material of the scene, indexed by the primitive's material
+layout (binding = 0, set = 3) readonly buffer Materials {
+    Material materials[];
 };
 
 layout (binding = 0, set = 5) uniform RenderParams {
@@ -28,7 +35,7 @@ layout (binding = 0, set = 5) uniform RenderParams {
     vec3 pad;
 } params;
 
-vec3 GetNormalFromMap()
+vec3 GetNormalFromMap(uvec4 BindlessIndex)
 {
     vec3 tangentNormal = texture(sampler2D(TextureHeap[BindlessIndex.y], SamplerHeap[0]), FragmentIn.fTexcoords).xyz * 2.0 - 1.0;
 
@@ -47,14 +54,17 @@ vec3 GetNormalFromMap()
 
 void main()
 {    
-    vec3 N = GetNormalFromMap();
-    vec4 alb = texture(sampler2D(TextureHeap[BindlessIndex.x], SamplerHeap[BindlessIndex.w]), FragmentIn.fTexcoords) * vec4(color_factor, 1.0);
+    Material material = materials[FragmentIn.fMaterialIndex];
+    uvec4 BindlessIndex = material.BindlessIndex;
+
+    vec3 N = GetNormalFromMap(BindlessIndex);
+    vec4 alb = texture(sampler2D(TextureHeap[BindlessIndex.x], SamplerHeap[BindlessIndex.w]), FragmentIn.fTexcoords) * vec4(material.color_factor, 1.0);
     vec4 mr = texture(sampler2D(TextureHeap[BindlessIndex.z], SamplerHeap[0]), FragmentIn.fTexcoords);
 
-    if (metallic_factor > 0)
-        mr.b *= metallic_factor;
-    if (roughness_factor > 0)
-        mr.g *= roughness_factor;
+    if (material.metallic_factor > 0)
+        mr.b *= material.metallic_factor;
+    if (material.roughness_factor > 0)
+        mr.g *= material.roughness_factor;
 
     if (alb.a < 0.25)
         discard;
@@ -0,0 +1,129 @@
+#version 450
+
+// Vertex pipeline fallback for gbuffer.task and gbuffer.mesh: meshlet_cull.comp wrote mesh wide vertex indices,
+// the instance index is the primitive
+struct Vertex
+{
+	float px, py, pz;
+	float ux, uy;
+	float nx, ny, nz;
+};
+
+struct PackedVertex
+{
+	uint position_xy;
+	uint position_z;
+	uint normal;
+	uint uv;
+};
+
+layout (binding = 0, set = 4) readonly buffer Vertices
+{
+	Vertex vertex_data[];
+};
+
+layout (binding = 0, set = 4) readonly buffer PackedVertices
+{
+	PackedVertex packed_vertex_data[];
+};
+
+struct Primitive
+{
+	mat4 transform;
+	vec4 position_offset;
+	vec4 position_scale;
+	vec4 bounds;
+	uint first_vertex;
+	uint first_meshlet;
+	uint meshlet_count;
+	uint first_meshlet_vertex;
+	uint first_meshlet_index;
+	uint first_group;
+	uint material_index;
+	uint vertex_format;
+};
+
+layout (binding = 6, set = 4) readonly buffer Primitives
+{
+	Primitive primitives[];
+};
+
+layout (binding = 0, set = 0) uniform SceneData {
+	mat4 projection;
+	mat4 view;
+
+	vec3 camera_position;
+	float padding0;
+
+	vec4 frustrum_planes[6];
+} scene;
+
+#define VERTEX_FORMAT_QUANTIZED 1
+
+layout (location = 0) out PerVertexData {
+	vec3 WorldPos;
+	vec2 OutUV;
+	vec3 OutNormals;
+	vec3 CameraPos;
+	vec3 MeshletColor;
+	flat uint MaterialIndex;
+} VertexOut;
+
+uint hash(uint a)
+{
+	a = (a+0x7ed55d16) + (a<<12);
+	a = (a^0xc761c23c) ^ (a>>19);
+	a = (a+0x165667b1) + (a<<5);
+	a = (a+0xd3a2646c) ^ (a<<9);
+	a = (a+0xfd7046c5) + (a<<3);
+	a = (a^0xb55a4f09) ^ (a>>16);
+	return a;
+}
+
+vec3 DecodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+void main()
+{
+	Primitive primitive = primitives[gl_InstanceIndex];
+	mat4 transform = primitive.transform;
+	uint vi = gl_VertexIndex;
+
+	vec3 position;
+	vec2 uv;
+	vec3 normals;
+
+	if (primitive.vertex_format == VERTEX_FORMAT_QUANTIZED)
+	{
+		PackedVertex v = packed_vertex_data[vi];
+		vec3 unorm = vec3(unpackUnorm2x16(v.position_xy), unpackUnorm2x16(v.position_z).x);
+
+		position = primitive.position_offset.xyz + unorm * primitive.position_scale.xyz;
+		uv = unpackHalf2x16(v.uv);
+		normals = DecodeOctahedral(unpackSnorm2x16(v.normal));
+	}
+	else
+	{
+		position = vec3(vertex_data[vi].px, vertex_data[vi].py, vertex_data[vi].pz);
+		uv = vec2(vertex_data[vi].ux, vertex_data[vi].uy);
+		normals = vec3(vertex_data[vi].nx, vertex_data[vi].ny, vertex_data[vi].nz);
+	}
+
+	// Vertices are shared between clusters here, so the debug colour is per primitive
+	uint phash = hash(gl_InstanceIndex);
+
+	VertexOut.OutUV = uv;
+	VertexOut.OutNormals = transpose(inverse(mat3(transform))) * normals;
+	VertexOut.WorldPos = vec3(transform * vec4(position, 1.0));
+	VertexOut.CameraPos = scene.camera_position;
+	VertexOut.MeshletColor = vec3(float(phash & 255), float((phash >> 8) & 255), float((phash >> 16) & 255)) / 255.0;
+	VertexOut.MaterialIndex = primitive.material_index;
+
+	gl_Position = scene.projection * scene.view * transform * vec4(position, 1.0);
+}
@@ -26,7 +26,7 @@ AudioCtx ctx;
 void data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount)
 {
     /* Assuming format is always s16 for now. */
-    for (i32 i = 0; i < ctx.clip_count; i++) {
+    for (u32 i = 0; i < ctx.clip_count; i++) {
         if (pDevice->playback.format == ma_format_s16) {
                drwav_read_pcm_frames_s16(&ctx.clips[i]->wav, frameCount, (drwav_int16*)pOutput);
     } else if (pDevice->playback.format == ma_format_f32) {
@@ -49,6 +49,7 @@ void fps_camera_init(FPS_Camera* camera)
 
 void fps_camera_update(FPS_Camera* camera, f32 dt)
 {
+    (void)dt;
     camera->width = (f32)platform.width;
     camera->height = (f32)platform.height;
 
@@ -59,18 +60,18 @@ void fps_camera_update(FPS_Camera* camera, f32 dt)
     camera->mouse_pos.Y = mouse_y;
 
     camera->view = HMM_LookAt(camera->position, HMM_AddVec3(camera->position, camera->front), camera->worldup);
-    camera->projection = HMM_Perspective(75.0f, camera->width / camera->height, 0.001f, 10000.0f);
+    camera->projection = HMM_Perspective(75.0f, camera->width / camera->height, CAMERA_NEAR, CAMERA_FAR);
     camera->view_projection = HMM_MultiplyMat4(camera->projection, camera->view);
 }
 
 void fps_camera_update_frustum(FPS_Camera* camera)
 {
 #if 1
-    const f32 half_v_side = 10000.0f * tanf(HMM_ToRadians(75.0f) * 0.5f);
+    const f32 half_v_side = CAMERA_FAR * tanf(HMM_ToRadians(75.0f) * 0.5f);
     const f32 half_h_side = half_v_side * (camera->width / camera->height);
-    const hmm_vec3 front_mult_far = HMM_MultiplyVec3f(camera->front, 10000.0f);
+    const hmm_vec3 front_mult_far = HMM_MultiplyVec3f(camera->front, CAMERA_FAR);
 
-    camera->view_frustum.near.point = HMM_AddVec3(camera->position, HMM_MultiplyVec3f(camera->front, 0.001f));
+    camera->view_frustum.near.point = HMM_AddVec3(camera->position, HMM_MultiplyVec3f(camera->front, CAMERA_NEAR));
     camera->view_frustum.near.norm = camera->front;
 
     camera->view_frustum.far.point = HMM_AddVec3(camera->position, front_mult_far);
@@ -13,6 +13,8 @@
 #define CAMERA_DEFAULT_SPEED 1.0f
 #define CAMERA_DEFAULT_MOUSE_SENSITIVITY 5.0f
 #define CAMERA_DEFAULT_ZOOM 90.0f
+#define CAMERA_NEAR 0.001f
+#define CAMERA_FAR 10000.0f
 
 typedef struct Plane Plane;
 struct Plane
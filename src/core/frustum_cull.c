@@ -0,0 +1,581 @@
+#include "frustum_cull.h"
+
+#include "platform_layer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define FRUSTUM_CULL_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define FRUSTUM_CULL_X86 0
+#endif
+
+// MSVC emits any intrinsic without flags, GCC and Clang need the wider paths marked so the rest of the file stays baseline
+#if defined(_MSC_VER)
+#define FRUSTUM_CULL_TARGET(isa)
+#else
+#define FRUSTUM_CULL_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+// Narrowest first, the widest one the CPU and OS support is picked the first time anything is culled
+#define FRUSTUM_CULL_ISA_SCALAR 0
+#define FRUSTUM_CULL_ISA_SSE 1
+#define FRUSTUM_CULL_ISA_AVX2 2
+#define FRUSTUM_CULL_ISA_AVX512 3
+#define FRUSTUM_CULL_ISA_COUNT 4
+
+typedef u32 (*frustum_cull_kernel)(FrustumCullSet* set, hmm_vec4* planes, u32* visible);
+
+internal i32 s_isa = -1;
+
+// Lane indices of the set bits of every 8 bit mask packed to the front, one byte each, for the AVX2 compaction
+internal u64 s_compact_lanes[256];
+
+internal void frustum_cull_grow(FrustumCullSet* set, u32 capacity)
+{
+    capacity = (capacity + FRUSTUM_CULL_PADDING - 1) / FRUSTUM_CULL_PADDING * FRUSTUM_CULL_PADDING;
+    if (capacity <= set->capacity)
+        return;
+
+    f32** arrays[] = { &set->sphere_x, &set->sphere_y, &set->sphere_z, &set->sphere_radius,
+                       &set->box_x, &set->box_y, &set->box_z, &set->extent_x, &set->extent_y, &set->extent_z };
+
+    // The padding is read by the wide loops before its lanes are masked off, keep it initialized
+    for (u32 i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++)
+    {
+        *arrays[i] = realloc(*arrays[i], sizeof(f32) * capacity);
+        memset(*arrays[i] + set->capacity, 0, sizeof(f32) * (capacity - set->capacity));
+    }
+
+    set->capacity = capacity;
+}
+
+void frustum_cull_init(FrustumCullSet* set, u32 capacity)
+{
+    memset(set, 0, sizeof(FrustumCullSet));
+    frustum_cull_grow(set, max(capacity, 1));
+}
+
+void frustum_cull_free(FrustumCullSet* set)
+{
+    free(set->sphere_x);
+    free(set->sphere_y);
+    free(set->sphere_z);
+    free(set->sphere_radius);
+    free(set->box_x);
+    free(set->box_y);
+    free(set->box_z);
+    free(set->extent_x);
+    free(set->extent_y);
+    free(set->extent_z);
+    memset(set, 0, sizeof(FrustumCullSet));
+}
+
+void frustum_cull_clear(FrustumCullSet* set)
+{
+    set->count = 0;
+}
+
+u32 frustum_cull_add(FrustumCullSet* set, hmm_vec4 sphere, hmm_vec3 aabb_min, hmm_vec3 aabb_max)
+{
+    if (set->count == set->capacity)
+        frustum_cull_grow(set, set->capacity * 2);
+
+    u32 index = set->count++;
+    set->sphere_x[index] = sphere.X;
+    set->sphere_y[index] = sphere.Y;
+    set->sphere_z[index] = sphere.Z;
+    set->sphere_radius[index] = sphere.W;
+    set->box_x[index] = (aabb_min.X + aabb_max.X) * 0.5f;
+    set->box_y[index] = (aabb_min.Y + aabb_max.Y) * 0.5f;
+    set->box_z[index] = (aabb_min.Z + aabb_max.Z) * 0.5f;
+    set->extent_x[index] = (aabb_max.X - aabb_min.X) * 0.5f;
+    set->extent_y[index] = (aabb_max.Y - aabb_min.Y) * 0.5f;
+    set->extent_z[index] = (aabb_max.Z - aabb_min.Z) * 0.5f;
+    return index;
+}
+
+u32 frustum_cull_add_transformed(FrustumCullSet* set, hmm_mat4 transform, hmm_vec4 sphere, hmm_vec3 aabb_min, hmm_vec3 aabb_max)
+{
+    // The radius grows with the largest axis scale so the sphere stays conservative under non uniform scale
+    f32 scale = 0.0f;
+    for (u32 c = 0; c < 3; c++)
+        scale = max(scale, HMM_LengthVec3(HMM_Vec3(transform.Elements[c][0], transform.Elements[c][1], transform.Elements[c][2])));
+
+    hmm_vec4 center = HMM_MultiplyMat4ByVec4(transform, HMM_Vec4v(sphere.XYZ, 1.0f));
+    hmm_vec4 world_sphere = HMM_Vec4v(center.XYZ, sphere.W * scale);
+
+    // The world box is the local one's center moved, and its extent through the absolute rotation and scale
+    hmm_vec3 local_center = HMM_MultiplyVec3f(HMM_AddVec3(aabb_min, aabb_max), 0.5f);
+    hmm_vec3 local_extent = HMM_MultiplyVec3f(HMM_SubtractVec3(aabb_max, aabb_min), 0.5f);
+    hmm_vec4 box_center = HMM_MultiplyMat4ByVec4(transform, HMM_Vec4v(local_center, 1.0f));
+
+    hmm_vec3 box_extent = HMM_Vec3(0.0f, 0.0f, 0.0f);
+    for (u32 r = 0; r < 3; r++)
+    {
+        for (u32 c = 0; c < 3; c++)
+            box_extent.Elements[r] += HMM_ABS(transform.Elements[c][r]) * local_extent.Elements[c];
+    }
+
+    return frustum_cull_add(set, world_sphere, HMM_SubtractVec3(box_center.XYZ, box_extent), HMM_AddVec3(box_center.XYZ, box_extent));
+}
+
+// Lanes past the last entry of the set
+internal u32 frustum_cull_tail(u32 remaining, u32 width)
+{
+    return remaining >= width ? (1u << width) - 1 : (1u << remaining) - 1;
+}
+
+// Writes every lane and only moves past the visible ones, nothing to mispredict
+internal u32 frustum_cull_compact(u32* visible, u32 count, u32 base, u32 mask, u32 width)
+{
+    for (u32 lane = 0; lane < width; lane++)
+    {
+        visible[count] = base + lane;
+        count += (mask >> lane) & 1;
+    }
+
+    return count;
+}
+
+internal u32 frustum_cull_popcount(u32 mask)
+{
+    mask = mask - ((mask >> 1) & 0x55555555);
+    mask = (mask & 0x33333333) + ((mask >> 2) & 0x33333333);
+    return (((mask + (mask >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+internal u32 frustum_cull_spheres_scalar(FrustumCullSet* set, hmm_vec4* planes, u32* visible)
+{
+    u32 count = 0;
+    for (u32 i = 0; i < set->count; i++)
+    {
+        b32 inside = 1;
+        for (u32 p = 0; p < 6; p++)
+            inside &= set->sphere_x[i] * planes[p].X + set->sphere_y[i] * planes[p].Y + set->sphere_z[i] * planes[p].Z - planes[p].W > -set->sphere_radius[i];
+
+        visible[count] = i;
+        count += inside;
+    }
+
+    return count;
+}
+
+// Distance of the box's positive vertex: the center's distance plus the extent projected on the absolute normal
+internal u32 frustum_cull_aabbs_scalar(FrustumCullSet* set, hmm_vec4* planes, u32* visible)
+{
+    u32 count = 0;
+    for (u32 i = 0; i < set->count; i++)
+    {
+        b32 inside = 1;
+        for (u32 p = 0; p < 6; p++)
+        {
+            f32 distance = set->box_x[i] * planes[p].X + set->box_y[i] * planes[p].Y + set->box_z[i] * planes[p].Z - planes[p].W;
+            f32 reach = set->extent_x[i] * HMM_ABS(planes[p].X) + set->extent_y[i] * HMM_ABS(planes[p].Y) + set->extent_z[i] * HMM_ABS(planes[p].Z);
+            inside &= distance + reach > 0.0f;
+        }
+
+        visible[count] = i;
+        count += inside;
+    }
+
+    return count;
+}
+
+#if FRUSTUM_CULL_X86
+internal u32 frustum_cull_spheres_sse(FrustumCullSet* set, hmm_vec4* planes, u32* visible)
+{
+    __m128 px[6], py[6], pz[6], pw[6];
+    for (u32 p = 0; p < 6; p++)
+    {
+        px[p] = _mm_set1_ps(planes[p].X);
+        py[p] = _mm_set1_ps(planes[p].Y);
+        pz[p] = _mm_set1_ps(planes[p].Z);
+        pw[p] = _mm_set1_ps(planes[p].W);
+    }
+
+    u32 count = 0;
+    for (u32 i = 0; i < set->count; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(set->sphere_x + i);
+        __m128 y = _mm_loadu_ps(set->sphere_y + i);
+        __m128 z = _mm_loadu_ps(set->sphere_z + i);
+        __m128 neg_radius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(set->sphere_radius + i));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (u32 p = 0; p < 6; p++)
+        {
+            __m128 distance = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, px[p]), _mm_mul_ps(y, py[p])), _mm_mul_ps(z, pz[p])), pw[p]);
+            inside = _mm_and_ps(inside, _mm_cmpgt_ps(distance, neg_radius));
+        }
+
+        u32 mask = _mm_movemask_ps(inside) & frustum_cull_tail(set->count - i, 4);
+        count = frustum_cull_compact(visible, count, i, mask, 4);
+    }
+
+    return count;
+}
+
+internal u32 frustum_cull_aabbs_sse(FrustumCullSet* set, hmm_vec4* planes, u32* visible)
+{
+    __m128 px[6], py[6], pz[6], pw[6], ax[6], ay[6], az[6];
+    for (u32 p = 0; p < 6; p++)
+    {
+        px[p] = _mm_set1_ps(planes[p].X);
+        py[p] = _mm_set1_ps(planes[p].Y);
+        pz[p] = _mm_set1_ps(planes[p].Z);
+        pw[p] = _mm_set1_ps(planes[p].W);
+        ax[p] = _mm_set1_ps(HMM_ABS(planes[p].X));
+        ay[p] = _mm_set1_ps(HMM_ABS(planes[p].Y));
+        az[p] = _mm_set1_ps(HMM_ABS(planes[p].Z));
+    }
+
+    u32 count = 0;
+    for (u32 i = 0; i < set->count; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(set->box_x + i);
+        __m128 y = _mm_loadu_ps(set->box_y + i);
+        __m128 z = _mm_loadu_ps(set->box_z + i);
+        __m128 ex = _mm_loadu_ps(set->extent_x + i);
+        __m128 ey = _mm_loadu_ps(set->extent_y + i);
+        __m128 ez = _mm_loadu_ps(set->extent_z + i);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (u32 p = 0; p < 6; p++)
+        {
+            __m128 distance = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, px[p]), _mm_mul_ps(y, py[p])), _mm_mul_ps(z, pz[p])), pw[p]);
+            __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ax[p]), _mm_mul_ps(ey, ay[p])), _mm_mul_ps(ez, az[p]));
+            inside = _mm_and_ps(inside, _mm_cmpgt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+        }
+
+        u32 mask = _mm_movemask_ps(inside) & frustum_cull_tail(set->count - i, 4);
+        count = frustum_cull_compact(visible, count, i, mask, 4);
+    }
+
+    return count;
+}
+
+FRUSTUM_CULL_TARGET("avx2")
+internal u32 frustum_cull_spheres_avx2(FrustumCullSet* set, hmm_vec4* planes, u32* visible)
+{
+    __m256 px[6], py[6], pz[6], pw[6];
+    for (u32 p = 0; p < 6; p++)
+    {
+        px[p] = _mm256_set1_ps(planes[p].X);
+        py[p] = _mm256_set1_ps(planes[p].Y);
+        pz[p] = _mm256_set1_ps(planes[p].Z);
+        pw[p] = _mm256_set1_ps(planes[p].W);
+    }
+
+    u32 count = 0;
+    for (u32 i = 0; i < set->count; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(set->sphere_x + i);
+        __m256 y = _mm256_loadu_ps(set->sphere_y + i);
+        __m256 z = _mm256_loadu_ps(set->sphere_z + i);
+        __m256 neg_radius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(set->sphere_radius + i));
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (u32 p = 0; p < 6; p++)
+        {
+            __m256 distance = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, px[p]), _mm256_mul_ps(y, py[p])), _mm256_mul_ps(z, pz[p])), pw[p]);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, neg_radius, _CMP_GT_OQ));
+        }
+
+        // All 8 lanes are stored and the count only moves past the visible ones, the store stays inside the padding
+        u32 mask = _mm256_movemask_ps(inside) & frustum_cull_tail(set->count - i, 8);
+        __m256i lanes = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(s_compact_lanes[mask]));
+        _mm256_storeu_si256((__m256i*)(visible + count), _mm256_add_epi32(_mm256_set1_epi32(i), lanes));
+        count += frustum_cull_popcount(mask);
+    }
+
+    return count;
+}
+
+FRUSTUM_CULL_TARGET("avx2")
+internal u32 frustum_cull_aabbs_avx2(FrustumCullSet* set, hmm_vec4* planes, u32* visible)
+{
+    __m256 px[6], py[6], pz[6], pw[6], ax[6], ay[6], az[6];
+    for (u32 p = 0; p < 6; p++)
+    {
+        px[p] = _mm256_set1_ps(planes[p].X);
+        py[p] = _mm256_set1_ps(planes[p].Y);
+        pz[p] = _mm256_set1_ps(planes[p].Z);
+        pw[p] = _mm256_set1_ps(planes[p].W);
+        ax[p] = _mm256_set1_ps(HMM_ABS(planes[p].X));
+        ay[p] = _mm256_set1_ps(HMM_ABS(planes[p].Y));
+        az[p] = _mm256_set1_ps(HMM_ABS(planes[p].Z));
+    }
+
+    u32 count = 0;
+    for (u32 i = 0; i < set->count; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(set->box_x + i);
+        __m256 y = _mm256_loadu_ps(set->box_y + i);
+        __m256 z = _mm256_loadu_ps(set->box_z + i);
+        __m256 ex = _mm256_loadu_ps(set->extent_x + i);
+        __m256 ey = _mm256_loadu_ps(set->extent_y + i);
+        __m256 ez = _mm256_loadu_ps(set->extent_z + i);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (u32 p = 0; p < 6; p++)
+        {
+            __m256 distance = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, px[p]), _mm256_mul_ps(y, py[p])), _mm256_mul_ps(z, pz[p])), pw[p]);
+            __m256 reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, ax[p]), _mm256_mul_ps(ey, ay[p])), _mm256_mul_ps(ez, az[p]));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), _mm256_setzero_ps(), _CMP_GT_OQ));
+        }
+
+        // All 8 lanes are stored and the count only moves past the visible ones, the store stays inside the padding
+        u32 mask = _mm256_movemask_ps(inside) & frustum_cull_tail(set->count - i, 8);
+        __m256i lanes = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(s_compact_lanes[mask]));
+        _mm256_storeu_si256((__m256i*)(visible + count), _mm256_add_epi32(_mm256_set1_epi32(i), lanes));
+        count += frustum_cull_popcount(mask);
+    }
+
+    return count;
+}
+
+// Compress store writes the visible indices directly, no per lane loop
+FRUSTUM_CULL_TARGET("avx512f")
+internal u32 frustum_cull_spheres_avx512(FrustumCullSet* set, hmm_vec4* planes, u32* visible)
+{
+    __m512 px[6], py[6], pz[6], pw[6];
+    for (u32 p = 0; p < 6; p++)
+    {
+        px[p] = _mm512_set1_ps(planes[p].X);
+        py[p] = _mm512_set1_ps(planes[p].Y);
+        pz[p] = _mm512_set1_ps(planes[p].Z);
+        pw[p] = _mm512_set1_ps(planes[p].W);
+    }
+
+    __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    u32 count = 0;
+    for (u32 i = 0; i < set->count; i += 16)
+    {
+        __m512 x = _mm512_loadu_ps(set->sphere_x + i);
+        __m512 y = _mm512_loadu_ps(set->sphere_y + i);
+        __m512 z = _mm512_loadu_ps(set->sphere_z + i);
+        __m512 neg_radius = _mm512_sub_ps(_mm512_setzero_ps(), _mm512_loadu_ps(set->sphere_radius + i));
+
+        __mmask16 inside = (__mmask16)frustum_cull_tail(set->count - i, 16);
+        for (u32 p = 0; p < 6; p++)
+        {
+            __m512 distance = _mm512_sub_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(x, px[p]), _mm512_mul_ps(y, py[p])), _mm512_mul_ps(z, pz[p])), pw[p]);
+            inside = _mm512_mask_cmp_ps_mask(inside, distance, neg_radius, _CMP_GT_OQ);
+        }
+
+        _mm512_mask_compressstoreu_epi32(visible + count, inside, _mm512_add_epi32(_mm512_set1_epi32(i), lanes));
+        count += frustum_cull_popcount(inside);
+    }
+
+    return count;
+}
+
+FRUSTUM_CULL_TARGET("avx512f")
+internal u32 frustum_cull_aabbs_avx512(FrustumCullSet* set, hmm_vec4* planes, u32* visible)
+{
+    __m512 px[6], py[6], pz[6], pw[6], ax[6], ay[6], az[6];
+    for (u32 p = 0; p < 6; p++)
+    {
+        px[p] = _mm512_set1_ps(planes[p].X);
+        py[p] = _mm512_set1_ps(planes[p].Y);
+        pz[p] = _mm512_set1_ps(planes[p].Z);
+        pw[p] = _mm512_set1_ps(planes[p].W);
+        ax[p] = _mm512_set1_ps(HMM_ABS(planes[p].X));
+        ay[p] = _mm512_set1_ps(HMM_ABS(planes[p].Y));
+        az[p] = _mm512_set1_ps(HMM_ABS(planes[p].Z));
+    }
+
+    __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    u32 count = 0;
+    for (u32 i = 0; i < set->count; i += 16)
+    {
+        __m512 x = _mm512_loadu_ps(set->box_x + i);
+        __m512 y = _mm512_loadu_ps(set->box_y + i);
+        __m512 z = _mm512_loadu_ps(set->box_z + i);
+        __m512 ex = _mm512_loadu_ps(set->extent_x + i);
+        __m512 ey = _mm512_loadu_ps(set->extent_y + i);
+        __m512 ez = _mm512_loadu_ps(set->extent_z + i);
+
+        __mmask16 inside = (__mmask16)frustum_cull_tail(set->count - i, 16);
+        for (u32 p = 0; p < 6; p++)
+        {
+            __m512 distance = _mm512_sub_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(x, px[p]), _mm512_mul_ps(y, py[p])), _mm512_mul_ps(z, pz[p])), pw[p]);
+            __m512 reach = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(ex, ax[p]), _mm512_mul_ps(ey, ay[p])), _mm512_mul_ps(ez, az[p]));
+            inside = _mm512_mask_cmp_ps_mask(inside, _mm512_add_ps(distance, reach), _mm512_setzero_ps(), _CMP_GT_OQ);
+        }
+
+        _mm512_mask_compressstoreu_epi32(visible + count, inside, _mm512_add_epi32(_mm512_set1_epi32(i), lanes));
+        count += frustum_cull_popcount(inside);
+    }
+
+    return count;
+}
+#endif
+
+internal frustum_cull_kernel s_sphere_kernels[FRUSTUM_CULL_ISA_COUNT] =
+{
+    frustum_cull_spheres_scalar,
+#if FRUSTUM_CULL_X86
+    frustum_cull_spheres_sse,
+    frustum_cull_spheres_avx2,
+    frustum_cull_spheres_avx512,
+#endif
+};
+
+internal frustum_cull_kernel s_aabb_kernels[FRUSTUM_CULL_ISA_COUNT] =
+{
+    frustum_cull_aabbs_scalar,
+#if FRUSTUM_CULL_X86
+    frustum_cull_aabbs_sse,
+    frustum_cull_aabbs_avx2,
+    frustum_cull_aabbs_avx512,
+#endif
+};
+
+// SSE2 is part of x86-64, the wider ones also need the OS to save their registers
+internal i32 frustum_cull_detect_isa()
+{
+    for (u32 mask = 0; mask < 256; mask++)
+    {
+        u64 lanes = 0;
+        u32 count = 0;
+        for (u32 lane = 0; lane < 8; lane++)
+        {
+            if (mask & (1u << lane))
+                lanes |= (u64)lane << (8 * count++);
+        }
+        s_compact_lanes[mask] = lanes;
+    }
+
+#if FRUSTUM_CULL_X86 && defined(_MSC_VER)
+    i32 info[4];
+    __cpuid(info, 1);
+    b32 os_saves_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28));
+    u64 xcr0 = os_saves_avx ? _xgetbv(0) : 0;
+
+    __cpuidex(info, 7, 0);
+    if ((xcr0 & 0xE6) == 0xE6 && (info[1] & (1 << 16)))
+        return FRUSTUM_CULL_ISA_AVX512;
+    if ((xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)))
+        return FRUSTUM_CULL_ISA_AVX2;
+    return FRUSTUM_CULL_ISA_SSE;
+#elif FRUSTUM_CULL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return FRUSTUM_CULL_ISA_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return FRUSTUM_CULL_ISA_AVX2;
+    return FRUSTUM_CULL_ISA_SSE;
+#else
+    return FRUSTUM_CULL_ISA_SCALAR;
+#endif
+}
+
+u32 frustum_cull_spheres(FrustumCullSet* set, hmm_vec4* planes, u32* visible)
+{
+    if (s_isa < 0)
+        s_isa = frustum_cull_detect_isa();
+
+    return s_sphere_kernels[s_isa](set, planes, visible);
+}
+
+u32 frustum_cull_aabbs(FrustumCullSet* set, hmm_vec4* planes, u32* visible)
+{
+    if (s_isa < 0)
+        s_isa = frustum_cull_detect_isa();
+
+    return s_aabb_kernels[s_isa](set, planes, visible);
+}
+
+#if FRUSTUM_CULL_BENCHMARK_ENABLED
+// Objects culled per measurement, small sets are repeated until they add up to this
+#define FRUSTUM_CULL_BENCHMARK_OBJECTS (64 * 1024 * 1024)
+
+internal const char* s_isa_names[FRUSTUM_CULL_ISA_COUNT] = { "scalar", "sse", "avx2", "avx512" };
+
+internal f32 frustum_cull_benchmark_random(u32* state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return (f32)(*state >> 8) / (f32)(1 << 24);
+}
+
+// Objects per nanosecond
+internal f64 frustum_cull_benchmark_run(frustum_cull_kernel kernel, FrustumCullSet* set, hmm_vec4* planes, u32* visible, u32* visible_count)
+{
+    u32 repeats = max(FRUSTUM_CULL_BENCHMARK_OBJECTS / set->count, 1);
+
+    // Once to warm the caches and for the count the paths are compared on
+    *visible_count = kernel(set, planes, visible);
+
+    f32 start = aurora_platform_get_time();
+    for (u32 r = 0; r < repeats; r++)
+        kernel(set, planes, visible);
+    f32 end = aurora_platform_get_time();
+
+    return (f64)set->count * repeats / ((f64)(end - start) * 1e9);
+}
+
+// Random objects around a camera looking down -Z, culled by every path the CPU supports from cache sized sets up to memory bound ones
+void frustum_cull_benchmark()
+{
+    if (s_isa < 0)
+        s_isa = frustum_cull_detect_isa();
+
+    // Near and far, then right, left, top and bottom through the eye, the inside is on the positive side of each
+    f32 tan_v = HMM_TanF(HMM_ToRadians(75.0f) * 0.5f);
+    f32 tan_h = tan_v * 16.0f / 9.0f;
+
+    hmm_vec4 planes[6];
+    planes[0] = HMM_Vec4(0.0f, 0.0f, -1.0f, 0.1f);
+    planes[1] = HMM_Vec4(0.0f, 0.0f, 1.0f, -1000.0f);
+    planes[2] = HMM_Vec4v(HMM_NormalizeVec3(HMM_Vec3(-1.0f, 0.0f, -tan_h)), 0.0f);
+    planes[3] = HMM_Vec4v(HMM_NormalizeVec3(HMM_Vec3(1.0f, 0.0f, -tan_h)), 0.0f);
+    planes[4] = HMM_Vec4v(HMM_NormalizeVec3(HMM_Vec3(0.0f, -1.0f, -tan_v)), 0.0f);
+    planes[5] = HMM_Vec4v(HMM_NormalizeVec3(HMM_Vec3(0.0f, 1.0f, -tan_v)), 0.0f);
+
+    u32 sizes[] = { 1024, 32 * 1024, 1024 * 1024 };
+
+    printf("Frustum cull benchmark, throughput in objects per ns\n");
+    printf("%9s %-8s %10s %10s %10s %10s\n", "objects", "path", "spheres", "aabbs", "visible", "visible");
+
+    for (u32 s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        FrustumCullSet set;
+        frustum_cull_init(&set, sizes[s]);
+
+        // Boxes fit inside their spheres, so the box test always culls at least as much
+        u32 seed = 0x12345678u;
+        for (u32 i = 0; i < sizes[s]; i++)
+        {
+            hmm_vec3 center = HMM_Vec3(frustum_cull_benchmark_random(&seed) * 1000.0f - 500.0f,
+                                       frustum_cull_benchmark_random(&seed) * 1000.0f - 500.0f,
+                                       frustum_cull_benchmark_random(&seed) * 1000.0f - 500.0f);
+            f32 radius = 0.5f + frustum_cull_benchmark_random(&seed) * 8.0f;
+            hmm_vec3 extent = HMM_MultiplyVec3f(HMM_Vec3(frustum_cull_benchmark_random(&seed), frustum_cull_benchmark_random(&seed), frustum_cull_benchmark_random(&seed)), radius * 0.57f);
+            frustum_cull_add(&set, HMM_Vec4v(center, radius), HMM_SubtractVec3(center, extent), HMM_AddVec3(center, extent));
+        }
+
+        u32* visible = malloc(sizeof(u32) * set.capacity);
+
+        for (i32 isa = 0; isa <= s_isa; isa++)
+        {
+            u32 sphere_visible, aabb_visible;
+            f64 sphere_rate = frustum_cull_benchmark_run(s_sphere_kernels[isa], &set, planes, visible, &sphere_visible);
+            f64 aabb_rate = frustum_cull_benchmark_run(s_aabb_kernels[isa], &set, planes, visible, &aabb_visible);
+            printf("%9u %-8s %10.3f %10.3f %10u %10u\n", sizes[s], s_isa_names[isa], sphere_rate, aabb_rate, sphere_visible, aabb_visible);
+        }
+
+        free(visible);
+        frustum_cull_free(&set);
+    }
+}
+#endif
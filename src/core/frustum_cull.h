@@ -0,0 +1,49 @@
+#ifndef FRUSTUM_CULL_H_INCLUDED
+#define FRUSTUM_CULL_H_INCLUDED
+
+#include "common.h"
+
+#include <HandmadeMath.h>
+
+#define FRUSTUM_CULL_BENCHMARK_ENABLED 0
+
+// Arrays are padded to this many entries so the widest loop never needs a scalar tail
+#define FRUSTUM_CULL_PADDING 16
+
+// World space bounds kept as SoA so every plane is tested against 4, 8 or 16 objects per instruction. The box is
+// stored as center and half extent, which turns the positive vertex test into a dot product with the absolute normal
+typedef struct FrustumCullSet FrustumCullSet;
+struct FrustumCullSet
+{
+    f32* sphere_x;
+    f32* sphere_y;
+    f32* sphere_z;
+    f32* sphere_radius;
+
+    f32* box_x;
+    f32* box_y;
+    f32* box_z;
+    f32* extent_x;
+    f32* extent_y;
+    f32* extent_z;
+
+    u32 count;
+    u32 capacity;
+};
+
+void frustum_cull_init(FrustumCullSet* set, u32 capacity);
+void frustum_cull_free(FrustumCullSet* set);
+void frustum_cull_clear(FrustumCullSet* set);
+
+// Both return the index of the new entry, the set grows as needed
+u32 frustum_cull_add(FrustumCullSet* set, hmm_vec4 sphere, hmm_vec3 aabb_min, hmm_vec3 aabb_max);
+u32 frustum_cull_add_transformed(FrustumCullSet* set, hmm_mat4 transform, hmm_vec4 sphere, hmm_vec3 aabb_min, hmm_vec3 aabb_max);
+
+// Planes as fps_camera_update_frustum builds them, an object is outside once dot(xyz, p) - w <= -radius for any plane.
+// The indices of the visible entries are written in order to visible, which needs room for set->capacity of them
+u32 frustum_cull_spheres(FrustumCullSet* set, hmm_vec4* planes, u32* visible);
+u32 frustum_cull_aabbs(FrustumCullSet* set, hmm_vec4* planes, u32* visible);
+
+void frustum_cull_benchmark();
+
+#endif
@@ -0,0 +1,236 @@
+#include "platform_layer.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JOB_DEQUE_CAPACITY 4096
+#define JOB_MAX_WORKERS 64
+
+#if defined(_MSC_VER)
+#define thread_local __declspec(thread)
+#else
+#define thread_local _Thread_local
+#endif
+
+// Chase-Lev deque: the owning worker pushes and pops at the bottom, everyone else steals from the top.
+typedef struct job_deque job_deque;
+struct job_deque
+{
+    volatile i32 top;
+    volatile i32 bottom;
+    AuroraJob jobs[JOB_DEQUE_CAPACITY];
+};
+
+typedef struct job_worker job_worker;
+struct job_worker
+{
+    u32 index;
+    u32 steal_seed;
+    Thread* thread;
+    job_deque deque;
+};
+
+typedef struct job_system job_system;
+struct job_system
+{
+    // Worker 0 is the thread that initialized the job system, it only runs jobs while waiting on a counter.
+    job_worker* workers;
+    u32 worker_count;
+
+    volatile i32 running;
+    Semaphore* wake;
+};
+
+internal job_system jobs;
+internal thread_local job_worker* current_worker;
+
+internal b32 job_deque_push(job_deque* deque, AuroraJob* job)
+{
+    i32 b = deque->bottom;
+    i32 t = deque->top;
+
+    if (b - t >= JOB_DEQUE_CAPACITY)
+        return 0;
+
+    deque->jobs[b & (JOB_DEQUE_CAPACITY - 1)] = *job;
+    aurora_platform_memory_barrier();
+    deque->bottom = b + 1;
+    return 1;
+}
+
+internal b32 job_deque_pop(job_deque* deque, AuroraJob* out)
+{
+    i32 b = deque->bottom - 1;
+    deque->bottom = b;
+    aurora_platform_memory_barrier();
+    i32 t = deque->top;
+
+    if (t > b)
+    {
+        deque->bottom = t;
+        return 0;
+    }
+
+    *out = deque->jobs[b & (JOB_DEQUE_CAPACITY - 1)];
+    if (t != b)
+        return 1;
+
+    // Last job in the deque, race the thieves for it
+    b32 won = aurora_platform_atomic_compare_exchange(&deque->top, t + 1, t) == t;
+    deque->bottom = t + 1;
+    return won;
+}
+
+internal b32 job_deque_steal(job_deque* deque, AuroraJob* out)
+{
+    i32 t = deque->top;
+    aurora_platform_memory_barrier();
+    i32 b = deque->bottom;
+
+    if (t >= b)
+        return 0;
+
+    *out = deque->jobs[t & (JOB_DEQUE_CAPACITY - 1)];
+    return aurora_platform_atomic_compare_exchange(&deque->top, t + 1, t) == t;
+}
+
+internal void job_execute(AuroraJob* job)
+{
+    job->entry(job->data);
+
+    if (job->counter)
+        aurora_platform_atomic_add(&job->counter->value, -1);
+}
+
+internal b32 job_system_next(job_worker* self, AuroraJob* out)
+{
+    if (job_deque_pop(&self->deque, out))
+        return 1;
+
+    self->steal_seed ^= self->steal_seed << 13;
+    self->steal_seed ^= self->steal_seed >> 17;
+    self->steal_seed ^= self->steal_seed << 5;
+
+    u32 start = self->steal_seed % jobs.worker_count;
+    for (u32 i = 0; i < jobs.worker_count; i++)
+    {
+        u32 victim = (start + i) % jobs.worker_count;
+        if (victim == self->index)
+            continue;
+
+        if (job_deque_steal(&jobs.workers[victim].deque, out))
+            return 1;
+    }
+
+    return 0;
+}
+
+internal void job_worker_main(Thread* thread)
+{
+    job_worker* worker = (job_worker*)aurora_platform_get_thread_ptr(thread);
+    current_worker = worker;
+
+    AuroraJob job;
+    while (jobs.running)
+    {
+        if (job_system_next(worker, &job))
+            job_execute(&job);
+        else
+            aurora_platform_wait_semaphore(jobs.wake);
+    }
+}
+
+void aurora_platform_init_job_system(u32 worker_count)
+{
+    memset(&jobs, 0, sizeof(jobs));
+
+    if (worker_count == 0)
+    {
+        u32 processor_count = aurora_platform_get_processor_count();
+        worker_count = processor_count > 1 ? processor_count - 1 : 1;
+    }
+    if (worker_count > JOB_MAX_WORKERS - 1)
+        worker_count = JOB_MAX_WORKERS - 1;
+
+    jobs.worker_count = worker_count + 1;
+    jobs.workers = calloc(jobs.worker_count, sizeof(job_worker));
+    jobs.wake = aurora_platform_new_semaphore(0);
+    jobs.running = 1;
+
+    for (u32 i = 0; i < jobs.worker_count; i++)
+    {
+        jobs.workers[i].index = i;
+        jobs.workers[i].steal_seed = 0x9E3779B9u * (i + 1);
+    }
+
+    current_worker = &jobs.workers[0];
+    aurora_platform_memory_barrier();
+
+    for (u32 i = 1; i < jobs.worker_count; i++)
+    {
+        jobs.workers[i].thread = aurora_platform_new_thread(job_worker_main);
+        aurora_platform_set_thread_ptr(jobs.workers[i].thread, &jobs.workers[i]);
+        aurora_platform_execute_thread(jobs.workers[i].thread);
+    }
+}
+
+void aurora_platform_free_job_system()
+{
+    if (!jobs.workers)
+        return;
+
+    jobs.running = 0;
+    aurora_platform_memory_barrier();
+    aurora_platform_signal_semaphore(jobs.wake, jobs.worker_count - 1);
+
+    for (u32 i = 1; i < jobs.worker_count; i++)
+        aurora_platform_free_thread(jobs.workers[i].thread);
+
+    aurora_platform_free_semaphore(jobs.wake);
+    free(jobs.workers);
+    memset(&jobs, 0, sizeof(jobs));
+    current_worker = NULL;
+}
+
+u32 aurora_platform_get_job_worker_count()
+{
+    return jobs.worker_count;
+}
+
+void aurora_platform_run_jobs(AuroraJob* job_list, u32 job_count, JobCounter* counter)
+{
+    job_worker* self = current_worker;
+
+    if (counter)
+        aurora_platform_atomic_add(&counter->value, (i32)job_count);
+
+    for (u32 i = 0; i < job_count; i++)
+    {
+        AuroraJob job = job_list[i];
+        job.counter = counter;
+
+        // No job system on this thread or the deque is full: run it right away
+        if (!self || !job_deque_push(&self->deque, &job))
+            job_execute(&job);
+    }
+
+    if (self && job_count > 0)
+        aurora_platform_signal_semaphore(jobs.wake, job_count < jobs.worker_count - 1 ? job_count : jobs.worker_count - 1);
+}
+
+void aurora_platform_wait_for_counter(JobCounter* counter)
+{
+    job_worker* self = current_worker;
+
+    AuroraJob job;
+    while (counter->value > 0)
+    {
+        if (self && job_system_next(self, &job))
+            job_execute(&job);
+        else
+            aurora_platform_yield_thread();
+    }
+
+    aurora_platform_memory_barrier();
+}
@@ -0,0 +1,522 @@
+#if defined(__linux__)
+
+#include "platform_layer.h"
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+AuroraPlatformLayer platform;
+
+typedef struct Linux_Aurora Linux_Aurora;
+struct Linux_Aurora
+{
+    Display* display;
+    Window window;
+    Atom wm_delete_window;
+    f64 timer_start;
+};
+
+internal Linux_Aurora linux_state;
+
+void aurora_platform_layer_init()
+{
+    memset(&platform, 0, sizeof(platform));
+    memset(&linux_state, 0, sizeof(linux_state));
+
+    ssize_t length = readlink("/proc/self/exe", platform.executable_directory, sizeof(platform.executable_directory) - 1);
+    if (length > 0)
+    {
+        platform.executable_directory[length] = '\0';
+        char* separator = strrchr(platform.executable_directory, '/');
+        if (separator)
+            *separator = '\0';
+    }
+
+    aurora_platform_init_timer();
+}
+
+void aurora_platform_layer_free()
+{
+}
+
+void aurora_platform_set_headless(u32 frame_count)
+{
+    platform.headless = 1;
+    platform.headless_frame_count = frame_count;
+}
+
+void aurora_platform_open_window(const char* title)
+{
+    if (platform.headless)
+        return;
+
+    linux_state.display = XOpenDisplay(NULL);
+    assert(linux_state.display);
+
+    i32 screen = DefaultScreen(linux_state.display);
+    Window root = RootWindow(linux_state.display, screen);
+
+    XSetWindowAttributes attributes = {0};
+    attributes.event_mask = StructureNotifyMask | KeyPressMask | KeyReleaseMask | ButtonPressMask | ButtonReleaseMask | PointerMotionMask;
+
+    linux_state.window = XCreateWindow(linux_state.display, root, 0, 0, platform.width, platform.height, 0,
+                                       CopyFromParent, InputOutput, CopyFromParent, CWEventMask, &attributes);
+    assert(linux_state.window);
+
+    XStoreName(linux_state.display, linux_state.window, title);
+
+    linux_state.wm_delete_window = XInternAtom(linux_state.display, "WM_DELETE_WINDOW", False);
+    XSetWMProtocols(linux_state.display, linux_state.window, &linux_state.wm_delete_window, 1);
+
+    XMapWindow(linux_state.display, linux_state.window);
+    XFlush(linux_state.display);
+}
+
+void aurora_platform_update_window()
+{
+    platform.frame_index++;
+
+    if (platform.headless)
+    {
+        // Headless runs render a fixed amount of frames, zero means run until killed
+        if (platform.headless_frame_count && platform.frame_index >= platform.headless_frame_count)
+            platform.quit = 1;
+        return;
+    }
+
+    while (XPending(linux_state.display))
+    {
+        XEvent event;
+        XNextEvent(linux_state.display, &event);
+
+        switch (event.type)
+        {
+        case ClientMessage:
+            if ((Atom)event.xclient.data.l[0] == linux_state.wm_delete_window)
+                platform.quit = 1;
+            break;
+        case ConfigureNotify:
+            if ((u32)event.xconfigure.width != platform.width || (u32)event.xconfigure.height != platform.height)
+            {
+                platform.width = event.xconfigure.width;
+                platform.height = event.xconfigure.height;
+                if (platform.resize_event != NULL)
+                    platform.resize_event(platform.width, platform.height);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void aurora_platform_free_window()
+{
+    if (!linux_state.display)
+        return;
+
+    XDestroyWindow(linux_state.display, linux_state.window);
+    XCloseDisplay(linux_state.display);
+    linux_state.display = NULL;
+}
+
+char* aurora_platform_read_file(const char* path, u32* out_size)
+{
+    FILE* file = fopen(path, "rb");
+
+    if (!file)
+    {
+        assert(0);
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    u32 filesizepadded = (size % 4 == 0 ? size * 4 : (size + 1) * 4) / 4;
+    char* buffer = malloc(filesizepadded);
+
+    if (!buffer)
+    {
+        fclose(file);
+        *out_size = 0;
+        assert(0);
+        return NULL;
+    }
+
+    fread(buffer, size, sizeof(char), file);
+    fclose(file);
+
+    *out_size = (u32)size;
+    return buffer;
+}
+
+void* aurora_platform_map_file(const char* path, u64* out_size)
+{
+    i32 fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    void* ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (ptr == MAP_FAILED)
+        return NULL;
+
+    madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+    *out_size = (u64)st.st_size;
+    return ptr;
+}
+
+void aurora_platform_unmap_file(void* ptr, u64 size)
+{
+    if (ptr)
+        munmap(ptr, size);
+}
+
+b32 aurora_platform_get_file_stamp(const char* path, u64* out_size, u64* out_time)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return 0;
+
+    *out_size = (u64)st.st_size;
+    *out_time = (u64)st.st_mtime;
+    return 1;
+}
+
+void aurora_platform_create_vk_surface(VkInstance instance, VkSurfaceKHR* out)
+{
+    if (platform.headless)
+    {
+        *out = VK_NULL_HANDLE;
+        return;
+    }
+
+    VkXlibSurfaceCreateInfoKHR surface_create_info = {0};
+    surface_create_info.sType = VK_STRUCTURE_TYPE_XLIB_SURFACE_CREATE_INFO_KHR;
+    surface_create_info.dpy = linux_state.display;
+    surface_create_info.window = linux_state.window;
+
+    vkCreateXlibSurfaceKHR(instance, &surface_create_info, NULL, out);
+}
+
+internal f64 linux_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (f64)ts.tv_sec + (f64)ts.tv_nsec * 1e-9;
+}
+
+void aurora_platform_init_timer()
+{
+    linux_state.timer_start = linux_now();
+}
+
+f32 aurora_platform_get_time()
+{
+    return (f32)(linux_now() - linux_state.timer_start);
+}
+
+internal KeySym linux_key_to_keysym(u32 key)
+{
+    if (key >= KEY_A && key <= KEY_Z) return XK_a + (key - KEY_A);
+    if (key >= KEY_D0 && key <= KEY_D9) return XK_0 + (key - KEY_D0);
+    if (key >= KEY_F1 && key <= KEY_F24) return XK_F1 + (key - KEY_F1);
+    if (key >= KEY_KP0 && key <= KEY_KP9) return XK_KP_0 + (key - KEY_KP0);
+
+    switch (key)
+    {
+    case KEY_SPACE: return XK_space;
+    case KEY_COMMA: return XK_comma;
+    case KEY_MINUS: return XK_minus;
+    case KEY_PERIOD: return XK_period;
+    case KEY_SEMICOLON: return XK_semicolon;
+    case KEY_LEFTBRACKET: return XK_bracketleft;
+    case KEY_BACKSLASH: return XK_backslash;
+    case KEY_RIGHTBRACKENT: return XK_bracketright;
+    case KEY_GRAVEACCENT: return XK_grave;
+    case KEY_BACKSPACE: return XK_BackSpace;
+    case KEY_ENTER: return XK_Return;
+    case KEY_TAB: return XK_Tab;
+    case KEY_PAUSE: return XK_Pause;
+    case KEY_NUMLOCK: return XK_Num_Lock;
+    case KEY_SCROLLLOCK: return XK_Scroll_Lock;
+    case KEY_CAPSLOCK: return XK_Caps_Lock;
+    case KEY_ESCAPE: return XK_Escape;
+    case KEY_PAGEUP: return XK_Page_Up;
+    case KEY_PAGEDOWN: return XK_Page_Down;
+    case KEY_END: return XK_End;
+    case KEY_HOME: return XK_Home;
+    case KEY_LEFT: return XK_Left;
+    case KEY_UP: return XK_Up;
+    case KEY_RIGHT: return XK_Right;
+    case KEY_DOWN: return XK_Down;
+    case KEY_PRINTSCREEN: return XK_Print;
+    case KEY_INSERT: return XK_Insert;
+    case KEY_DELETE: return XK_Delete;
+    case KEY_KPMULTIPLY: return XK_KP_Multiply;
+    case KEY_KPADD: return XK_KP_Add;
+    case KEY_KPEQUAL: return XK_KP_Equal;
+    case KEY_KPSUBSTRACT: return XK_KP_Subtract;
+    case KEY_KPDECIMAL: return XK_KP_Decimal;
+    case KEY_KPDIVIDE: return XK_KP_Divide;
+    case KEY_LEFTSHIFT: return XK_Shift_L;
+    case KEY_RIGHTSHIFT: return XK_Shift_R;
+    case KEY_LEFTCONTROL: return XK_Control_L;
+    case KEY_RIGHTCONTROL: return XK_Control_R;
+    case KEY_LEFTALT: return XK_Alt_L;
+    case KEY_RIGHTALT: return XK_Alt_R;
+    }
+
+    return NoSymbol;
+}
+
+b32 aurora_platform_key_pressed(u32 key)
+{
+    if (!linux_state.display)
+        return 0;
+
+    KeySym sym = linux_key_to_keysym(key);
+    if (sym == NoSymbol)
+        return 0;
+
+    KeyCode code = XKeysymToKeycode(linux_state.display, sym);
+    if (!code)
+        return 0;
+
+    char keys[32];
+    XQueryKeymap(linux_state.display, keys);
+    return (b32)((keys[code / 8] >> (code % 8)) & 1);
+}
+
+internal b32 linux_query_pointer(i32* x, i32* y, u32* mask)
+{
+    if (!linux_state.display)
+        return 0;
+
+    Window root, child;
+    i32 window_x, window_y;
+    return (b32)XQueryPointer(linux_state.display, DefaultRootWindow(linux_state.display), &root, &child, x, y, &window_x, &window_y, mask);
+}
+
+b32 aurora_platform_mouse_button_pressed(u32 button)
+{
+    i32 x, y;
+    u32 mask = 0;
+    if (!linux_query_pointer(&x, &y, &mask))
+        return 0;
+
+    switch (button)
+    {
+    case MOUSE_LEFT: return (b32)(mask & Button1Mask);
+    case MOUSE_MIDDLE: return (b32)(mask & Button2Mask);
+    case MOUSE_RIGHT: return (b32)(mask & Button3Mask);
+    }
+
+    return 0;
+}
+
+f32 aurora_platform_get_mouse_x()
+{
+    i32 x = 0, y = 0;
+    u32 mask;
+    linux_query_pointer(&x, &y, &mask);
+    return (f32)x;
+}
+
+f32 aurora_platform_get_mouse_y()
+{
+    i32 x = 0, y = 0;
+    u32 mask;
+    linux_query_pointer(&x, &y, &mask);
+    return (f32)y;
+}
+
+struct Thread
+{
+    pthread_t handle;
+    b32 started;
+    void* ptr;
+    b32 working;
+    AuroraThreadWorker worker;
+};
+
+internal void* _thread_worker(void* arg)
+{
+    Thread* thread = (Thread*)arg;
+
+    thread->working = 1;
+    thread->worker(thread);
+
+    return NULL;
+}
+
+Thread* aurora_platform_new_thread(AuroraThreadWorker worker)
+{
+    Thread* thread = calloc(1, sizeof(Thread));
+    thread->worker = worker;
+    return thread;
+}
+
+void aurora_platform_free_thread(Thread* thread)
+{
+    aurora_platform_join_thread(thread);
+    free(thread);
+}
+
+void aurora_platform_execute_thread(Thread* thread)
+{
+    thread->started = pthread_create(&thread->handle, NULL, _thread_worker, thread) == 0;
+}
+
+void aurora_platform_join_thread(Thread* thread)
+{
+    thread->working = 0;
+    if (!thread->started) return;
+
+    pthread_join(thread->handle, NULL);
+    thread->started = 0;
+}
+
+b32 aurora_platform_active_thread(Thread* thread)
+{
+    return thread->working;
+}
+
+void* aurora_platform_get_thread_ptr(Thread* thread)
+{
+    return thread->ptr;
+}
+
+void aurora_platform_set_thread_ptr(Thread* thread, void* ptr)
+{
+    thread->ptr = ptr;
+}
+
+struct Mutex
+{
+    pthread_mutex_t handle;
+
+    void* ptr;
+};
+
+Mutex* aurora_platform_new_mutex(u64 size)
+{
+    Mutex* mutex = calloc(1, sizeof(Mutex));
+
+    pthread_mutex_init(&mutex->handle, NULL);
+
+    if (size > 0)
+        mutex->ptr = malloc(size);
+
+    return mutex;
+}
+
+void aurora_platform_free_mutex(Mutex* mutex)
+{
+    pthread_mutex_destroy(&mutex->handle);
+
+    if (mutex->ptr)
+        free(mutex->ptr);
+
+    free(mutex);
+}
+
+void aurora_platform_lock_mutex(Mutex* mutex)
+{
+    pthread_mutex_lock(&mutex->handle);
+}
+
+void aurora_platform_unlock_mutex(Mutex* mutex)
+{
+    pthread_mutex_unlock(&mutex->handle);
+}
+
+void* aurora_platform_mutex_get_ptr(Mutex* mutex)
+{
+    return mutex->ptr;
+}
+
+struct Semaphore
+{
+    sem_t handle;
+};
+
+Semaphore* aurora_platform_new_semaphore(u32 initial_count)
+{
+    Semaphore* semaphore = malloc(sizeof(Semaphore));
+    sem_init(&semaphore->handle, 0, initial_count);
+    return semaphore;
+}
+
+void aurora_platform_free_semaphore(Semaphore* semaphore)
+{
+    sem_destroy(&semaphore->handle);
+    free(semaphore);
+}
+
+void aurora_platform_signal_semaphore(Semaphore* semaphore, u32 count)
+{
+    for (u32 i = 0; i < count; i++)
+        sem_post(&semaphore->handle);
+}
+
+void aurora_platform_wait_semaphore(Semaphore* semaphore)
+{
+    while (sem_wait(&semaphore->handle) != 0 && errno == EINTR)
+        ;
+}
+
+i32 aurora_platform_atomic_add(volatile i32* addend, i32 value)
+{
+    return __atomic_add_fetch(addend, value, __ATOMIC_SEQ_CST);
+}
+
+i32 aurora_platform_atomic_compare_exchange(volatile i32* dest, i32 exchange, i32 comparand)
+{
+    i32 expected = comparand;
+    __atomic_compare_exchange_n(dest, &expected, exchange, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return expected;
+}
+
+void aurora_platform_memory_barrier()
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void aurora_platform_yield_thread()
+{
+    sched_yield();
+}
+
+u32 aurora_platform_get_processor_count()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (u32)count : 1;
+}
+
+#endif
@@ -9,9 +9,26 @@
 
 typedef struct Thread Thread;
 typedef struct Mutex Mutex;
+typedef struct Semaphore Semaphore;
+typedef struct JobCounter JobCounter;
+typedef struct AuroraJob AuroraJob;
 
 typedef void (*AuroraResizeEvent)(u32, u32);
 typedef void (*AuroraThreadWorker)(Thread*);
+typedef void (*AuroraJobEntry)(void*);
+
+// Jobs are pushed in batches and tracked by a counter that drops to zero once every job of the batch has run.
+struct JobCounter
+{
+    volatile i32 value;
+};
+
+struct AuroraJob
+{
+    AuroraJobEntry entry;
+    void* data;
+    JobCounter* counter;
+};
 
 typedef struct AuroraPlatformLayer AuroraPlatformLayer;
 struct AuroraPlatformLayer
@@ -19,6 +36,11 @@ struct AuroraPlatformLayer
     u32 width;
     u32 height;
     b32 quit;
+
+    // Headless: no window and no surface, the game quits after headless_frame_count frames (0 = never)
+    b32 headless;
+    u32 headless_frame_count;
+    u32 frame_index;
     
     char executable_directory[512];
 
@@ -31,7 +53,11 @@ void  	aurora_platform_layer_init();
 void  	aurora_platform_layer_free();
 
 char* 	aurora_platform_read_file(const char* path, u32* out_size);
+void* 	aurora_platform_map_file(const char* path, u64* out_size);
+void  	aurora_platform_unmap_file(void* ptr, u64 size);
+b32   	aurora_platform_get_file_stamp(const char* path, u64* out_size, u64* out_time);
 
+void  	aurora_platform_set_headless(u32 frame_count);
 void  	aurora_platform_open_window(const char* title);
 void  	aurora_platform_update_window();
 void  	aurora_platform_free_window();
@@ -59,4 +85,23 @@ void    aurora_platform_lock_mutex(Mutex* mutex);
 void    aurora_platform_unlock_mutex(Mutex* mutex);
 void*   aurora_platform_mutex_get_ptr(Mutex* mutex);
 
+Semaphore* aurora_platform_new_semaphore(u32 initial_count);
+void       aurora_platform_free_semaphore(Semaphore* semaphore);
+void       aurora_platform_signal_semaphore(Semaphore* semaphore, u32 count);
+void       aurora_platform_wait_semaphore(Semaphore* semaphore);
+
+i32     aurora_platform_atomic_add(volatile i32* addend, i32 value);
+i32     aurora_platform_atomic_compare_exchange(volatile i32* dest, i32 exchange, i32 comparand);
+void    aurora_platform_memory_barrier();
+void    aurora_platform_yield_thread();
+u32     aurora_platform_get_processor_count();
+
+// Job system (core/job_system.c): persistent workers with per-worker work-stealing deques.
+// Jobs must be submitted from the thread that initialized the job system or from inside a running job.
+void    aurora_platform_init_job_system(u32 worker_count);
+void    aurora_platform_free_job_system();
+u32     aurora_platform_get_job_worker_count();
+void    aurora_platform_run_jobs(AuroraJob* jobs, u32 job_count, JobCounter* counter);
+void    aurora_platform_wait_for_counter(JobCounter* counter);
+
 #endif //PLATFORM_LAYER_H
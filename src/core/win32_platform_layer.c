@@ -1,3 +1,5 @@
+#if defined(_WIN32)
+
 #include "platform_layer.h"
 
 #include <Windows.h>
@@ -58,8 +60,17 @@ void aurora_platform_layer_free()
 {
 }
 
+void aurora_platform_set_headless(u32 frame_count)
+{
+    platform.headless = 1;
+    platform.headless_frame_count = frame_count;
+}
+
 void aurora_platform_open_window(const char* title)
 {
+    if (platform.headless)
+        return;
+
     WNDCLASSA wnd_class = {0};
     wnd_class.hInstance = (HINSTANCE)windows.application_hmodule;
     wnd_class.lpszClassName = "aurora_window_class";
@@ -74,6 +85,16 @@ void aurora_platform_open_window(const char* title)
 
 void aurora_platform_update_window()
 {
+    platform.frame_index++;
+
+    if (platform.headless)
+    {
+        // Headless runs render a fixed amount of frames, zero means run until killed
+        if (platform.headless_frame_count && platform.frame_index >= platform.headless_frame_count)
+            platform.quit = 1;
+        return;
+    }
+
     MSG msg;
     while (PeekMessage(&msg, windows.hwnd, 0, 0, PM_REMOVE))
     {
@@ -84,6 +105,9 @@ void aurora_platform_update_window()
 
 void aurora_platform_free_window()
 {
+    if (!windows.hwnd)
+        return;
+
     DestroyWindow(windows.hwnd);
 }
 
@@ -126,8 +150,59 @@ char* aurora_platform_read_file(const char* path, u32* out_size)
     return NULL;
 }
 
+void* aurora_platform_map_file(const char* path, u64* out_size)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping)
+        return NULL;
+
+    // The view keeps the mapping alive, so both handles can be closed right away
+    void* ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+
+    if (ptr)
+        *out_size = (u64)size.QuadPart;
+    return ptr;
+}
+
+void aurora_platform_unmap_file(void* ptr, u64 size)
+{
+    (void)size;
+    if (ptr)
+        UnmapViewOfFile(ptr);
+}
+
+b32 aurora_platform_get_file_stamp(const char* path, u64* out_size, u64* out_time)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data))
+        return 0;
+
+    *out_size = ((u64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    *out_time = ((u64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+    return 1;
+}
+
 void aurora_platform_create_vk_surface(VkInstance instance, VkSurfaceKHR* out)
 {
+    if (platform.headless)
+    {
+        *out = VK_NULL_HANDLE;
+        return;
+    }
+
     VkWin32SurfaceCreateInfoKHR surface_create_info = {0};
     surface_create_info.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
     surface_create_info.hinstance = windows.application_hmodule;
@@ -288,3 +363,64 @@ void* aurora_platform_mutex_get_ptr(Mutex* mutex)
 {
     return mutex->ptr;
 }
+
+struct Semaphore
+{
+    HANDLE handle;
+};
+
+Semaphore* aurora_platform_new_semaphore(u32 initial_count)
+{
+    Semaphore* semaphore = malloc(sizeof(Semaphore));
+
+    semaphore->handle = CreateSemaphoreA(NULL, (LONG)initial_count, LONG_MAX, NULL);
+    assert(semaphore->handle);
+
+    return semaphore;
+}
+
+void aurora_platform_free_semaphore(Semaphore* semaphore)
+{
+    CloseHandle(semaphore->handle);
+    free(semaphore);
+}
+
+void aurora_platform_signal_semaphore(Semaphore* semaphore, u32 count)
+{
+    if (count > 0)
+        ReleaseSemaphore(semaphore->handle, (LONG)count, NULL);
+}
+
+void aurora_platform_wait_semaphore(Semaphore* semaphore)
+{
+    WaitForSingleObject(semaphore->handle, INFINITE);
+}
+
+i32 aurora_platform_atomic_add(volatile i32* addend, i32 value)
+{
+    return (i32)InterlockedExchangeAdd((volatile LONG*)addend, (LONG)value) + value;
+}
+
+i32 aurora_platform_atomic_compare_exchange(volatile i32* dest, i32 exchange, i32 comparand)
+{
+    return (i32)InterlockedCompareExchange((volatile LONG*)dest, (LONG)exchange, (LONG)comparand);
+}
+
+void aurora_platform_memory_barrier()
+{
+    MemoryBarrier();
+}
+
+void aurora_platform_yield_thread()
+{
+    SwitchToThread();
+}
+
+u32 aurora_platform_get_processor_count()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (u32)info.dwNumberOfProcessors;
+}
+
+#endif
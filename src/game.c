@@ -2,9 +2,11 @@
 
 #include <core/platform_layer.h>
 #include <core/random.h>
+#include <core/frustum_cull.h>
 #include <client/camera.h>
 #include <gfx/rhi.h>
 #include <gfx/render_graph.h>
+#include <gfx/light_cull_pass.h>
 #include <gfx/geometry_pass.h>
 #include <gfx/fxaa_pass.h>
 #include <gfx/final_blit_pass.h>
@@ -12,6 +14,8 @@
 #include <resource/mesh.h>
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 typedef struct GameData GameData;
@@ -23,6 +27,7 @@ struct GameData
 
     RenderGraph rg;
     RenderGraphExecute rge;
+    RenderGraphNode* lcp;
     RenderGraphNode* gp;
     RenderGraphNode* fxaap;
     RenderGraphNode* fbp;
@@ -45,13 +50,25 @@ void game_resize(u32 width, u32 height)
     resize_render_graph(&data.rg, &data.rge);
 }
 
-void game_init()
+void game_init(int argc, char** argv)
 {
     data.update_frustum = 1;
 
     srand(time(NULL));
 
     aurora_platform_layer_init();
+    aurora_platform_init_job_system(0);
+
+    // --headless [frames]: render offscreen without a window, e.g. for benchmarking on lavapipe
+    // --vertex-pipeline: draw meshlets without mesh shaders even when the device has them
+    for (i32 i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--headless") == 0)
+            aurora_platform_set_headless(i + 1 < argc ? (u32)atoi(argv[i + 1]) : 0);
+        if (strcmp(argv[i], "--vertex-pipeline") == 0)
+            rhi_force_vertex_pipeline();
+    }
+
     platform.width = 1280;
     platform.height = 720;
     platform.resize_event = game_resize;
@@ -61,35 +78,60 @@ void game_init()
     fps_camera_init(&data.camera);
     init_render_graph(&data.rg, &data.rge);
 
+    set_render_graph_light_count(&data.rge, TEST_LIGHT_COUNT);
     for (i32 i = 0; i < TEST_LIGHT_COUNT; i++)
     {
-     data.rge.light_info.lights[i].position.X = random_float(-3.0f, 3.0f);
-     data.rge.light_info.lights[i].position.Y = random_float(-1.0f, -5.0f);
-     data.rge.light_info.lights[i].position.Z = random_float(-3.0f, 3.0f);
-
-     data.rge.light_info.lights[i].color.X = random_float(0.1f, 4.0f);
-     data.rge.light_info.lights[i].color.Y = random_float(0.1f, 4.0f);
-     data.rge.light_info.lights[i].color.Z = random_float(0.1f, 4.0f);
+     RenderGraphPointLight light = { 0 };
+     light.position.X = random_float(-3.0f, 3.0f);
+     light.position.Y = random_float(-1.0f, -5.0f);
+     light.position.Z = random_float(-3.0f, 3.0f);
+
+     light.color.X = random_float(0.1f, 4.0f);
+     light.color.Y = random_float(0.1f, 4.0f);
+     light.color.Z = random_float(0.1f, 4.0f);
+     set_render_graph_light(&data.rge, i, &light);
     }
-    data.rge.light_info.light_count = TEST_LIGHT_COUNT;
+
+#if MESHLET_BENCHMARK_ENABLED
+    mesh_benchmark_meshlet_builders(TEST_MODEL_SPONZA ? "assets/Sponza.gltf" : "assets/DamagedHelmet.gltf");
+#endif
+
+#if FRUSTUM_CULL_BENCHMARK_ENABLED
+    frustum_cull_benchmark();
+#endif
 
     f64 start = aurora_platform_get_time();
 
 #if TEST_MODEL_SPONZA
-    mesh_load(&data.test_model, "assets/Sponza.gltf");
+    if (!mesh_load_cooked(&data.test_model, "assets/Sponza.amesh"))
+    {
+        // Cook on first run or once the glTF changed, fall back to the glTF if the cooked file can't be written
+        if (!mesh_cook("assets/Sponza.gltf", "assets/Sponza.amesh") || !mesh_load_cooked(&data.test_model, "assets/Sponza.amesh"))
+            mesh_load(&data.test_model, "assets/Sponza.gltf");
+    }
 #elif TEST_MODEL_HELMET
-    mesh_load(&data.test_model, "assets/DamagedHelmet.gltf");
+    if (!mesh_load_cooked(&data.test_model, "assets/DamagedHelmet.amesh"))
+    {
+        // Cook on first run or once the glTF changed, fall back to the glTF if the cooked file can't be written
+        if (!mesh_cook("assets/DamagedHelmet.gltf", "assets/DamagedHelmet.amesh") || !mesh_load_cooked(&data.test_model, "assets/DamagedHelmet.amesh"))
+            mesh_load(&data.test_model, "assets/DamagedHelmet.gltf");
+    }
 #endif
     f64 end = aurora_platform_get_time();
     printf("Model loaded in %f seconds", end - start);
 
+    // The uploads are still in flight on the transfer queue, the first frame waits for them on the GPU
+    rhi_wait_upload_gpu(data.test_model.upload_ticket);
+
     data.rge.models[0] = data.test_model;
     data.rge.model_count++;
 
+    data.lcp = create_light_cull_pass();
     data.gp = create_geometry_pass();
     data.fxaap = create_fxaa_pass();
     data.fbp = create_final_blit_pass();
      
+    connect_render_graph_nodes(&data.rg, LightCullPassOutputClusters, GeometryPassInputLightClusters, data.lcp, data.gp);
     connect_render_graph_nodes(&data.rg, GeometryPassOutputLit, FXAAPassInputColor, data.gp, data.fxaap);
     connect_render_graph_nodes(&data.rg, FXAAPassOutputAntiAliased, FinalBlitPassInputImage, data.fxaap, data.fbp);
     bake_render_graph(&data.rg, &data.rge, data.fbp);
@@ -97,15 +139,15 @@ void game_init()
 
 void game_update()
 {
+    f32 loop_start = aurora_platform_get_time();
+
     while (!platform.quit)
     {
         f32 time = aurora_platform_get_time();
     f32 dt = time - data.last_frame;
     data.last_frame = time;
 
-    data.rge.camera.projection = data.camera.projection;
-    data.rge.camera.view = data.camera.view;
-        data.rge.camera.pos = data.camera.position;
+    set_render_graph_camera(&data.rge, data.camera.projection, data.camera.view, data.camera.position, CAMERA_NEAR, CAMERA_FAR);
 
     if (aurora_platform_key_pressed(KEY_W))
         data.update_frustum = 0;
@@ -114,20 +156,25 @@ void game_update()
     update_render_graph(&data.rg, &data.rge);
     rhi_end();
 
-    f32 start = aurora_platform_get_time();
     rhi_present();
-    f32 end = aurora_platform_get_time();
 
     fps_camera_input(&data.camera, dt);
     fps_camera_update(&data.camera, dt);
     if (data.update_frustum)
         fps_camera_update_frustum(&data.camera);
 
-    for (i32 i = 0; i < 6; i++)
-        data.rge.camera.frustrum_planes[i] = data.camera.frustum_planes[i];
+    set_render_graph_frustum(&data.rge, data.camera.frustum_planes);
 
         aurora_platform_update_window();
    }
+
+    if (platform.headless)
+    {
+        f32 loop_time = aurora_platform_get_time() - loop_start;
+        printf("Headless run: %u frames in %.3fs (%.3f ms/frame)\n", platform.frame_index, loop_time, platform.frame_index ? loop_time * 1000.0f / platform.frame_index : 0.0f);
+        printf("Meshlets: %u early, %u late, %u backface culled, %u frustum culled, %u occlusion culled, %u primitives culled\n", data.rge.meshlet_stats.early_drawn, data.rge.meshlet_stats.late_drawn, data.rge.meshlet_stats.backface_culled, data.rge.meshlet_stats.frustum_culled, data.rge.meshlet_stats.occlusion_culled, data.rge.meshlet_stats.primitive_culled);
+        printf("CPU frustum cull: %u primitives, %u models culled\n", data.rge.cpu_cull_stats.primitive_culled, data.rge.cpu_cull_stats.model_culled);
+    }
 }
 
 void game_exit()
@@ -147,5 +194,6 @@ void game_exit()
     rhi_shutdown();
     
     aurora_platform_free_window();
+    aurora_platform_free_job_system();
     aurora_platform_layer_free();
 }
@@ -4,6 +4,6 @@
 #define TEST_MODEL_SPONZA 1
 #define TEST_MODEL_HELMET 0
 
-void game_init();
+void game_init(int argc, char** argv);
 void game_update();
 void game_exit();
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <core/platform_layer.h>
 #include <stdio.h>
+#include <string.h>
 
 typedef struct fxaa_pass_data fxaa_pass_data;
 struct fxaa_pass_data
@@ -79,6 +80,7 @@ void fxaa_pass_init(RenderGraphNode* node, RenderGraphExecute* execute)
 
 void fxaa_pass_free(RenderGraphNode* node, RenderGraphExecute* execute)
 {
+    (void)execute;
     fxaa_pass_data* data = node->private_data;
 
     rhi_free_pipeline(&data->fxaa_pipeline);
@@ -92,8 +94,6 @@ void fxaa_pass_free(RenderGraphNode* node, RenderGraphExecute* execute)
 
 void fxaa_pass_update(RenderGraphNode* node, RenderGraphExecute* execute)
 {
-    f64 start = aurora_platform_get_time();
-
     fxaa_pass_data* data = node->private_data;
 
     RHI_CommandBuffer* cmd_buf = rhi_get_swapchain_cmd_buf();
@@ -127,16 +127,15 @@ void fxaa_pass_update(RenderGraphNode* node, RenderGraphExecute* execute)
     rhi_cmd_end_render(cmd_buf);
 
     rhi_cmd_img_transition_layout(cmd_buf, &node->outputs[0], VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0);
-
-    f64 end = aurora_platform_get_time();
-    //printf("FXAA pass: composite + aa execution took %f ms\n", (end - start) * 1000);
 }
 
 void fxaa_pass_resize(RenderGraphNode* node, RenderGraphExecute* execute)
 {
     fxaa_pass_data* data = node->private_data;
 
+    rhi_begin_descriptor_writes();
     rhi_descriptor_set_write_image(&data->fxaa_set, get_render_graph_node_input_image(&node->inputs[0]), 0);
+    rhi_end_descriptor_writes();
     rhi_resize_image(&node->outputs[0], execute->width, execute->height);
 }
 
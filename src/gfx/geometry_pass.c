@@ -1,7 +1,35 @@
 #include "geometry_pass.h"
 
 #include <core/platform_layer.h>
+#include <core/frustum_cull.h>
+#include <assert.h>
 #include <stdio.h>
+#include <string.h>
+
+#define DEPTH_PYRAMID_MAX_LEVELS 16
+// Keep in sync with GROUP_SIZE in draw_cull.comp
+#define DRAW_CULL_GROUP_SIZE 128
+
+// Phase 0 draws the meshlets visible last frame, phase 1 culls the rest against the depth pyramid
+typedef struct gbuffer_constants gbuffer_constants;
+struct gbuffer_constants
+{
+    u32 phase;
+    f32 lod_scale;
+    u32 pyramid_levels;
+    u32 pad;
+};
+
+// The cull pass turns every entry of the instance table into an indirect task dispatch for the same phase.
+// Without a GPU draw count every instance writes to its own slot, culled ones as empty draws
+typedef struct draw_cull_constants draw_cull_constants;
+struct draw_cull_constants
+{
+    u32 phase;
+    u32 instance_count;
+    u32 pyramid_levels;
+    u32 fixed_slots;
+};
 
 typedef struct geometry_pass geometry_pass;
 struct geometry_pass
@@ -23,6 +51,26 @@ struct geometry_pass
     RHI_Pipeline brdf_pipeline;
     RHI_Pipeline gbuffer_pipeline;
     RHI_Pipeline deferred_pipeline;
+    RHI_Pipeline depth_pyramid_pipeline;
+    RHI_Pipeline draw_cull_pipeline;
+
+    // Without mesh shaders a compute pass does the task shader's work and the survivors go through gbuffer.vert
+    b32 mesh_shaders;
+    b32 draw_indirect_count;
+    RHI_Pipeline meshlet_cull_pipeline;
+    // Stages and accesses that consume the cull results, and the stage that reads the depth pyramid for clusters
+    u32 draw_stages;
+    u32 draw_access;
+    u32 cluster_cull_stage;
+
+    // World space bounds of every model's primitives, rebuilt when models are added. The primitives inside the
+    // frustum make up the frame's instance table, the scene primitive index of each one
+    FrustumCullSet primitive_bounds;
+    u32* primitive_models;
+    u32* primitive_indices;
+    u32* visible_primitives;
+    i32 bounds_model_count;
+    u32 instance_count;
 
     RHI_Image hdr_cubemap;
     RHI_Image cubemap;
@@ -35,8 +83,21 @@ struct geometry_pass
     RHI_Image gAlbedo;
     RHI_Image gMetallicRoughness;
 
+    // Max depth mip chain built from the early phase depth, full chain bound to the cull set
+    RHI_Image depth_pyramid;
+    RHI_DescriptorSetLayout depth_pyramid_set_layout;
+    RHI_DescriptorSet depth_pyramid_sets[DEPTH_PYRAMID_MAX_LEVELS];
+
+    // One draw slot per instance for the whole scene, behind a single draw count the cull pass bumps atomically
+    RHI_UniformRing cull_stats_buffer;
+    RHI_UniformRing instance_buffer;
+    RHI_Buffer draw_buffer;
+    RHI_Buffer indexed_draw_buffer;
+    RHI_DescriptorSetLayout cull_set_layout;
+    RHI_DescriptorSet cull_set;
+
     RHI_Buffer screen_vertex_buffer;
-    RHI_Buffer render_params_buffer;
+    RHI_UniformRing render_params_buffer;
 
     RHI_DescriptorSetLayout cubemap_set_layout;
     RHI_DescriptorSet cubemap_set;
@@ -60,11 +121,62 @@ struct geometry_pass
     RHI_DescriptorSet brdf_set;
 };
 
+void geometry_pass_allocate_depth_pyramid(RenderGraphNode* node, RenderGraphExecute* execute, geometry_pass* data)
+{
+    // Previous power of two so every level is exactly half of the one above
+    u32 width = 1;
+    u32 height = 1;
+    while (width * 2 <= execute->width)
+        width *= 2;
+    while (height * 2 <= execute->height)
+        height *= 2;
+
+    u32 levels = 1;
+    while ((width | height) >> levels)
+        levels++;
+    assert(levels <= DEPTH_PYRAMID_MAX_LEVELS);
+
+    rhi_allocate_image_mips(&data->depth_pyramid, width, height, VK_FORMAT_R32_SFLOAT, IMAGE_STORAGE, VK_IMAGE_LAYOUT_GENERAL, levels);
+
+    rhi_begin_descriptor_writes();
+    rhi_descriptor_set_write_image(&data->depth_pyramid_sets[0], &node->outputs[1], 0);
+    for (u32 i = 0; i < levels; i++)
+    {
+        if (i > 0)
+            rhi_descriptor_set_write_image_mip(&data->depth_pyramid_sets[i], &data->depth_pyramid, i - 1, 0);
+        rhi_descriptor_set_write_storage_image_mip(&data->depth_pyramid_sets[i], &data->depth_pyramid, i, 1);
+    }
+    rhi_descriptor_set_write_image_mip(&data->cull_set, &data->depth_pyramid, -1, 0);
+    rhi_end_descriptor_writes();
+}
+
 void geometry_pass_init(RenderGraphNode* node, RenderGraphExecute* execute)
 {
     geometry_pass* data = node->private_data;
     data->parameters.show_meshlets = 0;
     data->parameters.shade_meshlets = 0;
+
+    frustum_cull_init(&data->primitive_bounds, MESH_SCENE_MAX_PRIMITIVES);
+    data->primitive_models = malloc(sizeof(u32) * data->primitive_bounds.capacity);
+    data->primitive_indices = malloc(sizeof(u32) * data->primitive_bounds.capacity);
+    data->visible_primitives = malloc(sizeof(u32) * data->primitive_bounds.capacity);
+    data->bounds_model_count = 0;
+    data->instance_count = 0;
+
+    data->mesh_shaders = rhi_has_mesh_shaders();
+    data->draw_indirect_count = rhi_has_draw_indirect_count();
+    if (data->mesh_shaders)
+    {
+        data->draw_stages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TASK_SHADER_BIT_NV;
+        data->draw_access = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        data->cluster_cull_stage = VK_PIPELINE_STAGE_TASK_SHADER_BIT_NV;
+    }
+    else
+    {
+        data->draw_stages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+        data->draw_access = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+        data->cluster_cull_stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    }
     
     f32 quad_vertices[] = {
         -1.0f,  1.0f, 0.0f, 0.0f, 1.0f,
@@ -76,17 +188,17 @@ void geometry_pass_init(RenderGraphNode* node, RenderGraphExecute* execute)
     rhi_allocate_buffer(&data->screen_vertex_buffer, sizeof(quad_vertices), BUFFER_VERTEX);
     rhi_upload_buffer(&data->screen_vertex_buffer, quad_vertices, sizeof(quad_vertices));
 
-    rhi_allocate_buffer(&data->render_params_buffer, sizeof(data->parameters), BUFFER_UNIFORM);
+    rhi_allocate_uniform_ring(&data->render_params_buffer, sizeof(data->parameters));
 
     data->nearest_sampler.address_mode = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     data->nearest_sampler.filter = VK_FILTER_NEAREST;
     rhi_init_sampler(&data->nearest_sampler, 1);
-    rhi_push_descriptor_heap_sampler(&execute->sampler_heap, &data->nearest_sampler, 0);
+    rhi_push_descriptor_heap_sampler(&execute->sampler_heap, &data->nearest_sampler, SAMPLER_HEAP_NEAREST);
 
     data->linear_sampler.address_mode = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     data->linear_sampler.filter = VK_FILTER_LINEAR;
     rhi_init_sampler(&data->linear_sampler, 1);
-    rhi_push_descriptor_heap_sampler(&execute->sampler_heap, &data->linear_sampler, 1);
+    rhi_push_descriptor_heap_sampler(&execute->sampler_heap, &data->linear_sampler, SAMPLER_HEAP_LINEAR);
 
     data->cubemap_sampler.address_mode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
     data->cubemap_sampler.filter = VK_FILTER_LINEAR;
@@ -107,9 +219,85 @@ void geometry_pass_init(RenderGraphNode* node, RenderGraphExecute* execute)
     rhi_allocate_image(&data->gAlbedo, execute->width, execute->height, VK_FORMAT_R8G8B8A8_UNORM, IMAGE_GBUFFER, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     rhi_allocate_image(&data->gMetallicRoughness, execute->width, execute->height, VK_FORMAT_R8G8B8A8_UNORM, IMAGE_GBUFFER, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     rhi_allocate_image(&node->outputs[0], execute->width, execute->height, VK_FORMAT_R16G16B16A16_SFLOAT, IMAGE_RTV, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-    rhi_allocate_image(&node->outputs[1], execute->width, execute->height, VK_FORMAT_D24_UNORM_S8_UINT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+    rhi_allocate_image(&node->outputs[1], execute->width, execute->height, VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
     node->output_count = 2;
 
+    {
+        data->depth_pyramid_set_layout.descriptors[0] = DESCRIPTOR_IMAGE;
+        data->depth_pyramid_set_layout.descriptors[1] = DESCRIPTOR_STORAGE_IMAGE;
+        data->depth_pyramid_set_layout.descriptor_count = 2;
+        rhi_init_descriptor_set_layout(&data->depth_pyramid_set_layout);
+
+        for (u32 i = 0; i < DEPTH_PYRAMID_MAX_LEVELS; i++)
+            rhi_init_descriptor_set(&data->depth_pyramid_sets[i], &data->depth_pyramid_set_layout);
+
+        data->cull_set_layout.descriptors[0] = DESCRIPTOR_IMAGE;
+        data->cull_set_layout.descriptors[1] = DESCRIPTOR_DYNAMIC_STORAGE_BUFFER;
+        data->cull_set_layout.descriptors[2] = DESCRIPTOR_DYNAMIC_STORAGE_BUFFER;
+        data->cull_set_layout.descriptors[3] = DESCRIPTOR_STORAGE_BUFFER;
+        data->cull_set_layout.descriptors[4] = DESCRIPTOR_STORAGE_BUFFER;
+        data->cull_set_layout.descriptor_count = 5;
+        rhi_init_descriptor_set_layout(&data->cull_set_layout);
+
+        u64 draw_size = MESH_DRAW_COUNT_SIZE + (u64)MESH_SCENE_MAX_PRIMITIVES * sizeof(MeshDrawCommand);
+        u64 indexed_draw_size = (u64)MESH_SCENE_MAX_PRIMITIVES * sizeof(MeshIndexedDrawCommand);
+        rhi_allocate_storage_ring(&data->cull_stats_buffer, sizeof(execute->meshlet_stats));
+        rhi_allocate_storage_ring(&data->instance_buffer, MESH_SCENE_MAX_PRIMITIVES * sizeof(u32));
+        rhi_allocate_buffer(&data->draw_buffer, draw_size, BUFFER_INDIRECT);
+        rhi_allocate_buffer(&data->indexed_draw_buffer, indexed_draw_size, BUFFER_INDIRECT);
+
+        rhi_init_descriptor_set(&data->cull_set, &data->cull_set_layout);
+        rhi_begin_descriptor_writes();
+        rhi_descriptor_set_write_uniform_ring(&data->cull_set, &data->cull_stats_buffer, 1);
+        rhi_descriptor_set_write_uniform_ring(&data->cull_set, &data->instance_buffer, 2);
+        rhi_descriptor_set_write_storage_buffer(&data->cull_set, &data->draw_buffer, draw_size, 3);
+        rhi_descriptor_set_write_storage_buffer(&data->cull_set, &data->indexed_draw_buffer, indexed_draw_size, 4);
+        rhi_end_descriptor_writes();
+
+        geometry_pass_allocate_depth_pyramid(node, execute, data);
+
+        RHI_ShaderModule cs;
+
+        rhi_load_shader(&cs, "shaders/depth_pyramid.comp.spv");
+
+        RHI_PipelineDescriptor descriptor;
+        descriptor.use_mesh_shaders = 0;
+        descriptor.push_constant_size = 4 * sizeof(u32);
+        descriptor.set_layouts[0] = &data->depth_pyramid_set_layout;
+        descriptor.set_layout_count = 1;
+        descriptor.shaders.cs = &cs;
+        descriptor.depth_biased_enable = 0;
+
+        rhi_init_compute_pipeline(&data->depth_pyramid_pipeline, &descriptor);
+
+        rhi_free_shader(&cs);
+
+        rhi_load_shader(&cs, "shaders/draw_cull.comp.spv");
+
+        descriptor.push_constant_size = sizeof(draw_cull_constants);
+        descriptor.set_layouts[0] = &execute->camera_descriptor_set_layout;
+        descriptor.set_layouts[1] = mesh_loader_get_geometry_descriptor_set_layout();
+        descriptor.set_layouts[2] = &data->cull_set_layout;
+        descriptor.set_layout_count = 3;
+        descriptor.shaders.cs = &cs;
+
+        rhi_init_compute_pipeline(&data->draw_cull_pipeline, &descriptor);
+
+        rhi_free_shader(&cs);
+
+        if (!data->mesh_shaders)
+        {
+            rhi_load_shader(&cs, "shaders/meshlet_cull.comp.spv");
+
+            descriptor.push_constant_size = sizeof(gbuffer_constants);
+            descriptor.shaders.cs = &cs;
+
+            rhi_init_compute_pipeline(&data->meshlet_cull_pipeline, &descriptor);
+
+            rhi_free_shader(&cs);
+        }
+    }
+
     RHI_CommandBuffer cmd_buf;
     rhi_init_cmd_buf(&cmd_buf, COMMAND_BUFFER_COMPUTE);
 
@@ -299,7 +487,7 @@ void geometry_pass_init(RenderGraphNode* node, RenderGraphExecute* execute)
         descriptor.front_face = VK_FRONT_FACE_CLOCKWISE;
         descriptor.color_attachments_formats[0] = VK_FORMAT_R16G16B16A16_SFLOAT;
         descriptor.color_attachment_count = 1;
-        descriptor.depth_attachment_format = VK_FORMAT_D24_UNORM_S8_UINT;
+        descriptor.depth_attachment_format = VK_FORMAT_D32_SFLOAT;
         descriptor.cull_mode = VK_CULL_MODE_NONE;
         descriptor.depth_op = VK_COMPARE_OP_LESS_OR_EQUAL;
         descriptor.polygon_mode = VK_POLYGON_MODE_FILL;
@@ -341,25 +529,34 @@ void geometry_pass_init(RenderGraphNode* node, RenderGraphExecute* execute)
         rhi_descriptor_set_write_image(&data->deferred_set, &data->prefilter, 7);
         rhi_descriptor_set_write_image(&data->deferred_set, &data->brdf, 8);
 
-        data->params_set_layout.descriptors[0] = DESCRIPTOR_BUFFER;
+        data->params_set_layout.descriptors[0] = DESCRIPTOR_DYNAMIC_BUFFER;
         data->params_set_layout.descriptor_count = 1;
         rhi_init_descriptor_set_layout(&data->params_set_layout);
 
         rhi_init_descriptor_set(&data->params_set, &data->params_set_layout);
-        rhi_descriptor_set_write_buffer(&data->params_set, &data->render_params_buffer, sizeof(data->parameters), 0);
+        rhi_descriptor_set_write_uniform_ring(&data->params_set, &data->render_params_buffer, 0);
     }
 
     {
         RHI_ShaderModule ts;
         RHI_ShaderModule ms;
+        RHI_ShaderModule vs;
         RHI_ShaderModule fs;
 
-        rhi_load_shader(&ts, "shaders/gbuffer.task.spv");
-        rhi_load_shader(&ms, "shaders/gbuffer.mesh.spv");
+        // Both paths write the same G-buffer from the same fragment shader and descriptor sets
+        if (data->mesh_shaders)
+        {
+            rhi_load_shader(&ts, "shaders/gbuffer.task.spv");
+            rhi_load_shader(&ms, "shaders/gbuffer.mesh.spv");
+        }
+        else
+        {
+            rhi_load_shader(&vs, "shaders/gbuffer.vert.spv");
+        }
         rhi_load_shader(&fs, "shaders/gbuffer.frag.spv");
 
         RHI_PipelineDescriptor descriptor;
-        descriptor.use_mesh_shaders = 1;
+        descriptor.use_mesh_shaders = data->mesh_shaders;
         descriptor.reflect_input_layout = 0;
         descriptor.front_face = VK_FRONT_FACE_CLOCKWISE;
         descriptor.color_attachments_formats[0] = VK_FORMAT_R16G16B16A16_SFLOAT;
@@ -367,29 +564,38 @@ void geometry_pass_init(RenderGraphNode* node, RenderGraphExecute* execute)
         descriptor.color_attachments_formats[2] = VK_FORMAT_R8G8B8A8_UNORM;
         descriptor.color_attachments_formats[3] = VK_FORMAT_R8G8B8A8_UNORM;
         descriptor.color_attachment_count = 4;
-        descriptor.depth_attachment_format = VK_FORMAT_D24_UNORM_S8_UINT;
+        descriptor.depth_attachment_format = VK_FORMAT_D32_SFLOAT;
         descriptor.cull_mode = VK_CULL_MODE_BACK_BIT;
         descriptor.depth_op = VK_COMPARE_OP_LESS;
         descriptor.polygon_mode = VK_POLYGON_MODE_FILL;
         descriptor.primitive_topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-        descriptor.push_constant_size = sizeof(hmm_mat4);
+        descriptor.push_constant_size = sizeof(gbuffer_constants);
         descriptor.set_layouts[0] = &execute->camera_descriptor_set_layout;
         descriptor.set_layouts[1] = rhi_get_image_heap_set_layout();
         descriptor.set_layouts[2] = rhi_get_sampler_heap_set_layout();
         descriptor.set_layouts[3] = mesh_loader_get_descriptor_set_layout();
         descriptor.set_layouts[4] = mesh_loader_get_geometry_descriptor_set_layout();
         descriptor.set_layouts[5] = &data->params_set_layout;
-        descriptor.set_layout_count = 6;
+        descriptor.set_layouts[6] = &data->cull_set_layout;
+        descriptor.set_layout_count = 7;
         descriptor.shaders.ts = &ts;
         descriptor.shaders.ms = &ms;
+        descriptor.shaders.vs = &vs;
         descriptor.shaders.ps = &fs;
         descriptor.depth_biased_enable = 0;
         descriptor.depth_bounds_enable = 1;
 
         rhi_init_graphics_pipeline(&data->gbuffer_pipeline, &descriptor);
 
-        rhi_free_shader(&ts);
-        rhi_free_shader(&ms);
+        if (data->mesh_shaders)
+        {
+            rhi_free_shader(&ts);
+            rhi_free_shader(&ms);
+        }
+        else
+        {
+            rhi_free_shader(&vs);
+        }
         rhi_free_shader(&fs);
     }
 
@@ -406,7 +612,7 @@ void geometry_pass_init(RenderGraphNode* node, RenderGraphExecute* execute)
         descriptor.front_face = VK_FRONT_FACE_CLOCKWISE;
         descriptor.color_attachment_count = 1;
         descriptor.color_attachments_formats[0] = VK_FORMAT_R16G16B16A16_SFLOAT;
-        descriptor.depth_attachment_format = VK_FORMAT_D24_UNORM_S8_UINT;
+        descriptor.depth_attachment_format = VK_FORMAT_D32_SFLOAT;
         descriptor.cull_mode = VK_CULL_MODE_BACK_BIT;
         descriptor.depth_op = VK_COMPARE_OP_LESS;
         descriptor.polygon_mode = VK_POLYGON_MODE_FILL;
@@ -416,7 +622,8 @@ void geometry_pass_init(RenderGraphNode* node, RenderGraphExecute* execute)
         descriptor.set_layouts[1] = rhi_get_sampler_heap_set_layout();
         descriptor.set_layouts[2] = &execute->light_descriptor_set_layout;
         descriptor.set_layouts[3] = &data->params_set_layout;
-        descriptor.set_layout_count = 4;
+        descriptor.set_layouts[4] = &execute->camera_descriptor_set_layout;
+        descriptor.set_layout_count = 5;
         descriptor.shaders.vs = &vs;
         descriptor.shaders.ps = &fs;
         descriptor.depth_biased_enable = 0;
@@ -428,10 +635,200 @@ void geometry_pass_init(RenderGraphNode* node, RenderGraphExecute* execute)
     }
 }
 
-void geometry_pass_execute_gbuffer(RHI_CommandBuffer* cmd_buf, RenderGraphNode* node, RenderGraphExecute* execute, geometry_pass* data)
+void geometry_pass_draw_meshlets(RHI_CommandBuffer* cmd_buf, RenderGraphExecute* execute, geometry_pass* data, u32 phase)
+{
+    gbuffer_constants constants;
+    memset(&constants, 0, sizeof(gbuffer_constants));
+    constants.phase = phase;
+    constants.pyramid_levels = data->depth_pyramid.mip_levels;
+
+    // Multiplied by the projection scale and divided by distance this turns a model space error into pixels over the threshold
+    constants.lod_scale = execute->height * 0.5f / MESH_LOD_PIXEL_ERROR;
+
+    rhi_cmd_set_push_constants(cmd_buf, &data->gbuffer_pipeline, &constants, sizeof(gbuffer_constants));
+
+    // Every mesh lives in the scene buffers, only the draws change from one model to the next
+    MeshScene* scene = mesh_loader_get_scene();
+    rhi_cmd_set_descriptor_set(cmd_buf, &data->gbuffer_pipeline, &scene->material_set, 3);
+    rhi_cmd_set_descriptor_set(cmd_buf, &data->gbuffer_pipeline, &scene->geometry_descriptor_set, 4);
+
+    // The cull pass picked the primitives and task counts, each task workgroup then culls 32 clusters and picks the cut among them.
+    // The fallback already did that in meshlet_cull.comp and draws the kept clusters' indices
+    if (data->mesh_shaders)
+    {
+        if (data->draw_indirect_count)
+            rhi_cmd_draw_meshlets_indirect_count(cmd_buf, &data->draw_buffer, MESH_DRAW_COUNT_SIZE, &data->draw_buffer, 0, data->instance_count, sizeof(MeshDrawCommand));
+        else
+            rhi_cmd_draw_meshlets_indirect(cmd_buf, &data->draw_buffer, MESH_DRAW_COUNT_SIZE, data->instance_count, sizeof(MeshDrawCommand));
+    }
+    else
+    {
+        rhi_cmd_set_index_buffer(cmd_buf, &scene->cluster_index_buffer);
+        if (data->draw_indirect_count)
+            rhi_cmd_draw_indexed_indirect_count(cmd_buf, &data->indexed_draw_buffer, 0, &data->draw_buffer, 0, data->instance_count, sizeof(MeshIndexedDrawCommand));
+        else
+            rhi_cmd_draw_indexed_indirect(cmd_buf, &data->indexed_draw_buffer, 0, data->instance_count, sizeof(MeshIndexedDrawCommand));
+    }
+}
+
+// Fallback for the task shader: cuts and culls the clusters of every primitive the cull pass kept and writes their indices
+void geometry_pass_cull_meshlets(RHI_CommandBuffer* cmd_buf, RenderGraphExecute* execute, geometry_pass* data, u32 phase, u32 camera_offset, u32* cull_offsets)
+{
+    gbuffer_constants constants;
+    memset(&constants, 0, sizeof(gbuffer_constants));
+    constants.phase = phase;
+    constants.pyramid_levels = data->depth_pyramid.mip_levels;
+    constants.lod_scale = execute->height * 0.5f / MESH_LOD_PIXEL_ERROR;
+
+    rhi_cmd_set_pipeline(cmd_buf, &data->meshlet_cull_pipeline);
+    rhi_cmd_set_dynamic_descriptor_set(cmd_buf, &data->meshlet_cull_pipeline, &execute->camera_descriptor_set, 0, &camera_offset, 1);
+    rhi_cmd_set_dynamic_descriptor_set(cmd_buf, &data->meshlet_cull_pipeline, &data->cull_set, 2, cull_offsets, 2);
+    rhi_cmd_set_push_constants(cmd_buf, &data->meshlet_cull_pipeline, &constants, sizeof(gbuffer_constants));
+
+    MeshScene* scene = mesh_loader_get_scene();
+    rhi_cmd_set_descriptor_set(cmd_buf, &data->meshlet_cull_pipeline, &scene->geometry_descriptor_set, 1);
+
+    // One row of workgroups per draw slot, rows past the draw count and runs past the primitive's clusters exit right away
+    rhi_cmd_dispatch(cmd_buf, (scene->max_primitive_meshlet_count + 31) / 32, data->instance_count, 1);
+
+    rhi_cmd_memory_barrier(cmd_buf, VK_ACCESS_SHADER_WRITE_BIT, data->draw_access, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, data->draw_stages);
+}
+
+// Frustum culls every primitive, and in the late phase tests it against the depth pyramid, then writes the indirect draws for the phase
+void geometry_pass_cull_draws(RHI_CommandBuffer* cmd_buf, RenderGraphExecute* execute, geometry_pass* data, u32 phase, u32 camera_offset, u32* cull_offsets)
+{
+    // Last phase's draws and the previous cull must be done with the buffers before the count is reset and they are rewritten
+    rhi_cmd_memory_barrier(cmd_buf, data->draw_access | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                           data->draw_stages | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    // Fixed slots don't count, every instance has a draw
+    rhi_cmd_fill_buffer(cmd_buf, &data->draw_buffer, 0, sizeof(u32), data->draw_indirect_count ? 0 : data->instance_count);
+    rhi_cmd_memory_barrier(cmd_buf, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    draw_cull_constants constants;
+    memset(&constants, 0, sizeof(draw_cull_constants));
+    constants.phase = phase;
+    constants.instance_count = data->instance_count;
+    constants.pyramid_levels = data->depth_pyramid.mip_levels;
+    constants.fixed_slots = !data->draw_indirect_count;
+
+    rhi_cmd_set_pipeline(cmd_buf, &data->draw_cull_pipeline);
+    rhi_cmd_set_dynamic_descriptor_set(cmd_buf, &data->draw_cull_pipeline, &execute->camera_descriptor_set, 0, &camera_offset, 1);
+    rhi_cmd_set_descriptor_set(cmd_buf, &data->draw_cull_pipeline, &mesh_loader_get_scene()->geometry_descriptor_set, 1);
+    rhi_cmd_set_dynamic_descriptor_set(cmd_buf, &data->draw_cull_pipeline, &data->cull_set, 2, cull_offsets, 2);
+    rhi_cmd_set_push_constants(cmd_buf, &data->draw_cull_pipeline, &constants, sizeof(draw_cull_constants));
+
+    // One thread per instance across the whole scene, the CPU cost doesn't grow with models or primitives
+    rhi_cmd_dispatch(cmd_buf, (data->instance_count + DRAW_CULL_GROUP_SIZE - 1) / DRAW_CULL_GROUP_SIZE, 1, 1);
+
+    rhi_cmd_memory_barrier(cmd_buf, VK_ACCESS_SHADER_WRITE_BIT, data->draw_access, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, data->draw_stages | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    if (!data->mesh_shaders)
+        geometry_pass_cull_meshlets(cmd_buf, execute, data, phase, camera_offset, cull_offsets);
+}
+
+// Frustum culls every primitive's world space box on the CPU and uploads the survivors as the frame's instance table.
+// Same planes as the GPU cull, so a primitive skipped here would have been culled there
+void geometry_pass_cull_models(RenderGraphExecute* execute, geometry_pass* data)
+{
+    if (data->bounds_model_count != execute->model_count)
+    {
+        frustum_cull_clear(&data->primitive_bounds);
+        for (i32 i = 0; i < execute->model_count; i++)
+        {
+            Mesh* model = &execute->models[i];
+            for (i32 j = 0; j < model->primitive_count; j++)
+            {
+                Primitive* pri = &model->primitives[j];
+
+                // Quantized positions span exactly their box, float ones only have the bounding sphere to go by
+                hmm_vec3 aabb_min = HMM_SubtractVec3(pri->bounds.XYZ, HMM_Vec3(pri->bounds.W, pri->bounds.W, pri->bounds.W));
+                hmm_vec3 aabb_max = HMM_AddVec3(pri->bounds.XYZ, HMM_Vec3(pri->bounds.W, pri->bounds.W, pri->bounds.W));
+                if (pri->vertex_format == VERTEX_FORMAT_QUANTIZED)
+                {
+                    aabb_min = pri->position_offset;
+                    aabb_max = HMM_AddVec3(pri->position_offset, pri->position_scale);
+                }
+
+                frustum_cull_add_transformed(&data->primitive_bounds, pri->transform, pri->bounds, aabb_min, aabb_max);
+            }
+        }
+
+        // Sized to the padded capacity, the wide loops store whole vectors of indices
+        data->primitive_models = realloc(data->primitive_models, sizeof(u32) * data->primitive_bounds.capacity);
+        data->primitive_indices = realloc(data->primitive_indices, sizeof(u32) * data->primitive_bounds.capacity);
+        data->visible_primitives = realloc(data->visible_primitives, sizeof(u32) * data->primitive_bounds.capacity);
+
+        u32 index = 0;
+        for (i32 i = 0; i < execute->model_count; i++)
+        {
+            for (i32 j = 0; j < execute->models[i].primitive_count; j++)
+            {
+                data->primitive_models[index] = i;
+                data->primitive_indices[index++] = execute->models[i].first_primitive + j;
+            }
+        }
+        assert(index <= MESH_SCENE_MAX_PRIMITIVES);
+
+        data->bounds_model_count = execute->model_count;
+    }
+
+    u32 visible_count = frustum_cull_aabbs(&data->primitive_bounds, execute->camera.frustrum_planes, data->visible_primitives);
+
+    // Visible primitives come out in order, so every model shows up in one run
+    u32 visible_model_count = 0;
+    for (u32 i = 0; i < visible_count; i++)
+    {
+        if (i == 0 || data->primitive_models[data->visible_primitives[i]] != data->primitive_models[data->visible_primitives[i - 1]])
+            visible_model_count++;
+    }
+
+    // Bounds indices become scene primitive indices in place, that is the instance table the GPU cull walks
+    for (u32 i = 0; i < visible_count; i++)
+        data->visible_primitives[i] = data->primitive_indices[data->visible_primitives[i]];
+
+    data->instance_count = visible_count;
+    if (visible_count)
+        rhi_upload_uniform_ring(&data->instance_buffer, data->visible_primitives, visible_count * sizeof(u32));
+
+    execute->cpu_cull_stats.primitive_culled = data->primitive_bounds.count - visible_count;
+    execute->cpu_cull_stats.model_culled = execute->model_count - visible_model_count;
+}
+
+void geometry_pass_build_depth_pyramid(RHI_CommandBuffer* cmd_buf, RenderGraphNode* node, geometry_pass* data)
 {
-    f64 start = aurora_platform_get_time();
+    RHI_Image* depth = &node->outputs[1];
+    RHI_Image* pyramid = &data->depth_pyramid;
+
+    rhi_cmd_img_transition_layout(cmd_buf, depth, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0);
+    // Last frame's late phase is the only reader, its contents don't matter anymore
+    rhi_cmd_img_transition_layout(cmd_buf, pyramid, 0, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, data->cluster_cull_stage, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0);
+
+    rhi_cmd_set_pipeline(cmd_buf, &data->depth_pyramid_pipeline);
+
+    u32 sizes[4];
+    sizes[2] = depth->width;
+    sizes[3] = depth->height;
 
+    for (u32 i = 0; i < pyramid->mip_levels; i++)
+    {
+        sizes[0] = sizes[2];
+        sizes[1] = sizes[3];
+        sizes[2] = pyramid->width >> i ? pyramid->width >> i : 1;
+        sizes[3] = pyramid->height >> i ? pyramid->height >> i : 1;
+
+        rhi_cmd_set_descriptor_set(cmd_buf, &data->depth_pyramid_pipeline, &data->depth_pyramid_sets[i], 0);
+        rhi_cmd_set_push_constants(cmd_buf, &data->depth_pyramid_pipeline, sizes, sizeof(sizes));
+        rhi_cmd_dispatch(cmd_buf, (sizes[2] + 7) / 8, (sizes[3] + 7) / 8, 1);
+
+        // The next level and the late cluster cull read what was just written
+        rhi_cmd_img_transition_layout(cmd_buf, pyramid, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | data->cluster_cull_stage, 0);
+    }
+
+    rhi_cmd_img_transition_layout(cmd_buf, depth, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0);
+}
+
+void geometry_pass_execute_gbuffer(RHI_CommandBuffer* cmd_buf, RenderGraphNode* node, RenderGraphExecute* execute, geometry_pass* data)
+{
     RHI_RenderBegin begin;
     memset(&begin, 0, sizeof(RHI_RenderBegin));
     begin.r = 0.0f;
@@ -448,50 +845,61 @@ void geometry_pass_execute_gbuffer(RHI_CommandBuffer* cmd_buf, RenderGraphNode*
     begin.images[4] = &node->outputs[1];
     begin.image_count = 5;
 
-    rhi_cmd_start_render(cmd_buf, begin);
-
     rhi_cmd_img_transition_layout(cmd_buf, &data->gPosition, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0);
     rhi_cmd_img_transition_layout(cmd_buf, &data->gNormal, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0);
     rhi_cmd_img_transition_layout(cmd_buf, &data->gAlbedo, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0);
     rhi_cmd_img_transition_layout(cmd_buf, &data->gMetallicRoughness, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0);
     rhi_cmd_img_transition_layout(cmd_buf, &node->outputs[1], 0, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0);
 
+    u32 camera_offset = rhi_uniform_ring_offset(&execute->camera_buffer);
+    u32 params_offset = rhi_uniform_ring_offset(&data->render_params_buffer);
+    u32 cull_offsets[2];
+    cull_offsets[0] = rhi_uniform_ring_offset(&data->cull_stats_buffer);
+    cull_offsets[1] = rhi_uniform_ring_offset(&data->instance_buffer);
+
+    // Early phase: whatever was visible last frame, into a cleared G-buffer
+    geometry_pass_cull_draws(cmd_buf, execute, data, 0, camera_offset, cull_offsets);
+    rhi_cmd_start_render(cmd_buf, begin);
     rhi_cmd_set_viewport(cmd_buf, execute->width, execute->height);
     rhi_cmd_set_pipeline(cmd_buf, &data->gbuffer_pipeline);
-    rhi_cmd_set_descriptor_set(cmd_buf, &data->gbuffer_pipeline, &execute->camera_descriptor_set, 0);
+    rhi_cmd_set_dynamic_descriptor_set(cmd_buf, &data->gbuffer_pipeline, &execute->camera_descriptor_set, 0, &camera_offset, 1);
     rhi_cmd_set_descriptor_heap(cmd_buf, &data->gbuffer_pipeline, &execute->image_heap, 1);
     rhi_cmd_set_descriptor_heap(cmd_buf, &data->gbuffer_pipeline, &execute->sampler_heap, 2);
-    rhi_cmd_set_descriptor_set(cmd_buf, &data->gbuffer_pipeline, &data->params_set, 5);
+    rhi_cmd_set_dynamic_descriptor_set(cmd_buf, &data->gbuffer_pipeline, &data->params_set, 5, &params_offset, 1);
+    rhi_cmd_set_dynamic_descriptor_set(cmd_buf, &data->gbuffer_pipeline, &data->cull_set, 6, cull_offsets, 2);
     rhi_cmd_set_depth_bounds(cmd_buf, 0.0f, 0.999f);
+    geometry_pass_draw_meshlets(cmd_buf, execute, data, 0);
+    rhi_cmd_end_render(cmd_buf);
 
-    for (i32 i = 0; i < execute->model_count; i++)
-    {
-        Mesh* model = &execute->models[i];
-        for (u32 i = 0; i < model->primitive_count; i++)
-    {
-        rhi_cmd_set_push_constants(cmd_buf, &data->gbuffer_pipeline, &model->primitives[i].transform, sizeof(hmm_mat4));
-            rhi_cmd_set_descriptor_set(cmd_buf, &data->gbuffer_pipeline, &model->materials[model->primitives[i].material_index].material_set, 3);
-            rhi_cmd_set_descriptor_set(cmd_buf, &data->gbuffer_pipeline, &model->primitives[i].geometry_descriptor_set, 4);
-        rhi_cmd_draw_meshlets(cmd_buf, model->primitives[i].meshlet_count);
-    }
-    }
+    geometry_pass_build_depth_pyramid(cmd_buf, node, data);
+
+    // Late phase: everything else that survives the pyramid, on top of the early results
+    geometry_pass_cull_draws(cmd_buf, execute, data, 1, camera_offset, cull_offsets);
+    begin.read_color = 1;
+    begin.read_depth = 1;
+    rhi_cmd_start_render(cmd_buf, begin);
+    rhi_cmd_set_viewport(cmd_buf, execute->width, execute->height);
+    rhi_cmd_set_pipeline(cmd_buf, &data->gbuffer_pipeline);
+    rhi_cmd_set_dynamic_descriptor_set(cmd_buf, &data->gbuffer_pipeline, &execute->camera_descriptor_set, 0, &camera_offset, 1);
+    rhi_cmd_set_descriptor_heap(cmd_buf, &data->gbuffer_pipeline, &execute->image_heap, 1);
+    rhi_cmd_set_descriptor_heap(cmd_buf, &data->gbuffer_pipeline, &execute->sampler_heap, 2);
+    rhi_cmd_set_dynamic_descriptor_set(cmd_buf, &data->gbuffer_pipeline, &data->params_set, 5, &params_offset, 1);
+    rhi_cmd_set_dynamic_descriptor_set(cmd_buf, &data->gbuffer_pipeline, &data->cull_set, 6, cull_offsets, 2);
+    rhi_cmd_set_depth_bounds(cmd_buf, 0.0f, 0.999f);
+    geometry_pass_draw_meshlets(cmd_buf, execute, data, 1);
+    rhi_cmd_end_render(cmd_buf);
+
+    // The cull counters are read on the host once this frame's fence comes back around
+    rhi_cmd_memory_barrier(cmd_buf, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT, data->cluster_cull_stage | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT);
 
     rhi_cmd_img_transition_layout(cmd_buf, &data->gPosition, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0);
     rhi_cmd_img_transition_layout(cmd_buf, &data->gNormal, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0);
     rhi_cmd_img_transition_layout(cmd_buf, &data->gAlbedo, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0);
     rhi_cmd_img_transition_layout(cmd_buf, &data->gMetallicRoughness, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0);
-
-    rhi_cmd_end_render(cmd_buf);
-
-    f64 end = aurora_platform_get_time();
-
-    //printf("Geometry Pass: GBuffer execution took %f ms\n", (end - start) * 1000);
 }
 
 void geometry_pass_execute_deferred(RHI_CommandBuffer* cmd_buf, RenderGraphNode* node, RenderGraphExecute* execute, geometry_pass* data)
 {
-    f64 start = aurora_platform_get_time();
-
     RHI_RenderBegin begin;
     memset(&begin, 0, sizeof(RHI_RenderBegin));
     begin.r = 0.0f;
@@ -518,11 +926,16 @@ void geometry_pass_execute_deferred(RHI_CommandBuffer* cmd_buf, RenderGraphNode*
     rhi_cmd_start_render(cmd_buf, begin);
     rhi_cmd_set_viewport(cmd_buf, execute->width, execute->height);
 
+    u32 light_offset = rhi_uniform_ring_offset(&execute->light_buffer);
+    u32 params_offset = rhi_uniform_ring_offset(&data->render_params_buffer);
+    u32 camera_offset = rhi_uniform_ring_offset(&execute->camera_buffer);
+
     rhi_cmd_set_pipeline(cmd_buf, &data->deferred_pipeline);
     rhi_cmd_set_descriptor_set(cmd_buf, &data->deferred_pipeline, &data->deferred_set, 0);
     rhi_cmd_set_descriptor_heap(cmd_buf, &data->deferred_pipeline, &execute->sampler_heap, 1);
-    rhi_cmd_set_descriptor_set(cmd_buf, &data->deferred_pipeline, &execute->light_descriptor_set, 2);
-    rhi_cmd_set_descriptor_set(cmd_buf, &data->deferred_pipeline, &data->params_set, 3);
+    rhi_cmd_set_dynamic_descriptor_set(cmd_buf, &data->deferred_pipeline, &execute->light_descriptor_set, 2, &light_offset, 1);
+    rhi_cmd_set_dynamic_descriptor_set(cmd_buf, &data->deferred_pipeline, &data->params_set, 3, &params_offset, 1);
+    rhi_cmd_set_dynamic_descriptor_set(cmd_buf, &data->deferred_pipeline, &execute->camera_descriptor_set, 4, &camera_offset, 1);
     rhi_cmd_set_push_constants(cmd_buf, &data->deferred_pipeline, &temp, sizeof(hmm_vec4));
     rhi_cmd_set_vertex_buffer(cmd_buf, &data->screen_vertex_buffer);
     rhi_cmd_draw(cmd_buf, 4);
@@ -530,16 +943,10 @@ void geometry_pass_execute_deferred(RHI_CommandBuffer* cmd_buf, RenderGraphNode*
     rhi_cmd_end_render(cmd_buf);
 
     rhi_cmd_img_transition_layout(cmd_buf, &node->outputs[0], VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0);
-
-    f64 end = aurora_platform_get_time();
-
-    //printf("Geometry Pass: Deferred execution took %f ms\n", (end - start) * 1000);
 }
 
 void geometry_pass_execute_skybox(RHI_CommandBuffer* cmd_buf, RenderGraphNode* node, RenderGraphExecute* execute, geometry_pass* data)
 {
-    f64 start = aurora_platform_get_time();
-
     RHI_RenderBegin begin;
     memset(&begin, 0, sizeof(RHI_RenderBegin));
     begin.r = 0.0f;
@@ -579,10 +986,6 @@ void geometry_pass_execute_skybox(RHI_CommandBuffer* cmd_buf, RenderGraphNode* n
     rhi_cmd_draw(cmd_buf, 36);
 
     rhi_cmd_end_render(cmd_buf);
-
-    f64 end = aurora_platform_get_time();
-
-    //printf("Geometry Pass: Skybox execution took %f ms\n", (end - start) * 1000);
 }
 
 void geometry_pass_update(RenderGraphNode* node, RenderGraphExecute* execute)
@@ -599,8 +1002,14 @@ void geometry_pass_update(RenderGraphNode* node, RenderGraphExecute* execute)
         data->parameters.shade_meshlets = 0;
 
     RHI_CommandBuffer* cmd_buf = rhi_get_swapchain_cmd_buf();
-    rhi_upload_buffer(&data->render_params_buffer, &data->parameters, sizeof(data->parameters));
+    rhi_upload_uniform_ring(&data->render_params_buffer, &data->parameters, sizeof(data->parameters));
 
+    // Counters from the last frame on this slot, zeroed again for this one
+    rhi_read_uniform_ring(&data->cull_stats_buffer, &execute->meshlet_stats, sizeof(execute->meshlet_stats));
+    u32 zero_stats[6] = { 0 };
+    rhi_upload_uniform_ring(&data->cull_stats_buffer, zero_stats, sizeof(zero_stats));
+
+    geometry_pass_cull_models(execute, data);
     geometry_pass_execute_gbuffer(cmd_buf, node, execute, data);
     geometry_pass_execute_deferred(cmd_buf, node, execute, data);
     geometry_pass_execute_skybox(cmd_buf, node, execute, data);
@@ -616,14 +1025,21 @@ void geometry_pass_resize(RenderGraphNode* node, RenderGraphExecute* execute)
     rhi_resize_image(&data->gMetallicRoughness, execute->width, execute->height);
     rhi_resize_image(&node->outputs[0], execute->width, execute->height);
     rhi_resize_image(&node->outputs[1], execute->width, execute->height);
+
+    rhi_free_image(&data->depth_pyramid);
+    geometry_pass_allocate_depth_pyramid(node, execute, data);
+
+    rhi_begin_descriptor_writes();
     rhi_descriptor_set_write_image(&data->deferred_set, &data->gPosition, 0);
     rhi_descriptor_set_write_image(&data->deferred_set, &data->gNormal, 1);
     rhi_descriptor_set_write_image(&data->deferred_set, &data->gAlbedo, 2);
     rhi_descriptor_set_write_image(&data->deferred_set, &data->gMetallicRoughness, 3);
+    rhi_end_descriptor_writes();
 }
 
 void geometry_pass_free(RenderGraphNode* node, RenderGraphExecute* execute)
 {
+    (void)execute;
     geometry_pass* data = node->private_data;
 
     rhi_free_descriptor_set(&data->brdf_set);
@@ -642,6 +1058,27 @@ void geometry_pass_free(RenderGraphNode* node, RenderGraphExecute* execute)
     rhi_free_pipeline(&data->skybox_pipeline);
     rhi_free_descriptor_set_layout(&data->skybox_set_layout);
 
+    for (u32 i = 0; i < DEPTH_PYRAMID_MAX_LEVELS; i++)
+        rhi_free_descriptor_set(&data->depth_pyramid_sets[i]);
+    rhi_free_descriptor_set_layout(&data->depth_pyramid_set_layout);
+    rhi_free_pipeline(&data->depth_pyramid_pipeline);
+    rhi_free_pipeline(&data->draw_cull_pipeline);
+    if (!data->mesh_shaders)
+        rhi_free_pipeline(&data->meshlet_cull_pipeline);
+    rhi_free_image(&data->depth_pyramid);
+
+    rhi_free_descriptor_set(&data->cull_set);
+    rhi_free_descriptor_set_layout(&data->cull_set_layout);
+    rhi_free_buffer(&data->indexed_draw_buffer);
+    rhi_free_buffer(&data->draw_buffer);
+    rhi_free_uniform_ring(&data->instance_buffer);
+    rhi_free_uniform_ring(&data->cull_stats_buffer);
+
+    frustum_cull_free(&data->primitive_bounds);
+    free(data->primitive_models);
+    free(data->primitive_indices);
+    free(data->visible_primitives);
+
     rhi_free_descriptor_set(&data->cubemap_set);
     rhi_free_descriptor_set_layout(&data->cubemap_set_layout);
     rhi_free_pipeline(&data->cubemap_pipeline);
@@ -667,7 +1104,7 @@ void geometry_pass_free(RenderGraphNode* node, RenderGraphExecute* execute)
     rhi_free_descriptor_set(&data->deferred_set);
     rhi_free_descriptor_set_layout(&data->deferred_set_layout);
     rhi_free_buffer(&data->screen_vertex_buffer);
-    rhi_free_buffer(&data->render_params_buffer);
+    rhi_free_uniform_ring(&data->render_params_buffer);
 
     free(data);
 }
@@ -3,6 +3,12 @@
 
 #include <gfx/render_graph.h>
 
+// Connect the light cull pass here so the deferred pass runs after the cluster lists are built
+enum GeometryPassInput
+{
+    GeometryPassInputLightClusters = DECLARE_NODE_INPUT(0)
+};
+
 enum GeometryPassOutput
 {
     GeometryPassOutputLit = DECLARE_NODE_OUTPUT(0)
@@ -0,0 +1,91 @@
+#include "light_cull_pass.h"
+
+#include <core/platform_layer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LIGHT_CULL_GROUP_SIZE 64
+
+typedef struct light_cull_pass_data light_cull_pass_data;
+struct light_cull_pass_data
+{
+    RHI_Pipeline cull_pipeline;
+};
+
+void light_cull_pass_init(RenderGraphNode* node, RenderGraphExecute* execute)
+{
+    light_cull_pass_data* data = node->private_data;
+
+    node->output_count = 0;
+
+    RHI_ShaderModule cs;
+    rhi_load_shader(&cs, "shaders/light_cull.comp.spv");
+
+    RHI_PipelineDescriptor descriptor;
+    descriptor.use_mesh_shaders = 0;
+    descriptor.push_constant_size = 0;
+    descriptor.set_layouts[0] = &execute->camera_descriptor_set_layout;
+    descriptor.set_layouts[1] = &execute->light_descriptor_set_layout;
+    descriptor.set_layout_count = 2;
+    descriptor.shaders.cs = &cs;
+    descriptor.depth_biased_enable = 0;
+
+    rhi_init_compute_pipeline(&data->cull_pipeline, &descriptor);
+
+    rhi_free_shader(&cs);
+}
+
+void light_cull_pass_free(RenderGraphNode* node, RenderGraphExecute* execute)
+{
+    (void)execute;
+    light_cull_pass_data* data = node->private_data;
+
+    rhi_free_pipeline(&data->cull_pipeline);
+
+    free(data);
+}
+
+void light_cull_pass_update(RenderGraphNode* node, RenderGraphExecute* execute)
+{
+    light_cull_pass_data* data = node->private_data;
+
+    RHI_CommandBuffer* cmd_buf = rhi_get_swapchain_cmd_buf();
+
+    // The previous frame's deferred pass may still be reading the lists
+    rhi_cmd_buffer_barrier(cmd_buf, &execute->cluster_count_buffer, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    rhi_cmd_buffer_barrier(cmd_buf, &execute->cluster_light_buffer, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    u32 camera_offset = rhi_uniform_ring_offset(&execute->camera_buffer);
+    u32 light_offset = rhi_uniform_ring_offset(&execute->light_buffer);
+
+    rhi_cmd_set_pipeline(cmd_buf, &data->cull_pipeline);
+    rhi_cmd_set_dynamic_descriptor_set(cmd_buf, &data->cull_pipeline, &execute->camera_descriptor_set, 0, &camera_offset, 1);
+    rhi_cmd_set_dynamic_descriptor_set(cmd_buf, &data->cull_pipeline, &execute->light_descriptor_set, 1, &light_offset, 1);
+    rhi_cmd_dispatch(cmd_buf, (RENDER_GRAPH_CLUSTER_COUNT + LIGHT_CULL_GROUP_SIZE - 1) / LIGHT_CULL_GROUP_SIZE, 1, 1);
+
+    rhi_cmd_buffer_barrier(cmd_buf, &execute->cluster_count_buffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    rhi_cmd_buffer_barrier(cmd_buf, &execute->cluster_light_buffer, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+}
+
+void light_cull_pass_resize(RenderGraphNode* node, RenderGraphExecute* execute)
+{
+    // The cluster grid is a fixed number of screen tiles, nothing depends on the resolution
+    (void)node;
+    (void)execute;
+}
+
+RenderGraphNode* create_light_cull_pass()
+{
+    RenderGraphNode* node = malloc(sizeof(RenderGraphNode));
+
+    node->init = light_cull_pass_init;
+    node->free = light_cull_pass_free;
+    node->update = light_cull_pass_update;
+    node->resize = light_cull_pass_resize;
+    node->private_data = malloc(sizeof(light_cull_pass_data));
+    node->input_count = 0;
+    memset(node->inputs, 0, sizeof(node->inputs));
+
+    return node;
+}
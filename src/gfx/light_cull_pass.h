@@ -0,0 +1,14 @@
+#ifndef LIGHT_CULL_PASS_H_INCLUDED
+#define LIGHT_CULL_PASS_H_INCLUDED
+
+#include <gfx/render_graph.h>
+
+// No image behind this output, connecting it only orders the passes so the cluster lists are ready
+enum LightCullPassOutput
+{
+    LightCullPassOutputClusters = DECLARE_NODE_OUTPUT(0)
+};
+
+RenderGraphNode* create_light_cull_pass();
+
+#endif
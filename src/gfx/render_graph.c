@@ -1,6 +1,13 @@
 #include "render_graph.h"
 
 #include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ALL_FRAME_SLOTS ((1u << FRAMES_IN_FLIGHT) - 1)
+#define CAMERA_OFFSET(member) (offsetof(RenderGraphExecute, camera.member) - offsetof(RenderGraphExecute, camera))
 
 void recursively_add_nodes(RenderGraphNode* node, RenderGraph* graph)
 {
@@ -20,38 +27,88 @@ void recursively_add_nodes(RenderGraphNode* node, RenderGraph* graph)
     }
 }
 
+internal void mark_render_graph_camera(RenderGraphExecute* execute, u32 fields)
+{
+    for (u32 i = 0; i < FRAMES_IN_FLIGHT; i++)
+        execute->dirty.camera[i] |= fields;
+}
+
+internal void grow_render_graph_lights(RenderGraphExecute* execute, u32 capacity)
+{
+    // Round up to whole dirty words
+    capacity = (capacity + 31) & ~31u;
+
+    // Frames in flight still read the old ring, growing has to happen outside of rhi_begin/rhi_end
+    if (execute->lights)
+    {
+        rhi_wait_idle();
+        rhi_free_uniform_ring(&execute->light_buffer);
+    }
+
+    execute->lights = realloc(execute->lights, capacity * sizeof(RenderGraphPointLight));
+    memset(execute->lights + execute->light_capacity, 0, (capacity - execute->light_capacity) * sizeof(RenderGraphPointLight));
+    execute->light_capacity = capacity;
+
+    // The new ring starts out empty in every slot, so everything goes up again
+    for (u32 i = 0; i < FRAMES_IN_FLIGHT; i++)
+    {
+        execute->dirty.lights[i] = realloc(execute->dirty.lights[i], (capacity / 32) * sizeof(u32));
+        memset(execute->dirty.lights[i], 0xFF, (capacity / 32) * sizeof(u32));
+    }
+    execute->dirty.light_slots = ALL_FRAME_SLOTS;
+    execute->dirty.light_count_slots = ALL_FRAME_SLOTS;
+
+    rhi_allocate_storage_ring(&execute->light_buffer, RENDER_GRAPH_LIGHT_HEADER_SIZE + capacity * sizeof(RenderGraphPointLight));
+    rhi_descriptor_set_write_uniform_ring(&execute->light_descriptor_set, &execute->light_buffer, 0);
+}
+
 void init_render_graph(RenderGraph* graph, RenderGraphExecute* execute)
 {
     memset(graph, 0, sizeof(RenderGraph));
-    memset(&execute->light_info, 0, sizeof(execute->light_info));
+    execute->lights = NULL;
+    execute->light_count = 0;
+    execute->light_capacity = 0;
+    memset(&execute->dirty, 0, sizeof(execute->dirty));
     graph->node_count = 0;
 
-    rhi_init_descriptor_heap(&execute->image_heap, DESCRIPTOR_HEAP_IMAGE, 512);
-    rhi_init_descriptor_heap(&execute->sampler_heap, DESCRIPTOR_HEAP_SAMPLER, 512);
+    rhi_init_descriptor_heap(&execute->image_heap, DESCRIPTOR_HEAP_IMAGE, RENDER_GRAPH_IMAGE_HEAP_SIZE);
+    rhi_init_descriptor_heap(&execute->sampler_heap, DESCRIPTOR_HEAP_SAMPLER, RENDER_GRAPH_SAMPLER_HEAP_SIZE);
+
+    // The shaders index the nearest and linear samplers directly, geometry_pass_init fills them in
+    rhi_reserve_descriptors(&execute->sampler_heap, 0, SAMPLER_HEAP_RESERVED);
     mesh_loader_set_texture_heap(&execute->image_heap);
     mesh_loader_set_sampler_heap(&execute->sampler_heap);
-    mesh_loader_init(4);
+    mesh_loader_init();
 
     execute->camera_descriptor_set_layout.descriptor_count = 1;
-    execute->camera_descriptor_set_layout.descriptors[0] = DESCRIPTOR_BUFFER;
+    execute->camera_descriptor_set_layout.descriptors[0] = DESCRIPTOR_DYNAMIC_BUFFER;
     rhi_init_descriptor_set_layout(&execute->camera_descriptor_set_layout);
 
-    execute->light_descriptor_set_layout.descriptor_count = 1;
-    execute->light_descriptor_set_layout.descriptors[0] = DESCRIPTOR_BUFFER;
+    execute->light_descriptor_set_layout.descriptor_count = 3;
+    execute->light_descriptor_set_layout.descriptors[0] = DESCRIPTOR_DYNAMIC_STORAGE_BUFFER;
+    execute->light_descriptor_set_layout.descriptors[1] = DESCRIPTOR_STORAGE_BUFFER;
+    execute->light_descriptor_set_layout.descriptors[2] = DESCRIPTOR_STORAGE_BUFFER;
     rhi_init_descriptor_set_layout(&execute->light_descriptor_set_layout);
 
-    rhi_allocate_buffer(&execute->camera_buffer, sizeof(execute->camera), BUFFER_UNIFORM);
-    rhi_allocate_buffer(&execute->light_buffer, sizeof(execute->light_info), BUFFER_UNIFORM);
-    
+    rhi_allocate_uniform_ring(&execute->camera_buffer, sizeof(execute->camera));
+    rhi_allocate_buffer(&execute->cluster_count_buffer, RENDER_GRAPH_CLUSTER_COUNT * sizeof(u32), BUFFER_STORAGE);
+    rhi_allocate_buffer(&execute->cluster_light_buffer, RENDER_GRAPH_CLUSTER_COUNT * RENDER_GRAPH_MAX_LIGHTS_PER_CLUSTER * sizeof(u32), BUFFER_STORAGE);
+
     rhi_init_descriptor_set(&execute->camera_descriptor_set, &execute->camera_descriptor_set_layout);
-    rhi_descriptor_set_write_buffer(&execute->camera_descriptor_set, &execute->camera_buffer, sizeof(execute->camera), 0);
+    rhi_descriptor_set_write_uniform_ring(&execute->camera_descriptor_set, &execute->camera_buffer, 0);
 
     rhi_init_descriptor_set(&execute->light_descriptor_set, &execute->light_descriptor_set_layout);
-    rhi_descriptor_set_write_buffer(&execute->light_descriptor_set, &execute->light_buffer, sizeof(execute->light_info), 0);
+    rhi_descriptor_set_write_storage_buffer(&execute->light_descriptor_set, &execute->cluster_count_buffer, RENDER_GRAPH_CLUSTER_COUNT * sizeof(u32), 1);
+    rhi_descriptor_set_write_storage_buffer(&execute->light_descriptor_set, &execute->cluster_light_buffer, RENDER_GRAPH_CLUSTER_COUNT * RENDER_GRAPH_MAX_LIGHTS_PER_CLUSTER * sizeof(u32), 2);
+    grow_render_graph_lights(execute, RENDER_GRAPH_INITIAL_LIGHT_CAPACITY);
+
+    // Every slot starts out fully dirty so the first frames upload the whole blocks
+    mark_render_graph_camera(execute, CAMERA_DIRTY_ALL);
 }
 
 void connect_render_graph_nodes(RenderGraph* graph, u32 src_id, u32 dst_id, RenderGraphNode* src_node, RenderGraphNode* dst_node)
 {
+    (void)graph;
     assert(src_node);
     assert(dst_node);
     assert(!IS_NODE_INPUT(src_id));
@@ -107,25 +164,186 @@ void free_render_graph(RenderGraph* graph, RenderGraphExecute* execute)
     for (u32 i = 0; i < graph->node_count; i++)
         graph->nodes[i]->free(graph->nodes[i], execute);
 
-    rhi_free_buffer(&execute->light_buffer);
+    rhi_free_uniform_ring(&execute->light_buffer);
+    rhi_free_buffer(&execute->cluster_count_buffer);
+    rhi_free_buffer(&execute->cluster_light_buffer);
     rhi_free_descriptor_set(&execute->light_descriptor_set);
     rhi_free_descriptor_set_layout(&execute->light_descriptor_set_layout);
 
-    rhi_free_buffer(&execute->camera_buffer);
+    free(execute->lights);
+    for (u32 i = 0; i < FRAMES_IN_FLIGHT; i++)
+        free(execute->dirty.lights[i]);
+
+    rhi_free_uniform_ring(&execute->camera_buffer);
     rhi_free_descriptor_set(&execute->camera_descriptor_set);
     rhi_free_descriptor_set_layout(&execute->camera_descriptor_set_layout);
 }
 
 void resize_render_graph(RenderGraph* graph, RenderGraphExecute* execute)
 {
+    // Every pass rewrites its sets here, send them all in one update
+    rhi_begin_descriptor_writes();
     for (u32 i = 0; i < graph->node_count; i++)
         graph->nodes[i]->resize(graph->nodes[i], execute);
+    rhi_end_descriptor_writes();
+}
+
+internal void upload_render_graph_lights(RenderGraphExecute* execute)
+{
+    u32 slot = rhi_get_frame_slot();
+    u32 slot_bit = 1u << slot;
+
+    if (execute->dirty.light_count_slots & slot_bit)
+    {
+        rhi_upload_uniform_ring_range(&execute->light_buffer, &execute->light_count, 0, sizeof(execute->light_count));
+        execute->dirty.light_count_slots &= ~slot_bit;
+    }
+
+    // Static frames stop here
+    if (!(execute->dirty.light_slots & slot_bit))
+        return;
+
+    // Runs of consecutive dirty lights go up as one range
+    u32* words = execute->dirty.lights[slot];
+    u32 light = 0;
+    while (light < execute->light_capacity)
+    {
+        if (!(words[light >> 5] >> (light & 31)))
+        {
+            light = (light | 31) + 1;
+            continue;
+        }
+
+        if (!(words[light >> 5] & (1u << (light & 31))))
+        {
+            light++;
+            continue;
+        }
+
+        u32 first = light;
+        while (light < execute->light_capacity && (words[light >> 5] & (1u << (light & 31))))
+            light++;
+
+        rhi_upload_uniform_ring_range(&execute->light_buffer, &execute->lights[first], RENDER_GRAPH_LIGHT_HEADER_SIZE + first * sizeof(RenderGraphPointLight), (light - first) * sizeof(RenderGraphPointLight));
+    }
+
+    memset(words, 0, (execute->light_capacity / 32) * sizeof(u32));
+    execute->dirty.light_slots &= ~slot_bit;
+}
+
+internal void upload_render_graph_camera(RenderGraphExecute* execute)
+{
+    u32 slot = rhi_get_frame_slot();
+    u32 dirty = execute->dirty.camera[slot];
+
+    // Static frames stop here
+    if (!dirty)
+        return;
+
+    if (dirty == CAMERA_DIRTY_ALL)
+    {
+        rhi_upload_uniform_ring(&execute->camera_buffer, &execute->camera, sizeof(execute->camera));
+    }
+    else
+    {
+        if (dirty & CAMERA_DIRTY_PROJECTION)
+            rhi_upload_uniform_ring_range(&execute->camera_buffer, &execute->camera.projection, CAMERA_OFFSET(projection), sizeof(execute->camera.projection));
+        if (dirty & CAMERA_DIRTY_VIEW)
+            rhi_upload_uniform_ring_range(&execute->camera_buffer, &execute->camera.view, CAMERA_OFFSET(view), sizeof(execute->camera.view));
+        if (dirty & CAMERA_DIRTY_POSITION)
+            rhi_upload_uniform_ring_range(&execute->camera_buffer, &execute->camera.pos, CAMERA_OFFSET(pos), sizeof(execute->camera.pos));
+        if (dirty & CAMERA_DIRTY_FRUSTUM)
+            rhi_upload_uniform_ring_range(&execute->camera_buffer, &execute->camera.frustrum_planes, CAMERA_OFFSET(frustrum_planes), sizeof(execute->camera.frustrum_planes));
+        if (dirty & CAMERA_DIRTY_DEPTH_RANGE)
+            rhi_upload_uniform_ring_range(&execute->camera_buffer, &execute->camera.z_near, CAMERA_OFFSET(z_near), 2 * sizeof(f32));
+    }
+
+    execute->dirty.camera[slot] = 0;
+}
+
+void set_render_graph_light(RenderGraphExecute* execute, u32 index, RenderGraphPointLight* light)
+{
+    assert(index < execute->light_capacity);
+
+    RenderGraphPointLight value = *light;
+
+    // No radius given, cut the light off where it falls below RENDER_GRAPH_LIGHT_CUTOFF
+    if (value.radius <= 0.0f)
+    {
+        f32 intensity = max(value.color.X, max(value.color.Y, value.color.Z));
+        value.radius = sqrtf(intensity / RENDER_GRAPH_LIGHT_CUTOFF);
+    }
+
+    if (memcmp(&execute->lights[index], &value, sizeof(RenderGraphPointLight)) == 0)
+        return;
+
+    execute->lights[index] = value;
+    for (u32 i = 0; i < FRAMES_IN_FLIGHT; i++)
+        execute->dirty.lights[i][index >> 5] |= 1u << (index & 31);
+    execute->dirty.light_slots = ALL_FRAME_SLOTS;
+}
+
+void set_render_graph_light_count(RenderGraphExecute* execute, i32 count)
+{
+    assert(count >= 0);
+
+    if (execute->light_count == count)
+        return;
+
+    if ((u32)count > execute->light_capacity)
+    {
+        u32 capacity = execute->light_capacity;
+        while (capacity < (u32)count)
+            capacity *= 2;
+        grow_render_graph_lights(execute, capacity);
+    }
+
+    execute->light_count = count;
+    execute->dirty.light_count_slots = ALL_FRAME_SLOTS;
+}
+
+void set_render_graph_camera(RenderGraphExecute* execute, hmm_mat4 projection, hmm_mat4 view, hmm_vec3 pos, f32 z_near, f32 z_far)
+{
+    u32 fields = 0;
+
+    if (memcmp(&execute->camera.projection, &projection, sizeof(projection)) != 0)
+    {
+        execute->camera.projection = projection;
+        fields |= CAMERA_DIRTY_PROJECTION;
+    }
+    if (memcmp(&execute->camera.view, &view, sizeof(view)) != 0)
+    {
+        execute->camera.view = view;
+        fields |= CAMERA_DIRTY_VIEW;
+    }
+    if (memcmp(&execute->camera.pos, &pos, sizeof(pos)) != 0)
+    {
+        execute->camera.pos = pos;
+        fields |= CAMERA_DIRTY_POSITION;
+    }
+    if (execute->camera.z_near != z_near || execute->camera.z_far != z_far)
+    {
+        execute->camera.z_near = z_near;
+        execute->camera.z_far = z_far;
+        fields |= CAMERA_DIRTY_DEPTH_RANGE;
+    }
+
+    mark_render_graph_camera(execute, fields);
+}
+
+void set_render_graph_frustum(RenderGraphExecute* execute, hmm_vec4* planes)
+{
+    if (memcmp(execute->camera.frustrum_planes, planes, sizeof(execute->camera.frustrum_planes)) == 0)
+        return;
+
+    memcpy(execute->camera.frustrum_planes, planes, sizeof(execute->camera.frustrum_planes));
+    mark_render_graph_camera(execute, CAMERA_DIRTY_FRUSTUM);
 }
 
 void update_render_graph(RenderGraph* graph, RenderGraphExecute* execute)
 {
-    rhi_upload_buffer(&execute->camera_buffer, &execute->camera, sizeof(execute->camera));
-    rhi_upload_buffer(&execute->light_buffer, &execute->light_info, sizeof(execute->light_info));
+    upload_render_graph_camera(execute);
+    upload_render_graph_lights(execute);
 
     for (u32 i = 0; i < graph->node_count; i++)
         graph->nodes[i]->update(graph->nodes[i], execute);
@@ -10,7 +10,25 @@
 #define IS_NODE_INPUT(id) (((1u << 31u) & id) > 0)
 #define GET_NODE_PORT_INDEX(id) (((1u << 31u) - 1u) & id)
 #define RENDER_GRAPH_MAX_MODELS 512
-#define RENDER_GRAPH_MAX_LIGHTS 512
+#define RENDER_GRAPH_INITIAL_LIGHT_CAPACITY 1024
+#define RENDER_GRAPH_LIGHT_HEADER_SIZE 16
+#define RENDER_GRAPH_LIGHT_CUTOFF 0.02f
+#define RENDER_GRAPH_CLUSTER_X 16
+#define RENDER_GRAPH_CLUSTER_Y 9
+#define RENDER_GRAPH_CLUSTER_Z 24
+#define RENDER_GRAPH_CLUSTER_COUNT (RENDER_GRAPH_CLUSTER_X * RENDER_GRAPH_CLUSTER_Y * RENDER_GRAPH_CLUSTER_Z)
+#define RENDER_GRAPH_MAX_LIGHTS_PER_CLUSTER 128
+#define RENDER_GRAPH_IMAGE_HEAP_SIZE 4096
+#define RENDER_GRAPH_SAMPLER_HEAP_SIZE 1024
+#define SAMPLER_HEAP_NEAREST 0
+#define SAMPLER_HEAP_LINEAR 1
+#define SAMPLER_HEAP_RESERVED 2
+#define CAMERA_DIRTY_PROJECTION (1 << 0)
+#define CAMERA_DIRTY_VIEW (1 << 1)
+#define CAMERA_DIRTY_POSITION (1 << 2)
+#define CAMERA_DIRTY_FRUSTUM (1 << 3)
+#define CAMERA_DIRTY_DEPTH_RANGE (1 << 4)
+#define CAMERA_DIRTY_ALL 0x1F
 
 typedef struct RenderGraphExecute RenderGraphExecute;
 typedef struct RenderGraphNode RenderGraphNode;
@@ -21,9 +39,9 @@ typedef struct RenderGraphPointLight RenderGraphPointLight;
 struct RenderGraphPointLight
 {
     hmm_vec3 position;
-    f32 pad;
+    f32 radius;
     hmm_vec3 color;
-    f32 pad2;
+    f32 pad;
 };
 
 struct RenderGraphExecute
@@ -37,19 +55,21 @@ struct RenderGraphExecute
     RHI_DescriptorHeap image_heap;
     RHI_DescriptorHeap sampler_heap;
 
-    RHI_Buffer camera_buffer;
+    RHI_UniformRing camera_buffer;
     RHI_DescriptorSet camera_descriptor_set;
     RHI_DescriptorSetLayout camera_descriptor_set_layout;
 
-    RHI_Buffer light_buffer;
+    // Lights storage ring plus the per cluster light lists the light cull pass fills in
+    RHI_UniformRing light_buffer;
+    RHI_Buffer cluster_count_buffer;
+    RHI_Buffer cluster_light_buffer;
     RHI_DescriptorSet light_descriptor_set;
     RHI_DescriptorSetLayout light_descriptor_set_layout;
-    
-    struct {
-        RenderGraphPointLight lights[RENDER_GRAPH_MAX_LIGHTS];
-        i32 light_count;
-        hmm_vec3 pad;
-    } light_info;
+
+    // On the GPU the lights follow a RENDER_GRAPH_LIGHT_HEADER_SIZE header holding the count
+    RenderGraphPointLight* lights;
+    i32 light_count;
+    u32 light_capacity;
 
     struct {
         hmm_mat4 projection;
@@ -59,8 +79,36 @@ struct RenderGraphExecute
         f32 pad;
         
         hmm_vec4 frustrum_planes[6];
+
+        f32 z_near;
+        f32 z_far;
+        hmm_vec2 pad2;
     } camera;
 
+    // Change tracking per uniform ring slot, a change stays dirty until every slot got it
+    struct {
+        u32* lights[FRAMES_IN_FLIGHT];
+        u32 light_slots;
+        u32 light_count_slots;
+        u32 camera[FRAMES_IN_FLIGHT];
+    } dirty;
+
+    // Meshlet cull counters, read back by the geometry pass from the last frame that used this slot
+    struct {
+        u32 early_drawn;
+        u32 late_drawn;
+        u32 frustum_culled;
+        u32 occlusion_culled;
+        u32 backface_culled;
+        u32 primitive_culled;
+    } meshlet_stats;
+
+    // Primitives and whole meshes the CPU frustum cull rejected this frame, before any GPU work was recorded for them
+    struct {
+        u32 primitive_culled;
+        u32 model_culled;
+    } cpu_cull_stats;
+
     b32 freeze_frustrum;
 };
 
@@ -101,4 +149,10 @@ void free_render_graph(RenderGraph* graph, RenderGraphExecute* execute);
 void resize_render_graph(RenderGraph* graph, RenderGraphExecute* execute);
 void update_render_graph(RenderGraph* graph, RenderGraphExecute* execute);
 
+// Lights and camera go through these so only what changed gets uploaded
+void set_render_graph_light(RenderGraphExecute* execute, u32 index, RenderGraphPointLight* light);
+void set_render_graph_light_count(RenderGraphExecute* execute, i32 count);
+void set_render_graph_camera(RenderGraphExecute* execute, hmm_mat4 projection, hmm_mat4 view, hmm_vec3 pos, f32 z_near, f32 z_far);
+void set_render_graph_frustum(RenderGraphExecute* execute, hmm_vec4* planes);
+
 #endif
\ No newline at end of file
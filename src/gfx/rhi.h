@@ -17,16 +17,22 @@ TODO: Global Illumination
 #define BUFFER_VERTEX VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
 #define BUFFER_INDEX VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
 #define BUFFER_UNIFORM VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT
+#define BUFFER_STORAGE VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+#define BUFFER_INDIRECT VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
 #define IMAGE_RTV VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT
 #define IMAGE_GBUFFER VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
 #define IMAGE_DSV VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT
 #define IMAGE_STORAGE VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
 #define DESCRIPTOR_HEAP_IMAGE 0
 #define DESCRIPTOR_HEAP_SAMPLER 1
+#define DESCRIPTOR_HEAP_MAX_SIZE 4096
 #define DESCRIPTOR_IMAGE VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE
 #define DESCRIPTOR_SAMPLED_IMAGE VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
 #define DESCRIPTOR_SAMPLER VK_DESCRIPTOR_TYPE_SAMPLER
 #define DESCRIPTOR_BUFFER VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER
+#define DESCRIPTOR_DYNAMIC_BUFFER VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC
+#define DESCRIPTOR_STORAGE_BUFFER VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+#define DESCRIPTOR_DYNAMIC_STORAGE_BUFFER VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC
 #define DESCRIPTOR_STORAGE_IMAGE VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
 
 // It's not like I'm going to implement another graphics API for this project, so we'll let the vulkan stuff public for now kekw
@@ -35,6 +41,9 @@ TODO: Global Illumination
 
 #include <core/common.h>
 
+// Timeline semaphore value an upload flush signals once its copies are done
+typedef uint64_t RHI_UploadTicket;
+
 typedef struct RHI_RawImage RHI_RawImage;
 struct RHI_RawImage
 {
@@ -60,6 +69,7 @@ struct RHI_Image
     i32 width, height;
     u32 usage;
     u32 mip_levels;
+    VkImageView* mip_views;
 };
 
 typedef struct RHI_Sampler RHI_Sampler;
@@ -153,6 +163,18 @@ struct RHI_Buffer
     VmaMemoryUsage memory_usage;
 };  
 
+// FRAMES_IN_FLIGHT copies of a uniform block in one persistently mapped buffer, bound with a dynamic offset
+// Storage rings are the same thing bound as a dynamic storage buffer, for blocks that don't have a fixed size
+typedef struct RHI_UniformRing RHI_UniformRing;
+struct RHI_UniformRing
+{
+    RHI_Buffer buffer;
+    u8* mapped;
+    u64 size;
+    u64 stride;
+    b32 storage;
+};
+
 typedef struct RHI_DescriptorHeap RHI_DescriptorHeap;
 struct RHI_DescriptorHeap
 {
@@ -160,7 +182,11 @@ struct RHI_DescriptorHeap
     u32 size;
     u32 used;
     VkDescriptorSet set;
-    b32* heap_handle;
+
+    // Stack of free slots, plus one bit per slot so reserved and double freed slots can be told apart
+    u32* free_slots;
+    u32 free_count;
+    u32* allocated;
 };
 
 typedef struct RHI_RenderBegin RHI_RenderBegin;
@@ -179,6 +205,12 @@ struct RHI_RenderBegin
 };
 
 void rhi_init();
+// Called before rhi_init, keeps NV mesh shaders off even when the device has them so both paths can be compared
+void rhi_force_vertex_pipeline();
+// Task and mesh shaders are available, otherwise meshlets go through the vertex pipeline fallback
+b32 rhi_has_mesh_shaders();
+// Whether indirect draws can take their count from a buffer, see rhi_cmd_draw_*_indirect_count
+b32 rhi_has_draw_indirect_count();
 void rhi_begin();
 void rhi_end();
 void rhi_present();
@@ -187,7 +219,9 @@ void rhi_wait_idle();
 void rhi_resize();
 
 RHI_Image* rhi_get_swapchain_image();
+u32 rhi_get_swapchain_final_layout();
 RHI_CommandBuffer* rhi_get_swapchain_cmd_buf();
+u32 rhi_get_frame_slot();
 RHI_DescriptorSetLayout* rhi_get_image_heap_set_layout();
 RHI_DescriptorSetLayout* rhi_get_sampler_heap_set_layout();
 
@@ -201,9 +235,16 @@ void rhi_free_descriptor_set(RHI_DescriptorSet* set);
 void rhi_descriptor_set_write_sampler(RHI_DescriptorSet* set, RHI_Sampler* sampler, i32 binding);
 void rhi_descriptor_set_write_image(RHI_DescriptorSet* set, RHI_Image* image, i32 binding);
 void rhi_descriptor_set_write_image_sampler(RHI_DescriptorSet* set, RHI_Image* image, RHI_Sampler* sampler, i32 binding);
+void rhi_descriptor_set_write_image_mip(RHI_DescriptorSet* set, RHI_Image* image, i32 mip, i32 binding);
+void rhi_descriptor_set_write_storage_image_mip(RHI_DescriptorSet* set, RHI_Image* image, i32 mip, i32 binding);
 void rhi_descriptor_set_write_buffer(RHI_DescriptorSet* set, RHI_Buffer* buffer, i32 size, i32 binding);
 void rhi_descriptor_set_write_storage_image(RHI_DescriptorSet* set, RHI_Image* image, RHI_Sampler* sampler, i32 binding);
 void rhi_descriptor_set_write_storage_buffer(RHI_DescriptorSet* set, RHI_Buffer* buffer, i32 size, i32 binding);
+void rhi_descriptor_set_write_uniform_ring(RHI_DescriptorSet* set, RHI_UniformRing* ring, i32 binding);
+
+// Descriptor set and heap writes made in between are sent to the driver in one go, nesting is fine
+void rhi_begin_descriptor_writes();
+void rhi_end_descriptor_writes();
 
 // Samplers
 void rhi_init_sampler(RHI_Sampler* sampler, u32 mips);
@@ -220,6 +261,22 @@ void rhi_free_pipeline(RHI_Pipeline* pipeline);
 void rhi_allocate_buffer(RHI_Buffer* buffer, u64 size, u32 buffer_usage);
 void rhi_free_buffer(RHI_Buffer* buffer);
 void rhi_upload_buffer(RHI_Buffer* buffer, void* data, u64 size);
+// Fills part of a buffer, sub-allocated buffers get their pieces uploaded one by one
+void rhi_upload_buffer_range(RHI_Buffer* buffer, void* data, u64 offset, u64 size);
+RHI_UploadTicket rhi_flush_uploads();
+b32 rhi_upload_finished(RHI_UploadTicket ticket);
+void rhi_wait_upload(RHI_UploadTicket ticket);
+void rhi_wait_upload_gpu(RHI_UploadTicket ticket);
+void rhi_wait_uploads();
+
+// Uniform ring, writes go to the slot of the frame being recorded so the GPU never reads a block mid update
+void rhi_allocate_uniform_ring(RHI_UniformRing* ring, u64 size);
+void rhi_allocate_storage_ring(RHI_UniformRing* ring, u64 size);
+void rhi_free_uniform_ring(RHI_UniformRing* ring);
+void rhi_upload_uniform_ring(RHI_UniformRing* ring, void* data, u64 size);
+void rhi_read_uniform_ring(RHI_UniformRing* ring, void* data, u64 size);
+void rhi_upload_uniform_ring_range(RHI_UniformRing* ring, void* data, u64 offset, u64 size);
+u32 rhi_uniform_ring_offset(RHI_UniformRing* ring);
 
 // Raw Image
 void rhi_load_raw_image(RHI_RawImage* image, const char* path);
@@ -228,6 +285,7 @@ void rhi_free_raw_image(RHI_RawImage* image);
 
 // Image
 void rhi_allocate_image(RHI_Image* image, i32 width, i32 height, VkFormat format, u32 usage, u32 target_layout);
+void rhi_allocate_image_mips(RHI_Image* image, i32 width, i32 height, VkFormat format, u32 usage, u32 target_layout, u32 mip_levels);
 void rhi_allocate_cubemap(RHI_Image* image, i32 width, i32 height, VkFormat format, u32 usage, u32 target_layout);
 void rhi_upload_image(RHI_Image* image, RHI_RawImage* raw_image, b32 gen_mips);
 void rhi_free_image(RHI_Image* image);
@@ -235,6 +293,7 @@ void rhi_resize_image(RHI_Image* image, i32 width, i32 height);
 
 // Descriptor heap
 void rhi_init_descriptor_heap(RHI_DescriptorHeap* heap, u32 type, u32 size);
+void rhi_reserve_descriptors(RHI_DescriptorHeap* heap, u32 first, u32 count);
 i32 rhi_find_available_descriptor(RHI_DescriptorHeap* heap);
 void rhi_push_descriptor_heap_image(RHI_DescriptorHeap* heap, RHI_Image* image, i32 binding);
 void rhi_push_descriptor_heap_sampler(RHI_DescriptorHeap* heap, RHI_Sampler* sampler, i32 binding);
@@ -244,9 +303,7 @@ void rhi_free_descriptor_heap(RHI_DescriptorHeap* heap);
 // Cmd Buf
 void rhi_init_cmd_buf(RHI_CommandBuffer* buf, u32 command_buffer_type);
 void rhi_free_cmd_buf(RHI_CommandBuffer* buf);
-void rhi_init_upload_cmd_buf(RHI_CommandBuffer* buf);
 void rhi_submit_cmd_buf(RHI_CommandBuffer* buf);
-void rhi_submit_upload_cmd_buf(RHI_CommandBuffer* buf);
 void rhi_begin_cmd_buf(RHI_CommandBuffer* buf);
 void rhi_end_cmd_buf(RHI_CommandBuffer* buf);
 void rhi_cmd_set_viewport(RHI_CommandBuffer* buf, u32 width, u32 height);
@@ -255,15 +312,26 @@ void rhi_cmd_set_vertex_buffer(RHI_CommandBuffer* buf, RHI_Buffer* buffer);
 void rhi_cmd_set_index_buffer(RHI_CommandBuffer* buf, RHI_Buffer* buffer);
 void rhi_cmd_set_descriptor_heap(RHI_CommandBuffer* buf, RHI_Pipeline* pipeline, RHI_DescriptorHeap* heap, i32 binding);
 void rhi_cmd_set_descriptor_set(RHI_CommandBuffer* buf, RHI_Pipeline* pipeline, RHI_DescriptorSet* set, i32 binding);
+void rhi_cmd_set_dynamic_descriptor_set(RHI_CommandBuffer* buf, RHI_Pipeline* pipeline, RHI_DescriptorSet* set, i32 binding, u32* offsets, u32 offset_count);
 void rhi_cmd_set_push_constants(RHI_CommandBuffer* buf, RHI_Pipeline* pipeline, void* data, u32 size);
 void rhi_cmd_set_depth_bounds(RHI_CommandBuffer* buf, f32 min, f32 max);
 void rhi_cmd_draw(RHI_CommandBuffer* buf, u32 count);
 void rhi_cmd_draw_indexed(RHI_CommandBuffer* buf, u32 count);
 void rhi_cmd_draw_meshlets(RHI_CommandBuffer* buf, u32 count);
+// Task dispatches written by the GPU. The count variants read the draw count from count_buffer and clamp it to max_draw_count,
+// they are only available when rhi_has_draw_indirect_count
+void rhi_cmd_draw_meshlets_indirect(RHI_CommandBuffer* buf, RHI_Buffer* buffer, u64 offset, u32 draw_count, u32 stride);
+void rhi_cmd_draw_indexed_indirect(RHI_CommandBuffer* buf, RHI_Buffer* buffer, u64 offset, u32 draw_count, u32 stride);
+void rhi_cmd_draw_meshlets_indirect_count(RHI_CommandBuffer* buf, RHI_Buffer* buffer, u64 offset, RHI_Buffer* count_buffer, u64 count_offset, u32 max_draw_count, u32 stride);
+void rhi_cmd_draw_indexed_indirect_count(RHI_CommandBuffer* buf, RHI_Buffer* buffer, u64 offset, RHI_Buffer* count_buffer, u64 count_offset, u32 max_draw_count, u32 stride);
 void rhi_cmd_dispatch(RHI_CommandBuffer* buf, u32 x, u32 y, u32 z);
+// Fills size bytes from offset with the same word, offset and size are multiples of 4
+void rhi_cmd_fill_buffer(RHI_CommandBuffer* buf, RHI_Buffer* buffer, u64 offset, u64 size, u32 value);
 void rhi_cmd_start_render(RHI_CommandBuffer* buf, RHI_RenderBegin info);
 void rhi_cmd_end_render(RHI_CommandBuffer* buf);
 void rhi_cmd_img_transition_layout(RHI_CommandBuffer* buf, RHI_Image* img, u32 src_access, u32 dst_access, u32 src_layout, u32 dst_layout, u32 src_p_stage, u32 dst_p_stage, u32 layer);
+void rhi_cmd_buffer_barrier(RHI_CommandBuffer* buf, RHI_Buffer* buffer, u32 src_access, u32 dst_access, u32 src_p_stage, u32 dst_p_stage);
+void rhi_cmd_memory_barrier(RHI_CommandBuffer* buf, u32 src_access, u32 dst_access, u32 src_p_stage, u32 dst_p_stage);
 void rhi_cmd_img_blit(RHI_CommandBuffer* buf, RHI_Image* src, RHI_Image* dst, u32 srcl, u32 dstl);
 
 #endif
\ No newline at end of file
@@ -16,6 +16,85 @@
 #define vk_check(result) assert(result == VK_SUCCESS)
 #define ARRAY_SIZE(array) sizeof(array) / sizeof(array[0])
 
+#define STAGING_RING_SIZE (64 * 1024 * 1024)
+#define STAGING_ALIGNMENT 16
+#define STAGING_BATCH_COUNT 4
+#define STAGING_MAX_DEDICATED 16
+
+#define DESCRIPTOR_WRITE_BATCH_SIZE 256
+
+#define PIPELINE_CACHE_PATH "pipeline_cache.bin"
+#define PIPELINE_CACHE_MAGIC 0x48435041
+
+// Written in front of the driver's cache blob. The driver checks its own header too, but not the driver version
+typedef struct vk_pipeline_cache_header vk_pipeline_cache_header;
+struct vk_pipeline_cache_header
+{
+    u32 magic;
+    u32 vendor_id;
+    u32 device_id;
+    u32 driver_version;
+    u8 uuid[VK_UUID_SIZE];
+    u64 data_size;
+};
+
+// One submit worth of copies, its ring space is reclaimed once the timeline reaches its ticket.
+// cmd runs on the transfer queue, graphics_cmd picks up the queue ownership acquires, mip blits and
+// layout transitions a transfer only queue can't do. Without a dedicated transfer queue everything goes in cmd.
+typedef struct vk_staging_batch vk_staging_batch;
+struct vk_staging_batch
+{
+    VkCommandBuffer cmd;
+    VkCommandBuffer graphics_cmd;
+    RHI_UploadTicket ticket;
+    u64 ring_end;
+    b32 recording;
+    b32 graphics_recording;
+    b32 in_flight;
+
+    // Uploads bigger than the whole ring get their own staging buffer, freed with the batch
+    VkBuffer dedicated_buffers[STAGING_MAX_DEDICATED];
+    VmaAllocation dedicated_allocations[STAGING_MAX_DEDICATED];
+    u32 dedicated_count;
+};
+
+typedef struct vk_staging_ring vk_staging_ring;
+struct vk_staging_ring
+{
+    VkBuffer buffer;
+    VmaAllocation allocation;
+    u8* mapped;
+    VkCommandPool pool;
+    VkCommandPool graphics_pool;
+
+    // A ticket is the value timeline reaches once its batch is done. With a dedicated transfer queue
+    // transfer_timeline hands each batch over to its graphics half, which signals the ticket
+    VkSemaphore timeline;
+    VkSemaphore transfer_timeline;
+    RHI_UploadTicket timeline_value;
+
+    // Highest ticket the next frame submit has to wait for on the GPU
+    RHI_UploadTicket frame_wait;
+
+    // Virtual offsets that only grow, the physical offset is offset % STAGING_RING_SIZE
+    u64 head;
+    u64 tail;
+
+    vk_staging_batch batches[STAGING_BATCH_COUNT];
+    u32 current;
+};
+
+// Descriptor writes queued between rhi_begin_descriptor_writes and rhi_end_descriptor_writes
+typedef struct vk_descriptor_writes vk_descriptor_writes;
+struct vk_descriptor_writes
+{
+    VkWriteDescriptorSet writes[DESCRIPTOR_WRITE_BATCH_SIZE];
+    VkDescriptorImageInfo image_infos[DESCRIPTOR_WRITE_BATCH_SIZE];
+    VkDescriptorBufferInfo buffer_infos[DESCRIPTOR_WRITE_BATCH_SIZE];
+    u32 count;
+    u32 depth;
+};
+
 typedef struct vk_state vk_state;
 struct vk_state
 {
@@ -26,24 +105,29 @@ struct vk_state
     i32 extension_count;
 
     VkSurfaceKHR surface;
+    b32 headless;
 
     VkPhysicalDevice physical_device;
     u32 graphics_family;
     u32 compute_family;
+    u32 transfer_family;
+    b32 dedicated_transfer;
     VkPhysicalDeviceProperties2 physical_device_properties_2;
     VkPhysicalDeviceFeatures2 physical_device_features;
+    VkPhysicalDeviceVulkan12Features physical_device_vulkan12_features;
     VkPhysicalDeviceMeshShaderPropertiesNV mesh_shader_properties;
+    b32 mesh_shaders;
+    b32 draw_indirect_count;
 
     VkDevice device;
     VkQueue graphics_queue;
     VkQueue compute_queue;
+    VkQueue transfer_queue;
     char* device_extensions[64];
     i32 device_extension_count;
     VkCommandPool graphics_pool;
     VkCommandPool compute_pool;
     VkFence compute_fence;
-    VkCommandPool upload_pool;
-    VkFence upload_fence;
 
     VkSwapchainKHR swap_chain;
     VkExtent2D swap_chain_extent;
@@ -55,6 +139,7 @@ struct vk_state
     VkSemaphore image_rendered_semaphore;
     RHI_Image rhi_swap_chain[FRAMES_IN_FLIGHT];
     i32 image_index;
+    u32 frame_index;
 
     RHI_CommandBuffer swap_chain_cmd_bufs[FRAMES_IN_FLIGHT];
 
@@ -65,10 +150,21 @@ struct vk_state
 
     RHI_DescriptorSetLayout rhi_image_heap;
     RHI_DescriptorSetLayout rhi_sampler_heap;
+    vk_descriptor_writes descriptor_writes;
+
+    vk_staging_ring staging;
+
+    VkPipelineCache pipeline_cache;
+    u32 pipeline_cache_hits;
+    u32 pipeline_cache_misses;
+    f32 pipeline_create_time;
 };
 
 vk_state state;
 
+// Outside the state, it is set before rhi_init clears that
+internal b32 s_force_vertex_pipeline;
+
 b32 check_layers(u32 check_count, char **check_names, u32 layer_count, VkLayerProperties *layers) {
     for (u32 i = 0; i < check_count; i++) {
          b32 found = 0;
@@ -79,6 +175,8 @@ b32 check_layers(u32 check_count, char **check_names, u32 layer_count, VkLayerPr
                 break;
             }
         }
+        if (!found)
+            return 0;
     }
     return 1;
 }
@@ -87,7 +185,6 @@ void rhi_make_instance()
 {
     u32 instance_extension_count = 0;
     u32 instance_layer_count = 0;
-    u32 validation_layer_count = 0;
     char** instance_validation_layers = NULL;
 
     char* instance_validation_layers_alt1[] = {
@@ -110,7 +207,6 @@ void rhi_make_instance()
         if (validation_found) {
             state.layer_count = 1;
             state.layers[0] = "VK_LAYER_KHRONOS_validation";
-            validation_layer_count = 1;
         }
 
         free(instance_layers);
@@ -137,9 +233,15 @@ void rhi_make_instance()
                     state.extensions[state.extension_count++] = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
                 }
 
+#if defined(VK_USE_PLATFORM_WIN32_KHR)
                 if (!strcmp(VK_KHR_WIN32_SURFACE_EXTENSION_NAME, instance_extensions[i].extensionName)) {
                     state.extensions[state.extension_count++] = VK_KHR_WIN32_SURFACE_EXTENSION_NAME;
                 }
+#elif defined(VK_USE_PLATFORM_XLIB_KHR)
+                if (!strcmp(VK_KHR_XLIB_SURFACE_EXTENSION_NAME, instance_extensions[i].extensionName)) {
+                    state.extensions[state.extension_count++] = VK_KHR_XLIB_SURFACE_EXTENSION_NAME;
+                }
+#endif
 
                 assert(state.extension_count < 64);
             }
@@ -186,14 +288,55 @@ void rhi_make_physical_device()
         free(devices);
     }
 
+    // Mesh shaders need the extension and both stages, anything else takes the vertex pipeline path
+    b32 draw_indirect_count_extension = 0;
+    u32 extension_count = 0;
+    vkEnumerateDeviceExtensionProperties(state.physical_device, NULL, &extension_count, NULL);
+    VkExtensionProperties* extensions = malloc(sizeof(VkExtensionProperties) * extension_count);
+    vkEnumerateDeviceExtensionProperties(state.physical_device, NULL, &extension_count, extensions);
+    for (u32 i = 0; i < extension_count; i++)
+    {
+        if (!strcmp(VK_NV_MESH_SHADER_EXTENSION_NAME, extensions[i].extensionName))
+            state.mesh_shaders = !s_force_vertex_pipeline;
+        if (!strcmp(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME, extensions[i].extensionName))
+            draw_indirect_count_extension = 1;
+    }
+    free(extensions);
+
+    VkPhysicalDeviceMeshShaderFeaturesNV mesh_shader_features = { 0 };
+    mesh_shader_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_NV;
+
     state.physical_device_properties_2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
     state.mesh_shader_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_PROPERTIES_NV;
 
-    state.physical_device_properties_2.pNext = &state.mesh_shader_properties;
+    state.physical_device_properties_2.pNext = state.mesh_shaders ? &state.mesh_shader_properties : NULL;
     vkGetPhysicalDeviceProperties2(state.physical_device, &state.physical_device_properties_2);
 
+    state.physical_device_vulkan12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    state.physical_device_vulkan12_features.pNext = state.mesh_shaders ? &mesh_shader_features : NULL;
+
     state.physical_device_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    state.physical_device_features.pNext = &state.physical_device_vulkan12_features;
     vkGetPhysicalDeviceFeatures2(state.physical_device, &state.physical_device_features);
+    state.physical_device_features.pNext = NULL;
+    state.physical_device_vulkan12_features.pNext = NULL;
+
+    state.mesh_shaders = state.mesh_shaders && mesh_shader_features.taskShader && mesh_shader_features.meshShader;
+    printf("Meshlets are drawn with %s\n", state.mesh_shaders ? "NV mesh shaders" : "the vertex pipeline fallback");
+
+    // The G-buffer pass is drawn from GPU written indirect commands and can't do without multi draw indirect. The vertex
+    // pipeline fallback also passes the primitive index as first_instance. A draw count is optional, without one every
+    // visible primitive gets a draw slot and the culled ones draw nothing
+    VkPhysicalDeviceFeatures* supported = &state.physical_device_features.features;
+    if (!supported->multiDrawIndirect)
+        printf("The device doesn't support multiDrawIndirect, which the G-buffer pass needs\n");
+    if (!state.mesh_shaders && !supported->drawIndirectFirstInstance)
+        printf("The device doesn't support drawIndirectFirstInstance, which the vertex pipeline fallback needs\n");
+    assert(supported->multiDrawIndirect);
+    assert(state.mesh_shaders || supported->drawIndirectFirstInstance);
+
+    state.draw_indirect_count = state.physical_device_vulkan12_features.drawIndirectCount || draw_indirect_count_extension;
+    printf("Indirect draws %s\n", state.draw_indirect_count ? "read their count from the GPU" : "take one slot per visible primitive");
 
     // Find queue families
     u32 queue_family_count = 0;
@@ -217,6 +360,19 @@ void rhi_make_physical_device()
             }
         }
 
+        // A transfer only family maps to the copy engines, uploads there run alongside rendering
+        state.transfer_family = state.graphics_family;
+        for (u32 i = 0; i < queue_family_count; i++)
+        {
+            VkQueueFlags flags = queue_families[i].queueFlags;
+            if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+            {
+                state.transfer_family = i;
+                break;
+            }
+        }
+        state.dedicated_transfer = state.transfer_family != state.graphics_family;
+
         free(queue_families);
     }
 }
@@ -241,37 +397,48 @@ void rhi_make_device()
     compute_queue_create_info.queueCount = 1;
     compute_queue_create_info.pQueuePriorities = &queuePriority;
 
+    VkDeviceQueueCreateInfo transfer_queue_create_info = graphics_queue_create_info;
+    transfer_queue_create_info.queueFamilyIndex = state.transfer_family;
+
+    // Indirect draw features are only turned on when the device reported them
+    VkPhysicalDeviceFeatures* supported = &state.physical_device_features.features;
     VkPhysicalDeviceFeatures features = {0};
     features.samplerAnisotropy = 1;
     features.fillModeNonSolid = 1;
     features.geometryShader = 1;
     features.pipelineStatisticsQuery = 1;
+    features.multiDrawIndirect = supported->multiDrawIndirect;
+    features.drawIndirectFirstInstance = supported->drawIndirectFirstInstance;
 
     state.physical_device_features.features = features;
 
-    VkPhysicalDevice16BitStorageFeatures features16 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES };
+    VkPhysicalDevice16BitStorageFeatures features16 = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES };
     features16.storageBuffer16BitAccess = true;
 
-    VkPhysicalDevice8BitStorageFeaturesKHR features8 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_8BIT_STORAGE_FEATURES_KHR };
-    features8.storageBuffer8BitAccess = true;
-    features8.uniformAndStorageBuffer8BitAccess = true;
-    features8.pNext = &features16;
-
     VkPhysicalDeviceMeshShaderFeaturesNV mesh_shader_features = { 0 };
     mesh_shader_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_NV;
     mesh_shader_features.taskShader = VK_TRUE;
     mesh_shader_features.meshShader = VK_TRUE;
-    mesh_shader_features.pNext = &features8;
-
-    VkPhysicalDeviceDescriptorIndexingFeatures indexing_features = {0};
-    indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
-    indexing_features.descriptorBindingPartiallyBound = 1;
-    indexing_features.pNext = &mesh_shader_features;
+    mesh_shader_features.pNext = &features16;
+
+    // 8 bit storage, descriptor indexing and timeline semaphores are core 1.2 features and go in one struct with the draw count,
+    // the device create info can't have both that struct and the per extension ones. Enabled promoted extensions need their
+    // feature on as well, the device reports both whenever it has the extension
+    VkPhysicalDeviceVulkan12Features vulkan12_features = { 0 };
+    vulkan12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12_features.storageBuffer8BitAccess = 1;
+    vulkan12_features.uniformAndStorageBuffer8BitAccess = 1;
+    vulkan12_features.descriptorIndexing = state.physical_device_vulkan12_features.descriptorIndexing;
+    vulkan12_features.descriptorBindingPartiallyBound = 1;
+    vulkan12_features.descriptorBindingVariableDescriptorCount = 1;
+    vulkan12_features.timelineSemaphore = 1;
+    vulkan12_features.drawIndirectCount = state.physical_device_vulkan12_features.drawIndirectCount;
+    vulkan12_features.pNext = state.mesh_shaders ? (void*)&mesh_shader_features : (void*)&features16;
 
     VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamic_features = { 0 };
     dynamic_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
     dynamic_features.dynamicRendering = 1;
-    dynamic_features.pNext = &indexing_features; 
+    dynamic_features.pNext = &vulkan12_features;
 
     state.physical_device_features.pNext = &dynamic_features;
 
@@ -286,7 +453,7 @@ void rhi_make_device()
         {
             printf("Device Extension: %s\n", properties[i].extensionName);
 
-            if (!strcmp(VK_KHR_SWAPCHAIN_EXTENSION_NAME, properties[i].extensionName)) {
+            if (!state.headless && !strcmp(VK_KHR_SWAPCHAIN_EXTENSION_NAME, properties[i].extensionName)) {
                 state.device_extensions[state.device_extension_count++] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
             }
 
@@ -302,7 +469,7 @@ void rhi_make_device()
                 state.device_extensions[state.device_extension_count++] = VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME;
             }
 
-            if (!strcmp(VK_NV_MESH_SHADER_EXTENSION_NAME, properties[i].extensionName)) {
+            if (state.mesh_shaders && !strcmp(VK_NV_MESH_SHADER_EXTENSION_NAME, properties[i].extensionName)) {
                 state.device_extensions[state.device_extension_count++] = VK_NV_MESH_SHADER_EXTENSION_NAME;
             }
 
@@ -317,17 +484,26 @@ void rhi_make_device()
             if (!strcmp(VK_KHR_8BIT_STORAGE_EXTENSION_NAME, properties[i].extensionName)) {
                 state.device_extensions[state.device_extension_count++] = VK_KHR_8BIT_STORAGE_EXTENSION_NAME;
             }
+
+            if (!strcmp(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME, properties[i].extensionName)) {
+                state.device_extensions[state.device_extension_count++] = VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME;
+            }
         }
 
         free(properties);
     }
 
-    VkDeviceQueueCreateInfo queue_create_infos[2] = {graphics_queue_create_info, compute_queue_create_info};
-    i32 queue_create_info_count = 2;
+    // One create info per family, the queues can share one
+    VkDeviceQueueCreateInfo queue_create_infos[3] = {graphics_queue_create_info};
+    i32 queue_create_info_count = 1;
+    if (state.compute_family != state.graphics_family)
+        queue_create_infos[queue_create_info_count++] = compute_queue_create_info;
+    if (state.transfer_family != state.graphics_family && state.transfer_family != state.compute_family)
+        queue_create_infos[queue_create_info_count++] = transfer_queue_create_info;
 
     VkDeviceCreateInfo create_info = {0};
     create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    create_info.queueCreateInfoCount = 2;
+    create_info.queueCreateInfoCount = queue_create_info_count;
     create_info.pQueueCreateInfos = queue_create_infos;
     create_info.enabledExtensionCount = state.device_extension_count;
     create_info.ppEnabledExtensionNames = (const char* const*)state.device_extensions;
@@ -341,6 +517,7 @@ void rhi_make_device()
     volkLoadDevice(state.device);
     vkGetDeviceQueue(state.device, state.graphics_family, 0, &state.graphics_queue);
     vkGetDeviceQueue(state.device, state.compute_family, 0, &state.compute_queue);
+    vkGetDeviceQueue(state.device, state.transfer_family, 0, &state.transfer_queue);
 }
 
 void rhi_make_swapchain()
@@ -413,9 +590,28 @@ void rhi_make_swapchain()
         state.rhi_swap_chain[i].image_view = state.swap_chain_image_views[i];
         state.rhi_swap_chain[i].image_layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
         state.rhi_swap_chain[i].mip_levels = 1;
+        state.rhi_swap_chain[i].mip_views = NULL;
     }
 }
 
+// Headless mode: the swapchain is replaced by a ring of FRAMES_IN_FLIGHT offscreen images, left in
+// TRANSFER_SRC_OPTIMAL after the final blit so they can be read back.
+void rhi_make_offscreen_targets()
+{
+    state.swap_chain_extent.width = platform.width;
+    state.swap_chain_extent.height = platform.height;
+    state.swap_chain_format = VK_FORMAT_B8G8R8A8_UNORM;
+
+    for (u32 i = 0; i < FRAMES_IN_FLIGHT; i++)
+        rhi_allocate_image(&state.rhi_swap_chain[i], platform.width, platform.height, state.swap_chain_format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+}
+
+void rhi_free_offscreen_targets()
+{
+    for (u32 i = 0; i < FRAMES_IN_FLIGHT; i++)
+        rhi_free_image(&state.rhi_swap_chain[i]);
+}
+
 void rhi_make_sync()
 {
     VkResult result;
@@ -423,9 +619,6 @@ void rhi_make_sync()
     VkFenceCreateInfo fence_info = { 0 };
     fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 
-    result = vkCreateFence(state.device, &fence_info, NULL, &state.upload_fence);
-    vk_check(result);
-
     result = vkCreateFence(state.device, &fence_info, NULL, &state.compute_fence);
     vk_check(result);
 
@@ -453,8 +646,6 @@ void rhi_make_cmd()
 
     VkResult result = vkCreateCommandPool(state.device, &command_pool_create_info, NULL, &state.graphics_pool);
     vk_check(result);
-    result = vkCreateCommandPool(state.device, &command_pool_create_info, NULL, &state.upload_pool);
-    vk_check(result);
 
     command_pool_create_info.queueFamilyIndex = state.compute_family;
     result = vkCreateCommandPool(state.device, &command_pool_create_info, NULL, &state.compute_pool);
@@ -511,16 +702,19 @@ void rhi_make_allocator()
 void rhi_make_descriptors()
 {
     VkDescriptorPoolSize sizes[] = {
-        { VK_DESCRIPTOR_TYPE_SAMPLER, 4096 },
-        { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 4096 },
+        { VK_DESCRIPTOR_TYPE_SAMPLER, DESCRIPTOR_HEAP_MAX_SIZE * 2 },
+        { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, DESCRIPTOR_HEAP_MAX_SIZE * 2 },
         { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4096 },
-        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 4096 }
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 4096 },
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1024 },
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 256 },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 256 }
     };
 
     VkDescriptorPoolCreateInfo pool_info = {0};
     pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     pool_info.pPoolSizes = sizes;
-    pool_info.poolSizeCount = 4;
+    pool_info.poolSizeCount = 7;
     pool_info.maxSets = 2048;
     pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
 
@@ -529,11 +723,11 @@ void rhi_make_descriptors()
 
     VkDescriptorSetLayoutBinding binding = {0};
     binding.binding = 0;
-    binding.descriptorCount = 2048;
+    binding.descriptorCount = DESCRIPTOR_HEAP_MAX_SIZE;
     binding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
     binding.stageFlags = VK_SHADER_STAGE_ALL;
 
-    VkDescriptorBindingFlags flag = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+    VkDescriptorBindingFlags flag = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT;
     VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags = {0};
     binding_flags.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
     binding_flags.bindingCount = 1;
@@ -555,14 +749,478 @@ void rhi_make_descriptors()
     vk_check(res);
 
     state.rhi_image_heap.descriptors[0] = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-    state.rhi_image_heap.descriptor_count = 2048;
+    state.rhi_image_heap.descriptor_count = DESCRIPTOR_HEAP_MAX_SIZE;
     state.rhi_image_heap.layout = state.image_heap_layout;
 
     state.rhi_sampler_heap.descriptors[0] = VK_DESCRIPTOR_TYPE_SAMPLER;
-    state.rhi_sampler_heap.descriptor_count = 2048;
+    state.rhi_sampler_heap.descriptor_count = DESCRIPTOR_HEAP_MAX_SIZE;
     state.rhi_sampler_heap.layout = state.sampler_heap_layout;
 }
 
+internal void rhi_flush_descriptor_writes()
+{
+    if (state.descriptor_writes.count == 0)
+        return;
+
+    vkUpdateDescriptorSets(state.device, state.descriptor_writes.count, state.descriptor_writes.writes, 0, NULL);
+    state.descriptor_writes.count = 0;
+}
+
+void rhi_make_pipeline_cache()
+{
+    VkPhysicalDeviceProperties* properties = &state.physical_device_properties_2.properties;
+
+    VkPipelineCacheCreateInfo cache_info = { 0 };
+    cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+    u8* file_data = NULL;
+    FILE* file = fopen(PIPELINE_CACHE_PATH, "rb");
+    if (file)
+    {
+        vk_pipeline_cache_header header = { 0 };
+        if (fread(&header, sizeof(header), 1, file) == 1)
+        {
+            // A cache from another GPU or driver is at best useless, throw it away
+            b32 valid = header.magic == PIPELINE_CACHE_MAGIC &&
+                        header.vendor_id == properties->vendorID &&
+                        header.device_id == properties->deviceID &&
+                        header.driver_version == properties->driverVersion &&
+                        memcmp(header.uuid, properties->pipelineCacheUUID, VK_UUID_SIZE) == 0 &&
+                        header.data_size > 0;
+
+            if (valid)
+            {
+                file_data = malloc(header.data_size);
+                if (file_data && fread(file_data, header.data_size, 1, file) == 1)
+                {
+                    cache_info.initialDataSize = header.data_size;
+                    cache_info.pInitialData = file_data;
+                }
+            }
+            else
+            {
+                printf("Pipeline cache %s was written by another device or driver, rebuilding\n", PIPELINE_CACHE_PATH);
+            }
+        }
+
+        fclose(file);
+    }
+
+    VkResult result = vkCreatePipelineCache(state.device, &cache_info, NULL, &state.pipeline_cache);
+    if (result != VK_SUCCESS && cache_info.pInitialData)
+    {
+        // The driver rejected the blob, start over with an empty cache
+        cache_info.initialDataSize = 0;
+        cache_info.pInitialData = NULL;
+        result = vkCreatePipelineCache(state.device, &cache_info, NULL, &state.pipeline_cache);
+    }
+    vk_check(result);
+
+    free(file_data);
+}
+
+void rhi_free_pipeline_cache()
+{
+    printf("Pipeline cache: %u hits, %u misses, %f seconds creating pipelines\n", state.pipeline_cache_hits, state.pipeline_cache_misses, state.pipeline_create_time);
+
+    size_t data_size = 0;
+    vkGetPipelineCacheData(state.device, state.pipeline_cache, &data_size, NULL);
+
+    u8* data = data_size > 0 ? malloc(data_size) : NULL;
+    if (data && vkGetPipelineCacheData(state.device, state.pipeline_cache, &data_size, data) == VK_SUCCESS)
+    {
+        VkPhysicalDeviceProperties* properties = &state.physical_device_properties_2.properties;
+
+        vk_pipeline_cache_header header = { 0 };
+        header.magic = PIPELINE_CACHE_MAGIC;
+        header.vendor_id = properties->vendorID;
+        header.device_id = properties->deviceID;
+        header.driver_version = properties->driverVersion;
+        memcpy(header.uuid, properties->pipelineCacheUUID, VK_UUID_SIZE);
+        header.data_size = data_size;
+
+        FILE* file = fopen(PIPELINE_CACHE_PATH, "wb");
+        if (file)
+        {
+            fwrite(&header, sizeof(header), 1, file);
+            fwrite(data, data_size, 1, file);
+            fclose(file);
+        }
+    }
+
+    free(data);
+    vkDestroyPipelineCache(state.device, state.pipeline_cache, NULL);
+}
+
+internal void rhi_record_pipeline_creation(VkPipelineCreationFeedback* feedback, f32 start)
+{
+    state.pipeline_create_time += aurora_platform_get_time() - start;
+
+    if (!(feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT))
+        return;
+
+    if (feedback->flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT)
+        state.pipeline_cache_hits++;
+    else
+        state.pipeline_cache_misses++;
+}
+
+void rhi_make_staging()
+{
+    VkBufferCreateInfo buffer_info = { 0 };
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_info.size = STAGING_RING_SIZE;
+
+    VmaAllocationCreateInfo alloc_info = { 0 };
+    alloc_info.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+    alloc_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    VmaAllocationInfo allocation_info = { 0 };
+    VkResult result = vmaCreateBuffer(state.allocator, &buffer_info, &alloc_info, &state.staging.buffer, &state.staging.allocation, &allocation_info);
+    vk_check(result);
+    state.staging.mapped = (u8*)allocation_info.pMappedData;
+
+    VkCommandPoolCreateInfo pool_info = { 0 };
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.queueFamilyIndex = state.transfer_family;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    result = vkCreateCommandPool(state.device, &pool_info, NULL, &state.staging.pool);
+    vk_check(result);
+
+    if (state.dedicated_transfer)
+    {
+        pool_info.queueFamilyIndex = state.graphics_family;
+        result = vkCreateCommandPool(state.device, &pool_info, NULL, &state.staging.graphics_pool);
+        vk_check(result);
+    }
+
+    VkCommandBufferAllocateInfo cmd_info = { 0 };
+    cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmd_info.commandBufferCount = 1;
+
+    for (u32 i = 0; i < STAGING_BATCH_COUNT; i++)
+    {
+        cmd_info.commandPool = state.staging.pool;
+        result = vkAllocateCommandBuffers(state.device, &cmd_info, &state.staging.batches[i].cmd);
+        vk_check(result);
+
+        if (state.dedicated_transfer)
+        {
+            cmd_info.commandPool = state.staging.graphics_pool;
+            result = vkAllocateCommandBuffers(state.device, &cmd_info, &state.staging.batches[i].graphics_cmd);
+            vk_check(result);
+        }
+    }
+
+    VkSemaphoreTypeCreateInfo type_info = { 0 };
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphore_info = { 0 };
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_info.pNext = &type_info;
+
+    result = vkCreateSemaphore(state.device, &semaphore_info, NULL, &state.staging.timeline);
+    vk_check(result);
+    result = vkCreateSemaphore(state.device, &semaphore_info, NULL, &state.staging.transfer_timeline);
+    vk_check(result);
+}
+
+internal void rhi_staging_retire(vk_staging_batch* batch)
+{
+    rhi_wait_upload(batch->ticket);
+
+    for (u32 i = 0; i < batch->dedicated_count; i++)
+        vmaDestroyBuffer(state.allocator, batch->dedicated_buffers[i], batch->dedicated_allocations[i]);
+    batch->dedicated_count = 0;
+
+    state.staging.tail = max(state.staging.tail, batch->ring_end);
+    batch->in_flight = 0;
+}
+
+// Batches are submitted in slot order, so the oldest in flight one is the first found starting at the current slot
+internal b32 rhi_staging_retire_oldest()
+{
+    for (u32 i = 0; i < STAGING_BATCH_COUNT; i++)
+    {
+        vk_staging_batch* batch = &state.staging.batches[(state.staging.current + i) % STAGING_BATCH_COUNT];
+        if (batch->in_flight)
+        {
+            rhi_staging_retire(batch);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+internal void rhi_staging_begin_cmd(VkCommandBuffer cmd)
+{
+    vkResetCommandBuffer(cmd, 0);
+
+    VkCommandBufferBeginInfo begin_info = { 0 };
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vk_check(vkBeginCommandBuffer(cmd, &begin_info));
+}
+
+internal vk_staging_batch* rhi_staging_begin()
+{
+    vk_staging_batch* batch = &state.staging.batches[state.staging.current];
+
+    if (!batch->recording)
+    {
+        if (batch->in_flight)
+            rhi_staging_retire(batch);
+
+        rhi_staging_begin_cmd(batch->cmd);
+        batch->recording = 1;
+    }
+
+    return batch;
+}
+
+// Command buffer for the graphics queue half of the batch, the transfer one when both are the same queue
+internal VkCommandBuffer rhi_staging_graphics_cmd(vk_staging_batch* batch)
+{
+    if (!state.dedicated_transfer)
+        return batch->cmd;
+
+    if (!batch->graphics_recording)
+    {
+        rhi_staging_begin_cmd(batch->graphics_cmd);
+        batch->graphics_recording = 1;
+    }
+
+    return batch->graphics_cmd;
+}
+
+// Hands a freshly written buffer from the transfer queue to the graphics queue, or just makes the copy visible
+internal void rhi_staging_buffer_barrier(vk_staging_batch* batch, VkBuffer buffer, u64 offset, u64 size)
+{
+    VkBufferMemoryBarrier barrier = { 0 };
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffer;
+    barrier.offset = offset;
+    barrier.size = size;
+
+    if (!state.dedicated_transfer)
+    {
+        vkCmdPipelineBarrier(batch->cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, NULL, 1, &barrier, 0, NULL);
+        return;
+    }
+
+    barrier.srcQueueFamilyIndex = state.transfer_family;
+    barrier.dstQueueFamilyIndex = state.graphics_family;
+
+    // Release: the destination access is ignored on this side
+    VkAccessFlags dst_access = barrier.dstAccessMask;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(batch->cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 1, &barrier, 0, NULL);
+
+    // Acquire: the semaphore wait already covers the copy
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = dst_access;
+    vkCmdPipelineBarrier(rhi_staging_graphics_cmd(batch), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, NULL, 1, &barrier, 0, NULL);
+}
+
+// Same as above for an image left in TRANSFER_DST_OPTIMAL, the graphics side finishes it off
+internal void rhi_staging_image_ownership(vk_staging_batch* batch, RHI_Image* image)
+{
+    if (!state.dedicated_transfer)
+        return;
+
+    VkImageMemoryBarrier barrier = { 0 };
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = state.transfer_family;
+    barrier.dstQueueFamilyIndex = state.graphics_family;
+    barrier.image = image->image;
+    barrier.subresourceRange.aspectMask = vk_get_image_aspect(image->format);
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+    vkCmdPipelineBarrier(batch->cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(rhi_staging_graphics_cmd(batch), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+// Returns a CPU pointer to write the upload to, and the buffer/offset to copy from once it is recorded.
+// Must be called before rhi_staging_begin() since making room can flush the batch being recorded.
+internal u8* rhi_staging_alloc(u64 size, VkBuffer* out_buffer, u64* out_offset)
+{
+    if (size > STAGING_RING_SIZE)
+    {
+        vk_staging_batch* batch = rhi_staging_begin();
+        if (batch->dedicated_count == STAGING_MAX_DEDICATED)
+        {
+            rhi_flush_uploads();
+            batch = rhi_staging_begin();
+        }
+
+        VkBufferCreateInfo buffer_info = { 0 };
+        buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        buffer_info.size = size;
+
+        VmaAllocationCreateInfo alloc_info = { 0 };
+        alloc_info.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+        alloc_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+        u32 index = batch->dedicated_count++;
+        VmaAllocationInfo allocation_info = { 0 };
+        vk_check(vmaCreateBuffer(state.allocator, &buffer_info, &alloc_info, &batch->dedicated_buffers[index], &batch->dedicated_allocations[index], &allocation_info));
+
+        *out_buffer = batch->dedicated_buffers[index];
+        *out_offset = 0;
+        return (u8*)allocation_info.pMappedData;
+    }
+
+    for (;;)
+    {
+        // Nothing pending, start over at the beginning of the ring
+        if (state.staging.head == state.staging.tail)
+        {
+            state.staging.head = (state.staging.head + STAGING_RING_SIZE - 1) / STAGING_RING_SIZE * STAGING_RING_SIZE;
+            state.staging.tail = state.staging.head;
+        }
+
+        u64 offset = (state.staging.head + STAGING_ALIGNMENT - 1) & ~(u64)(STAGING_ALIGNMENT - 1);
+
+        // Never split an upload across the end of the ring
+        if ((offset % STAGING_RING_SIZE) + size > STAGING_RING_SIZE)
+            offset = (offset / STAGING_RING_SIZE + 1) * STAGING_RING_SIZE;
+
+        if (offset + size - state.staging.tail <= STAGING_RING_SIZE)
+        {
+            state.staging.head = offset + size;
+            *out_buffer = state.staging.buffer;
+            *out_offset = offset % STAGING_RING_SIZE;
+            return state.staging.mapped + *out_offset;
+        }
+
+        // Out of space: reclaim the oldest submitted batch, or submit the one being recorded
+        if (!rhi_staging_retire_oldest())
+            rhi_flush_uploads();
+    }
+}
+
+RHI_UploadTicket rhi_flush_uploads()
+{
+    vk_staging_batch* batch = &state.staging.batches[state.staging.current];
+    if (!batch->recording)
+        return state.staging.timeline_value;
+
+    vk_check(vkEndCommandBuffer(batch->cmd));
+
+    RHI_UploadTicket ticket = ++state.staging.timeline_value;
+
+    VkTimelineSemaphoreSubmitInfo timeline_info = { 0 };
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.signalSemaphoreValueCount = 1;
+    timeline_info.pSignalSemaphoreValues = &ticket;
+
+    VkSubmitInfo submit_info = { 0 };
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &batch->cmd;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = state.dedicated_transfer ? &state.staging.transfer_timeline : &state.staging.timeline;
+
+    vk_check(vkQueueSubmit(state.transfer_queue, 1, &submit_info, VK_NULL_HANDLE));
+
+    // The graphics half always goes out, even empty, so tickets are only ever signalled from one queue in order
+    if (state.dedicated_transfer)
+    {
+        VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+        timeline_info.waitSemaphoreValueCount = 1;
+        timeline_info.pWaitSemaphoreValues = &ticket;
+
+        submit_info.waitSemaphoreCount = 1;
+        submit_info.pWaitSemaphores = &state.staging.transfer_timeline;
+        submit_info.pWaitDstStageMask = &wait_stage;
+        submit_info.commandBufferCount = 0;
+        submit_info.pSignalSemaphores = &state.staging.timeline;
+
+        if (batch->graphics_recording)
+        {
+            vk_check(vkEndCommandBuffer(batch->graphics_cmd));
+            submit_info.commandBufferCount = 1;
+            submit_info.pCommandBuffers = &batch->graphics_cmd;
+            batch->graphics_recording = 0;
+        }
+
+        vk_check(vkQueueSubmit(state.graphics_queue, 1, &submit_info, VK_NULL_HANDLE));
+    }
+
+    batch->ticket = ticket;
+    batch->ring_end = state.staging.head;
+    batch->recording = 0;
+    batch->in_flight = 1;
+    state.staging.current = (state.staging.current + 1) % STAGING_BATCH_COUNT;
+
+    return ticket;
+}
+
+b32 rhi_upload_finished(RHI_UploadTicket ticket)
+{
+    u64 value = 0;
+    vkGetSemaphoreCounterValue(state.device, state.staging.timeline, &value);
+    return value >= ticket;
+}
+
+void rhi_wait_upload(RHI_UploadTicket ticket)
+{
+    VkSemaphoreWaitInfo wait_info = { 0 };
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &state.staging.timeline;
+    wait_info.pValues = &ticket;
+
+    vk_check(vkWaitSemaphores(state.device, &wait_info, UINT64_MAX));
+}
+
+void rhi_wait_upload_gpu(RHI_UploadTicket ticket)
+{
+    state.staging.frame_wait = max(state.staging.frame_wait, ticket);
+}
+
+void rhi_wait_uploads()
+{
+    rhi_flush_uploads();
+    while (rhi_staging_retire_oldest())
+        ;
+}
+
+void rhi_free_staging()
+{
+    rhi_wait_uploads();
+
+    vkDestroySemaphore(state.device, state.staging.timeline, NULL);
+    vkDestroySemaphore(state.device, state.staging.transfer_timeline, NULL);
+    vkDestroyCommandPool(state.device, state.staging.pool, NULL);
+    if (state.dedicated_transfer)
+        vkDestroyCommandPool(state.device, state.staging.graphics_pool, NULL);
+    vmaDestroyBuffer(state.allocator, state.staging.buffer, state.staging.allocation);
+}
+
 void rhi_init()
 {
     memset(&state, 0, sizeof(vk_state));
@@ -570,18 +1228,42 @@ void rhi_init()
     
     rhi_make_instance();
     aurora_platform_create_vk_surface(state.instance, &state.surface);
+    state.headless = state.surface == VK_NULL_HANDLE;
     rhi_make_physical_device();
     rhi_make_device();
-    rhi_make_swapchain();
+    if (!state.headless)
+        rhi_make_swapchain();
     rhi_make_sync();
     rhi_make_cmd();
     rhi_make_allocator();
     rhi_make_descriptors();
+    rhi_make_staging();
+    rhi_make_pipeline_cache();
+    if (state.headless)
+        rhi_make_offscreen_targets();
+}
+
+void rhi_force_vertex_pipeline()
+{
+    s_force_vertex_pipeline = 1;
+}
+
+b32 rhi_has_mesh_shaders()
+{
+    return state.mesh_shaders;
+}
+
+b32 rhi_has_draw_indirect_count()
+{
+    return state.draw_indirect_count;
 }
 
 void rhi_begin()
 {
-    vkAcquireNextImageKHR(state.device, state.swap_chain, UINT32_MAX, state.image_available_semaphore, VK_NULL_HANDLE, (u32*)&state.image_index);
+    if (state.headless)
+        state.image_index = state.frame_index % FRAMES_IN_FLIGHT;
+    else
+        vkAcquireNextImageKHR(state.device, state.swap_chain, UINT32_MAX, state.image_available_semaphore, VK_NULL_HANDLE, (u32*)&state.image_index);
 
     RHI_CommandBuffer* cmd_buf = &state.swap_chain_cmd_bufs[state.image_index];
 
@@ -596,20 +1278,50 @@ void rhi_end()
 {
     RHI_CommandBuffer cmd_buf = state.swap_chain_cmd_bufs[state.image_index];
     rhi_end_cmd_buf(&cmd_buf);
+    rhi_flush_descriptor_writes();
+
+    // Uploads recorded since the last flush may be used by this frame, anything flushed
+    // earlier is only waited on if someone asked for it through rhi_wait_upload_gpu
+    if (state.staging.batches[state.staging.current].recording)
+        rhi_wait_upload_gpu(rhi_flush_uploads());
 
     VkSubmitInfo submit_info = { 0 };
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-    VkSemaphore wait_semaphores[] = { state.image_available_semaphore };
-    VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-    submit_info.waitSemaphoreCount = 1;
+    VkSemaphore wait_semaphores[2] = { 0 };
+    VkPipelineStageFlags wait_stages[2] = { 0 };
+    uint64_t wait_values[2] = { 0 };
+    u32 wait_count = 0;
+
+    // Nothing to acquire or present offscreen, the frame fence alone paces the CPU
+    if (!state.headless)
+    {
+        wait_semaphores[wait_count] = state.image_available_semaphore;
+        wait_stages[wait_count++] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    }
+
+    if (state.staging.frame_wait > 0)
+    {
+        wait_semaphores[wait_count] = state.staging.timeline;
+        wait_values[wait_count] = state.staging.frame_wait;
+        wait_stages[wait_count++] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        state.staging.frame_wait = 0;
+    }
+
+    VkTimelineSemaphoreSubmitInfo timeline_info = { 0 };
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.waitSemaphoreValueCount = wait_count;
+    timeline_info.pWaitSemaphoreValues = wait_values;
+
+    submit_info.pNext = &timeline_info;
+    submit_info.waitSemaphoreCount = wait_count;
     submit_info.pWaitSemaphores = wait_semaphores;
     submit_info.pWaitDstStageMask = wait_stages;
     submit_info.commandBufferCount = 1;
     submit_info.pCommandBuffers = &cmd_buf.buf;
 
     VkSemaphore signal_semaphores[] = { state.image_rendered_semaphore };
-    submit_info.signalSemaphoreCount = 1;
+    submit_info.signalSemaphoreCount = state.headless ? 0 : 1;
     submit_info.pSignalSemaphores = signal_semaphores;
 
     vkResetFences(state.device, 1, &state.swap_chain_fences[state.image_index]);
@@ -620,6 +1332,10 @@ void rhi_end()
 
 void rhi_present()
 {
+    state.frame_index++;
+    if (state.headless)
+        return;
+
     VkSemaphore signal_semaphores[] = { state.image_rendered_semaphore };
     VkPresentInfoKHR present_info = { 0 };
     present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -641,6 +1357,10 @@ void rhi_shutdown()
     vkDestroyDescriptorSetLayout(state.device, state.sampler_heap_layout, NULL);
     vkDestroyDescriptorSetLayout(state.device, state.image_heap_layout, NULL);
     vkDestroyDescriptorPool(state.device, state.descriptor_pool, NULL);
+    rhi_free_staging();
+    rhi_free_pipeline_cache();
+    if (state.headless)
+        rhi_free_offscreen_targets();
     vmaDestroyAllocator(state.allocator);
 
     for (u32 i = 0; i < FRAMES_IN_FLIGHT; i++)
@@ -655,8 +1375,6 @@ void rhi_shutdown()
     vkDestroySwapchainKHR(state.device, state.swap_chain, NULL);
     vkDestroyCommandPool(state.device, state.compute_pool, NULL);
     vkDestroyFence(state.device, state.compute_fence, NULL);
-    vkDestroyCommandPool(state.device, state.upload_pool, NULL);
-    vkDestroyFence(state.device, state.upload_fence, NULL);
     vkDestroyCommandPool(state.device, state.graphics_pool, NULL);
     vkDestroyDevice(state.device, NULL);
     vkDestroySurfaceKHR(state.instance, state.surface, NULL);
@@ -675,12 +1393,20 @@ void rhi_resize()
     
         rhi_make_swapchain();
     }
+    else if (state.headless)
+    {
+        rhi_free_offscreen_targets();
+        rhi_make_offscreen_targets();
+    }
 }
 
 void rhi_wait_idle()
 {
     if (state.device)
+    {
+        rhi_wait_uploads();
         vkDeviceWaitIdle(state.device);
+    }
 }
 
 RHI_Image* rhi_get_swapchain_image()
@@ -688,11 +1414,21 @@ RHI_Image* rhi_get_swapchain_image()
     return &state.rhi_swap_chain[state.image_index];
 }
 
+u32 rhi_get_swapchain_final_layout()
+{
+    return state.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+}
+
 RHI_CommandBuffer* rhi_get_swapchain_cmd_buf()
 {
     return &state.swap_chain_cmd_bufs[state.image_index];
 }
 
+u32 rhi_get_frame_slot()
+{
+    return (u32)state.image_index;
+}
+
 RHI_DescriptorSetLayout* rhi_get_image_heap_set_layout()
 {
     return &state.rhi_image_heap;
@@ -706,7 +1442,7 @@ RHI_DescriptorSetLayout* rhi_get_sampler_heap_set_layout()
 void rhi_init_descriptor_set_layout(RHI_DescriptorSetLayout* layout)
 {
     VkDescriptorSetLayoutBinding bindings[32] = {0};
-    for (i32 i = 0; i < layout->descriptor_count; i++)
+    for (u32 i = 0; i < layout->descriptor_count; i++)
     {
         bindings[i].binding = i;
         bindings[i].descriptorCount = 1;
@@ -742,121 +1478,117 @@ void rhi_init_descriptor_set(RHI_DescriptorSet* set, RHI_DescriptorSetLayout* la
 
 void rhi_free_descriptor_set(RHI_DescriptorSet* set)
 {
+    rhi_flush_descriptor_writes();
     vkFreeDescriptorSets(state.device, state.descriptor_pool, 1, &set->set);
 }
 
-void rhi_descriptor_set_write_sampler(RHI_DescriptorSet* set, RHI_Sampler* sampler, i32 binding)
+void rhi_begin_descriptor_writes()
+{
+    state.descriptor_writes.depth++;
+}
+
+void rhi_end_descriptor_writes()
 {
-    VkDescriptorImageInfo image_info = {0};
-    image_info.imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    image_info.imageView = VK_NULL_HANDLE;
-    image_info.sampler = sampler->sampler;
+    assert(state.descriptor_writes.depth > 0);
+    if (--state.descriptor_writes.depth == 0)
+        rhi_flush_descriptor_writes();
+}
 
-    VkWriteDescriptorSet write = {0};
-    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write.dstSet = set->set;
-    write.dstBinding = binding;
-    write.descriptorCount = 1;
-    write.dstArrayElement = 0;
-    write.pImageInfo = &image_info;
-    write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+// Each write owns the info at its own index, so the pointers stay valid until the flush
+internal VkWriteDescriptorSet* rhi_queue_descriptor_write(VkDescriptorSet set, u32 binding, u32 element, VkDescriptorType type)
+{
+    if (state.descriptor_writes.count == DESCRIPTOR_WRITE_BATCH_SIZE)
+        rhi_flush_descriptor_writes();
 
-    vkUpdateDescriptorSets(state.device, 1, &write, 0, NULL);
+    u32 index = state.descriptor_writes.count++;
+    VkWriteDescriptorSet* write = &state.descriptor_writes.writes[index];
+    memset(write, 0, sizeof(VkWriteDescriptorSet));
+    write->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write->dstSet = set;
+    write->dstBinding = binding;
+    write->dstArrayElement = element;
+    write->descriptorCount = 1;
+    write->descriptorType = type;
+    return write;
 }
 
-void rhi_descriptor_set_write_buffer(RHI_DescriptorSet* set, RHI_Buffer* buffer, i32 size, i32 binding)
+internal void rhi_queue_image_write(VkDescriptorSet set, u32 binding, u32 element, VkDescriptorType type, VkImageView view, VkImageLayout layout, VkSampler sampler)
 {
-    VkDescriptorBufferInfo buffer_info = {0};
-    buffer_info.buffer = buffer->buffer;
-    buffer_info.offset = 0;
-    buffer_info.range = size;
+    VkWriteDescriptorSet* write = rhi_queue_descriptor_write(set, binding, element, type);
 
-    VkWriteDescriptorSet write = {0};
-    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write.dstSet = set->set;
-    write.dstBinding = binding;
-    write.descriptorCount = 1;
-    write.dstArrayElement = 0;
-    write.pBufferInfo = &buffer_info;
-    write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    VkDescriptorImageInfo* image_info = &state.descriptor_writes.image_infos[write - state.descriptor_writes.writes];
+    image_info->imageLayout = layout;
+    image_info->imageView = view;
+    image_info->sampler = sampler;
+    write->pImageInfo = image_info;
 
-    vkUpdateDescriptorSets(state.device, 1, &write, 0, NULL);
+    // Outside of a batch every write goes out right away, like it always did
+    if (state.descriptor_writes.depth == 0)
+        rhi_flush_descriptor_writes();
 }
 
-void rhi_descriptor_set_write_storage_image(RHI_DescriptorSet* set, RHI_Image* image, RHI_Sampler* sampler, i32 binding)
+internal void rhi_queue_buffer_write(VkDescriptorSet set, u32 binding, VkDescriptorType type, VkBuffer buffer, u64 range)
 {
-    VkDescriptorImageInfo image_info = {0};
-    image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-    image_info.imageView = image->image_view;
-    image_info.sampler = sampler->sampler;
+    VkWriteDescriptorSet* write = rhi_queue_descriptor_write(set, binding, 0, type);
 
-    VkWriteDescriptorSet write = {0};
-    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write.dstSet = set->set;
-    write.dstBinding = binding;
-    write.descriptorCount = 1;
-    write.dstArrayElement = 0;
-    write.pImageInfo = &image_info;
-    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    VkDescriptorBufferInfo* buffer_info = &state.descriptor_writes.buffer_infos[write - state.descriptor_writes.writes];
+    buffer_info->buffer = buffer;
+    buffer_info->offset = 0;
+    buffer_info->range = range;
+    write->pBufferInfo = buffer_info;
 
-    vkUpdateDescriptorSets(state.device, 1, &write, 0, NULL);
+    if (state.descriptor_writes.depth == 0)
+        rhi_flush_descriptor_writes();
 }
 
-void rhi_descriptor_set_write_storage_buffer(RHI_DescriptorSet* set, RHI_Buffer* buffer, i32 size, i32 binding)
+void rhi_descriptor_set_write_sampler(RHI_DescriptorSet* set, RHI_Sampler* sampler, i32 binding)
 {
-    VkDescriptorBufferInfo buffer_info = {0};
-    buffer_info.buffer = buffer->buffer;
-    buffer_info.offset = 0;
-    buffer_info.range = size;
+    rhi_queue_image_write(set->set, binding, 0, VK_DESCRIPTOR_TYPE_SAMPLER, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED, sampler->sampler);
+}
 
-    VkWriteDescriptorSet write = {0};
-    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write.dstSet = set->set;
-    write.dstBinding = binding;
-    write.descriptorCount = 1;
-    write.dstArrayElement = 0;
-    write.pBufferInfo = &buffer_info;
-    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+void rhi_descriptor_set_write_buffer(RHI_DescriptorSet* set, RHI_Buffer* buffer, i32 size, i32 binding)
+{
+    rhi_queue_buffer_write(set->set, binding, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, buffer->buffer, size);
+}
 
-    vkUpdateDescriptorSets(state.device, 1, &write, 0, NULL);
+void rhi_descriptor_set_write_uniform_ring(RHI_DescriptorSet* set, RHI_UniformRing* ring, i32 binding)
+{
+    // Points at the first slot, the per frame offset comes in at bind time
+    VkDescriptorType type = ring->storage ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    rhi_queue_buffer_write(set->set, binding, type, ring->buffer.buffer, ring->size);
 }
 
-void rhi_descriptor_set_write_image(RHI_DescriptorSet* set, RHI_Image* image, i32 binding)
+void rhi_descriptor_set_write_storage_image(RHI_DescriptorSet* set, RHI_Image* image, RHI_Sampler* sampler, i32 binding)
 {
-    VkDescriptorImageInfo image_info = {0};
-    image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    image_info.imageView = image->image_view;
-    image_info.sampler = VK_NULL_HANDLE;
+    rhi_queue_image_write(set->set, binding, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, image->image_view, VK_IMAGE_LAYOUT_GENERAL, sampler->sampler);
+}
 
-    VkWriteDescriptorSet write = {0};
-    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write.dstSet = set->set;
-    write.dstBinding = binding;
-    write.descriptorCount = 1;
-    write.dstArrayElement = 0;
-    write.pImageInfo = &image_info;
-    write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+void rhi_descriptor_set_write_storage_buffer(RHI_DescriptorSet* set, RHI_Buffer* buffer, i32 size, i32 binding)
+{
+    rhi_queue_buffer_write(set->set, binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, buffer->buffer, size);
+}
 
-    vkUpdateDescriptorSets(state.device, 1, &write, 0, NULL);
+void rhi_descriptor_set_write_image(RHI_DescriptorSet* set, RHI_Image* image, i32 binding)
+{
+    rhi_queue_image_write(set->set, binding, 0, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, image->image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_NULL_HANDLE);
 }
 
-void rhi_descriptor_set_write_image_sampler(RHI_DescriptorSet* set, RHI_Image* image, RHI_Sampler* sampler, i32 binding)
+void rhi_descriptor_set_write_image_mip(RHI_DescriptorSet* set, RHI_Image* image, i32 mip, i32 binding)
 {
-    VkDescriptorImageInfo image_info = {0};
-    image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    image_info.imageView = image->image_view;
-    image_info.sampler = sampler->sampler;
+    // Images that get read and written by compute stay in GENERAL, a negative mip binds the whole chain
+    VkImageView view = mip < 0 || !image->mip_views ? image->image_view : image->mip_views[mip];
+    rhi_queue_image_write(set->set, binding, 0, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, view, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE);
+}
 
-    VkWriteDescriptorSet write = {0};
-    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write.dstSet = set->set;
-    write.dstBinding = binding;
-    write.descriptorCount = 1;
-    write.dstArrayElement = 0;
-    write.pImageInfo = &image_info;
-    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+void rhi_descriptor_set_write_storage_image_mip(RHI_DescriptorSet* set, RHI_Image* image, i32 mip, i32 binding)
+{
+    VkImageView view = mip < 0 || !image->mip_views ? image->image_view : image->mip_views[mip];
+    rhi_queue_image_write(set->set, binding, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, view, VK_IMAGE_LAYOUT_GENERAL, VK_NULL_HANDLE);
+}
 
-    vkUpdateDescriptorSets(state.device, 1, &write, 0, NULL);
+void rhi_descriptor_set_write_image_sampler(RHI_DescriptorSet* set, RHI_Image* image, RHI_Sampler* sampler, i32 binding)
+{
+    rhi_queue_image_write(set->set, binding, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, image->image_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, sampler->sampler);
 }
 
 void rhi_init_sampler(RHI_Sampler* sampler, u32 mips)
@@ -971,7 +1703,7 @@ void rhi_init_graphics_pipeline(RHI_Pipeline* pipeline, RHI_PipelineDescriptor*
 
         attribute_descriptions = malloc(sizeof(VkVertexInputAttributeDescription) * vs_input_var_count);
 
-        for (i32 location = 0; location < vs_input_var_count; location++)
+        for (u32 location = 0; location < vs_input_var_count; location++)
         {
             for (u32 i = 0; i < vs_input_var_count; i++)
             {
@@ -1098,7 +1830,7 @@ void rhi_init_graphics_pipeline(RHI_Pipeline* pipeline, RHI_PipelineDescriptor*
     if (descriptor->set_layout_count > 0)
     {
         VkDescriptorSetLayout layouts[16];
-        for (i32 i = 0; i < descriptor->set_layout_count; i++)
+        for (u32 i = 0; i < descriptor->set_layout_count; i++)
             layouts[i] = descriptor->set_layouts[i]->layout;
 
         pipeline_layout_info.setLayoutCount = descriptor->set_layout_count;
@@ -1122,7 +1854,8 @@ void rhi_init_graphics_pipeline(RHI_Pipeline* pipeline, RHI_PipelineDescriptor*
     rendering_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
     rendering_create_info.colorAttachmentCount = descriptor->color_attachment_count;
     rendering_create_info.depthAttachmentFormat = descriptor->depth_attachment_format;
-    rendering_create_info.stencilAttachmentFormat = descriptor->depth_attachment_format;
+    if (vk_get_image_aspect(descriptor->depth_attachment_format) & VK_IMAGE_ASPECT_STENCIL_BIT)
+        rendering_create_info.stencilAttachmentFormat = descriptor->depth_attachment_format;
     rendering_create_info.pColorAttachmentFormats = (VkFormat*)descriptor->color_attachments_formats;
     rendering_create_info.pNext = VK_NULL_HANDLE;
 
@@ -1147,8 +1880,16 @@ void rhi_init_graphics_pipeline(RHI_Pipeline* pipeline, RHI_PipelineDescriptor*
     pipeline_info.pVertexInputState = &vertex_input_state_info;
     pipeline_info.pInputAssemblyState = &input_assembly;
 
-    res = vkCreateGraphicsPipelines(state.device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &pipeline->pipeline);
+    VkPipelineCreationFeedback feedback = { 0 };
+    VkPipelineCreationFeedbackCreateInfo feedback_info = { 0 };
+    feedback_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+    feedback_info.pPipelineCreationFeedback = &feedback;
+    rendering_create_info.pNext = &feedback_info;
+
+    f32 start = aurora_platform_get_time();
+    res = vkCreateGraphicsPipelines(state.device, state.pipeline_cache, 1, &pipeline_info, NULL, &pipeline->pipeline);
     vk_check(res);
+    rhi_record_pipeline_creation(&feedback, start);
 
     free(states);
 }
@@ -1163,7 +1904,7 @@ void rhi_init_compute_pipeline(RHI_Pipeline* pipeline, RHI_PipelineDescriptor* d
     if (descriptor->set_layout_count > 0)
     {
         VkDescriptorSetLayout layouts[16];
-        for (i32 i = 0; i < descriptor->set_layout_count; i++)
+        for (u32 i = 0; i < descriptor->set_layout_count; i++)
             layouts[i] = descriptor->set_layouts[i]->layout;
 
         pipeline_layout_info.setLayoutCount = descriptor->set_layout_count;
@@ -1183,15 +1924,23 @@ void rhi_init_compute_pipeline(RHI_Pipeline* pipeline, RHI_PipelineDescriptor* d
     VkResult res = vkCreatePipelineLayout(state.device, &pipeline_layout_info, NULL, &pipeline->pipeline_layout);
     vk_check(res);
 
-    VkComputePipelineCreateInfo info = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+    VkComputePipelineCreateInfo info = { .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
     info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
     info.stage.module = descriptor->shaders.cs->shader_module;
     info.stage.pName = "main";
     info.layout = pipeline->pipeline_layout;
 
-    res = vkCreateComputePipelines(state.device, VK_NULL_HANDLE, 1, &info, NULL, &pipeline->pipeline);
+    VkPipelineCreationFeedback feedback = { 0 };
+    VkPipelineCreationFeedbackCreateInfo feedback_info = { 0 };
+    feedback_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+    feedback_info.pPipelineCreationFeedback = &feedback;
+    info.pNext = &feedback_info;
+
+    f32 start = aurora_platform_get_time();
+    res = vkCreateComputePipelines(state.device, state.pipeline_cache, 1, &info, NULL, &pipeline->pipeline);
     vk_check(res);
+    rhi_record_pipeline_creation(&feedback, start);
 }
 
 void rhi_free_pipeline(RHI_Pipeline* pipeline)
@@ -1211,6 +1960,13 @@ void rhi_allocate_buffer(RHI_Buffer* buffer, u64 size, u32 buffer_usage)
     VmaAllocationCreateInfo allocation_create_info = {0};
     allocation_create_info.usage = vk_get_memory_usage(buffer_create_info.usage);
 
+    // Device local buffers are filled through the staging ring
+    if (allocation_create_info.usage == VMA_MEMORY_USAGE_GPU_ONLY)
+        buffer_create_info.usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+    buffer->usage = buffer_create_info.usage;
+    buffer->memory_usage = allocation_create_info.usage;
+
     VkResult result = vmaCreateBuffer(state.allocator, &buffer_create_info, &allocation_create_info, &buffer->buffer, &buffer->allocation, NULL);
     vk_check(result);
 }
@@ -1222,13 +1978,118 @@ void rhi_free_buffer(RHI_Buffer* buffer)
 
 void rhi_upload_buffer(RHI_Buffer* buffer, void* data, u64 size)
 {
-    void* buf = NULL;
-    vk_check(vmaMapMemory(state.allocator, buffer->allocation, &buf));
-    memcpy(buf, data, size);
+    rhi_upload_buffer_range(buffer, data, 0, size);
+}
+
+void rhi_upload_buffer_range(RHI_Buffer* buffer, void* data, u64 offset, u64 size)
+{
+    if (buffer->memory_usage == VMA_MEMORY_USAGE_GPU_ONLY)
+    {
+        VkBuffer staging_buffer;
+        u64 staging_offset;
+        u8* dst = rhi_staging_alloc(size, &staging_buffer, &staging_offset);
+        memcpy(dst, data, size);
+
+        vk_staging_batch* batch = rhi_staging_begin();
+
+        VkBufferCopy region = { 0 };
+        region.srcOffset = staging_offset;
+        region.dstOffset = offset;
+        region.size = size;
+        vkCmdCopyBuffer(batch->cmd, staging_buffer, buffer->buffer, 1, &region);
+        rhi_staging_buffer_barrier(batch, buffer->buffer, offset, size);
+        return;
+    }
+
+    u8* buf = NULL;
+    vk_check(vmaMapMemory(state.allocator, buffer->allocation, (void**)&buf));
+    memcpy(buf + offset, data, size);
     vmaUnmapMemory(state.allocator, buffer->allocation);
 }
 
+internal void rhi_allocate_ring(RHI_UniformRing* ring, u64 size, u64 alignment, VkBufferUsageFlags usage)
+{
+    if (alignment == 0)
+        alignment = 1;
+
+    ring->size = size;
+    ring->stride = (size + alignment - 1) & ~(alignment - 1);
+
+    VkBufferCreateInfo buffer_create_info = {0};
+    buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_create_info.size = ring->stride * FRAMES_IN_FLIGHT;
+    buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    buffer_create_info.usage = usage;
+
+    VmaAllocationCreateInfo allocation_create_info = {0};
+    allocation_create_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+    allocation_create_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    ring->buffer.usage = buffer_create_info.usage;
+    ring->buffer.memory_usage = allocation_create_info.usage;
+
+    VmaAllocationInfo allocation_info;
+    VkResult result = vmaCreateBuffer(state.allocator, &buffer_create_info, &allocation_create_info, &ring->buffer.buffer, &ring->buffer.allocation, &allocation_info);
+    vk_check(result);
+
+    ring->mapped = (u8*)allocation_info.pMappedData;
+    memset(ring->mapped, 0, ring->stride * FRAMES_IN_FLIGHT);
+}
+
+void rhi_allocate_uniform_ring(RHI_UniformRing* ring, u64 size)
+{
+    ring->storage = 0;
+    rhi_allocate_ring(ring, size, state.physical_device_properties_2.properties.limits.minUniformBufferOffsetAlignment, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+}
+
+void rhi_allocate_storage_ring(RHI_UniformRing* ring, u64 size)
+{
+    ring->storage = 1;
+    rhi_allocate_ring(ring, size, state.physical_device_properties_2.properties.limits.minStorageBufferOffsetAlignment, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+}
+
+void rhi_free_uniform_ring(RHI_UniformRing* ring)
+{
+    rhi_free_buffer(&ring->buffer);
+    ring->mapped = NULL;
+}
+
+void rhi_upload_uniform_ring(RHI_UniformRing* ring, void* data, u64 size)
+{
+    rhi_upload_uniform_ring_range(ring, data, 0, size);
+}
+
+void rhi_read_uniform_ring(RHI_UniformRing* ring, void* data, u64 size)
+{
+    assert(size <= ring->size);
+
+    // Same guarantee as the uploads, whatever the GPU wrote into this slot has landed
+    u64 src = rhi_uniform_ring_offset(ring);
+    vmaInvalidateAllocation(state.allocator, ring->buffer.allocation, src, size);
+    memcpy(data, ring->mapped + src, size);
+}
+
+void rhi_upload_uniform_ring_range(RHI_UniformRing* ring, void* data, u64 offset, u64 size)
+{
+    assert(offset + size <= ring->size);
+
+    // rhi_begin waited on this frame's fence, so nothing on the GPU is reading the slot anymore
+    u64 dst = rhi_uniform_ring_offset(ring) + offset;
+    memcpy(ring->mapped + dst, data, size);
+    vmaFlushAllocation(state.allocator, ring->buffer.allocation, dst, size);
+}
+
+u32 rhi_uniform_ring_offset(RHI_UniformRing* ring)
+{
+    return (u32)(ring->stride * rhi_get_frame_slot());
+}
+
 void rhi_allocate_image(RHI_Image* image, i32 width, i32 height, VkFormat format, u32 usage, u32 target_layout)
+{
+    rhi_allocate_image_mips(image, width, height, format, usage, target_layout, 1);
+}
+
+void rhi_allocate_image_mips(RHI_Image* image, i32 width, i32 height, VkFormat format, u32 usage, u32 target_layout, u32 mip_levels)
 {
     image->width = width;
     image->height = height;
@@ -1237,7 +2098,8 @@ void rhi_allocate_image(RHI_Image* image, i32 width, i32 height, VkFormat format
     image->usage = usage;
     image->extent.width = width;
     image->extent.height = height;
-    image->mip_levels = 1;
+    image->mip_levels = mip_levels;
+    image->mip_views = NULL;
 
     VkImageCreateInfo image_create_info = { 0 };
     image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1278,12 +2140,24 @@ void rhi_allocate_image(RHI_Image* image, i32 width, i32 height, VkFormat format
     res = vkCreateImageView(state.device, &view_info, NULL, &image->image_view);
     vk_check(res);
 
+    // One view per level so compute passes can read one mip while writing the next
+    if (mip_levels > 1)
+    {
+        image->mip_views = malloc(sizeof(VkImageView) * mip_levels);
+        view_info.subresourceRange.levelCount = 1;
+        for (u32 i = 0; i < mip_levels; i++)
+        {
+            view_info.subresourceRange.baseMipLevel = i;
+            res = vkCreateImageView(state.device, &view_info, NULL, &image->mip_views[i]);
+            vk_check(res);
+        }
+    }
+
+    // Goes out with the next upload flush, before any frame or immediate submit that could use it
     RHI_CommandBuffer temp;
-    rhi_init_upload_cmd_buf(&temp);
-    rhi_begin_cmd_buf(&temp);
+    temp.buf = rhi_staging_graphics_cmd(rhi_staging_begin());
+    temp.command_buffer_type = COMMAND_BUFFER_UPLOAD;
     rhi_cmd_img_transition_layout(&temp, image, 0, 0, VK_IMAGE_LAYOUT_UNDEFINED, target_layout, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, 0);
-    rhi_end_cmd_buf(&temp);
-    rhi_submit_upload_cmd_buf(&temp);
 }
 
 void rhi_allocate_cubemap(RHI_Image* image, i32 width, i32 height, VkFormat format, u32 usage, u32 target_layout)
@@ -1296,6 +2170,7 @@ void rhi_allocate_cubemap(RHI_Image* image, i32 width, i32 height, VkFormat form
     image->extent.width = width;
     image->extent.height = height;
     image->mip_levels = 1;
+    image->mip_views = NULL;
 
     VkImageCreateInfo image_create_info = { 0 };
     image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1337,21 +2212,15 @@ void rhi_allocate_cubemap(RHI_Image* image, i32 width, i32 height, VkFormat form
     res = vkCreateImageView(state.device, &view_info, NULL, &image->image_view);
     vk_check(res);
 
+    // Goes out with the next upload flush, before any frame or immediate submit that could use it
     RHI_CommandBuffer temp;
-    rhi_init_upload_cmd_buf(&temp);
-    rhi_begin_cmd_buf(&temp);
+    temp.buf = rhi_staging_graphics_cmd(rhi_staging_begin());
+    temp.command_buffer_type = COMMAND_BUFFER_UPLOAD;
     rhi_cmd_img_transition_layout(&temp, image, 0, 0, VK_IMAGE_LAYOUT_UNDEFINED, target_layout, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, 0);
-    rhi_end_cmd_buf(&temp);
-    rhi_submit_upload_cmd_buf(&temp);
 }
 
-void rhi_generate_mipmaps(RHI_Image* image)
+internal void rhi_record_mipmaps(VkCommandBuffer cmd, RHI_Image* image)
 {
-    RHI_CommandBuffer cmd_buf;
-    rhi_init_cmd_buf(&cmd_buf, COMMAND_BUFFER_GRAPHICS);
-
-    rhi_begin_cmd_buf(&cmd_buf);
-
     VkImageMemoryBarrier barrier;
     memset(&barrier, 0, sizeof(barrier));
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -1374,7 +2243,7 @@ void rhi_generate_mipmaps(RHI_Image* image)
         barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
         barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 
-        vkCmdPipelineBarrier(cmd_buf.buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
 
         VkImageBlit blit;
         memset(&blit, 0, sizeof(blit));
@@ -1399,14 +2268,14 @@ void rhi_generate_mipmaps(RHI_Image* image)
         blit.dstSubresource.baseArrayLayer = 0;
         blit.dstSubresource.layerCount = 1;
 
-        vkCmdBlitImage(cmd_buf.buf, image->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+        vkCmdBlitImage(cmd, image->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
 
         barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
         barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
         barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
         barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
-        vkCmdPipelineBarrier(cmd_buf.buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
 
         if (mip_width > 1) mip_width /= 2;
         if (mip_height > 1) mip_height /= 2;
@@ -1418,25 +2287,37 @@ void rhi_generate_mipmaps(RHI_Image* image)
     barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
     barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
-    vkCmdPipelineBarrier(cmd_buf.buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+void rhi_generate_mipmaps(RHI_Image* image)
+{
+    RHI_CommandBuffer cmd_buf;
+    rhi_init_cmd_buf(&cmd_buf, COMMAND_BUFFER_GRAPHICS);
 
+    rhi_begin_cmd_buf(&cmd_buf);
+    rhi_record_mipmaps(cmd_buf.buf, image);
     rhi_submit_cmd_buf(&cmd_buf);
 }
 
 void rhi_load_raw_image(RHI_RawImage* image, const char* path)
 {
-    u32 channels;
-    image->data = stbi_load(path, &image->width, &image->height, &channels, STBI_rgb_alpha);
+    i32 width, height, channels;
+    image->data = stbi_load(path, &width, &height, &channels, STBI_rgb_alpha);
     //assert(image->data);
+    image->width = width;
+    image->height = height;
     image->data_size = image->width * image->height * 4;
     image->format = VK_FORMAT_R8G8B8A8_UNORM;
 }
 
 void rhi_load_raw_hdr_image(RHI_RawImage* image, const char* path)
 {
-    u32 channels;
-    image->data = stbi_load_16(path, &image->width, &image->height, &channels, STBI_rgb_alpha);
+    i32 width, height, channels;
+    image->data = stbi_load_16(path, &width, &height, &channels, STBI_rgb_alpha);
     assert(image->data);
+    image->width = width;
+    image->height = height;
     image->data_size = image->width * image->height * 4 * sizeof(u16);
     image->format = VK_FORMAT_R16G16B16A16_UNORM;
 }
@@ -1456,6 +2337,7 @@ void rhi_upload_image(RHI_Image* image, RHI_RawImage* raw_image, b32 gen_mips)
     image->usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
     image->image_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
     image->mip_levels = gen_mips == 1 ? (u32)(floor(log2(max(image->width, image->height))) + 1) : 1;
+    image->mip_views = NULL;
     
     VkImageCreateInfo image_create_info = { 0 };
     image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1478,27 +2360,13 @@ void rhi_upload_image(RHI_Image* image, RHI_RawImage* raw_image, b32 gen_mips)
     VkResult res = vmaCreateImage(state.allocator, &image_create_info, &allocation, &image->image, &image->allocation, NULL);
     vk_check(res);
 
-    VkBuffer staging_buffer = VK_NULL_HANDLE;
-    VmaAllocation staging_buffer_allocation = VK_NULL_HANDLE;
-    VmaAllocationInfo staging_buffer_allocation_info = {0};
-
-    VkBufferCreateInfo staging_buffer_info = { 0 };
-    staging_buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    staging_buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    staging_buffer_info.size = raw_image->data_size;
-
-    VmaAllocationCreateInfo staging_buffer_alloc_info = { 0 };
-    staging_buffer_alloc_info.usage = VMA_MEMORY_USAGE_CPU_ONLY;
-
-    res = vmaCreateBuffer(state.allocator, &staging_buffer_info, &staging_buffer_alloc_info, &staging_buffer, &staging_buffer_allocation, NULL);
-    vk_check(res);
-
-    void* upload_data;
-    vmaMapMemory(state.allocator, staging_buffer_allocation, &upload_data);
+    VkBuffer staging_buffer;
+    u64 staging_offset;
+    u8* upload_data = rhi_staging_alloc(raw_image->data_size, &staging_buffer, &staging_offset);
     memcpy(upload_data, raw_image->data, raw_image->data_size);
-    vmaUnmapMemory(state.allocator, staging_buffer_allocation);
 
     VkBufferImageCopy image_copy_region = {0};
+    image_copy_region.bufferOffset = staging_offset;
     image_copy_region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     image_copy_region.imageSubresource.mipLevel = 0;
     image_copy_region.imageSubresource.baseArrayLayer = 0;
@@ -1507,16 +2375,22 @@ void rhi_upload_image(RHI_Image* image, RHI_RawImage* raw_image, b32 gen_mips)
     image_copy_region.imageExtent.height = image->height;
     image_copy_region.imageExtent.depth = 1;
 
+    // Recorded into the current staging batch, nothing is submitted until the next flush
+    vk_staging_batch* batch = rhi_staging_begin();
     RHI_CommandBuffer temp;
-    rhi_init_upload_cmd_buf(&temp);
-    rhi_begin_cmd_buf(&temp);
+    temp.buf = batch->cmd;
+    temp.command_buffer_type = COMMAND_BUFFER_UPLOAD;
+
     rhi_cmd_img_transition_layout(&temp, image, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0);
     vkCmdCopyBufferToImage(temp.buf, staging_buffer, image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &image_copy_region);
-    if (!gen_mips) rhi_cmd_img_transition_layout(&temp, image, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0);
-    rhi_end_cmd_buf(&temp);
-    rhi_submit_upload_cmd_buf(&temp);
 
-    vmaDestroyBuffer(state.allocator, staging_buffer, staging_buffer_allocation);
+    // Blits and shader read layouts need the graphics queue
+    rhi_staging_image_ownership(batch, image);
+    temp.buf = rhi_staging_graphics_cmd(batch);
+    if (gen_mips)
+        rhi_record_mipmaps(temp.buf, image);
+    else
+        rhi_cmd_img_transition_layout(&temp, image, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0);
 
     VkImageViewCreateInfo view_info = { 0 };
     view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -1535,12 +2409,18 @@ void rhi_upload_image(RHI_Image* image, RHI_RawImage* raw_image, b32 gen_mips)
 
     res = vkCreateImageView(state.device, &view_info, NULL, &image->image_view);
     assert(res == VK_SUCCESS);
-
-    if (gen_mips) rhi_generate_mipmaps(image);
 }
 
 void rhi_free_image(RHI_Image* image)
 {
+    if (image->mip_views)
+    {
+        for (u32 i = 0; i < image->mip_levels; i++)
+            vkDestroyImageView(state.device, image->mip_views[i], NULL);
+        free(image->mip_views);
+        image->mip_views = NULL;
+    }
+
     vkDestroyImageView(state.device, image->image_view, NULL);
     vmaDestroyImage(state.allocator, image->image, image->allocation);
 }
@@ -1558,86 +2438,96 @@ void rhi_resize_image(RHI_Image* image, i32 width, i32 height)
 
 void rhi_init_descriptor_heap(RHI_DescriptorHeap* heap, u32 type, u32 size)
 {
+    assert(size > 0 && size <= DESCRIPTOR_HEAP_MAX_SIZE);
+
     memset(heap, 0, sizeof(RHI_DescriptorHeap));
-    heap->heap_handle = malloc(sizeof(b32) * size);
-    memset(heap->heap_handle, 0, sizeof(b32) * size);
     heap->type = type;
     heap->used = 0;
     heap->size = size;
+    heap->free_slots = malloc(sizeof(u32) * size);
+    heap->allocated = calloc((size + 31) / 32, sizeof(u32));
+
+    // Pushed in reverse so the lowest slots are handed out first
+    for (u32 i = 0; i < size; i++)
+        heap->free_slots[i] = size - 1 - i;
+    heap->free_count = size;
+
+    // The layout is sized for the largest heap, only allocate what this one needs
+    VkDescriptorSetVariableDescriptorCountAllocateInfo variable_info = {0};
+    variable_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
+    variable_info.descriptorSetCount = 1;
+    variable_info.pDescriptorCounts = &size;
 
     VkDescriptorSetAllocateInfo descriptor_set_info = {0};
     descriptor_set_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     descriptor_set_info.descriptorSetCount = 1;
     descriptor_set_info.descriptorPool = state.descriptor_pool;
     descriptor_set_info.pSetLayouts = type == DESCRIPTOR_HEAP_IMAGE ? &state.image_heap_layout : &state.sampler_heap_layout;
+    descriptor_set_info.pNext = &variable_info;
 
     VkResult res = vkAllocateDescriptorSets(state.device, &descriptor_set_info, &heap->set);
     vk_check(res);
 }
 
-i32 rhi_find_available_descriptor(RHI_DescriptorHeap* heap)
+void rhi_reserve_descriptors(RHI_DescriptorHeap* heap, u32 first, u32 count)
 {
-    for (i32 i = 0; i < heap->size; i++)
+    assert(first + count <= heap->size);
+
+    // Reserved slots count as used and are never handed out, so they must not be taken already
+    for (u32 i = first; i < first + count; i++)
     {
-        if (heap->heap_handle[i] == 0)
-        {
-            heap->heap_handle[i] = 1;
-            heap->used++;
-            return i;
-        }
+        assert(!(heap->allocated[i / 32] & (1u << (i % 32))));
+        heap->allocated[i / 32] |= 1u << (i % 32);
+        heap->used++;
     }
 
-    return -1;
+    // Rare and done up front, just rebuild the free list without the reserved slots
+    heap->free_count = 0;
+    for (u32 i = heap->size; i > 0; i--)
+    {
+        u32 slot = i - 1;
+        if (!(heap->allocated[slot / 32] & (1u << (slot % 32))))
+            heap->free_slots[heap->free_count++] = slot;
+    }
 }
 
-void rhi_push_descriptor_heap_image(RHI_DescriptorHeap* heap, RHI_Image* image, i32 binding)
+i32 rhi_find_available_descriptor(RHI_DescriptorHeap* heap)
 {
-    VkDescriptorImageInfo image_info = {0};
-    image_info.imageLayout = image->image_layout;
-    image_info.imageView = image->image_view;
-    image_info.sampler = VK_NULL_HANDLE;
+    if (heap->free_count == 0)
+        return -1;
 
-    VkWriteDescriptorSet write = {0};
-    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write.descriptorCount = 1;
-    write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
-    write.dstArrayElement = binding;
-    write.dstBinding = 0;
-    write.dstSet = heap->set;
-    write.pImageInfo = &image_info;
+    u32 slot = heap->free_slots[--heap->free_count];
+    heap->allocated[slot / 32] |= 1u << (slot % 32);
+    heap->used++;
+    return (i32)slot;
+}
 
-    vkUpdateDescriptorSets(state.device, 1, &write, 0, NULL);
+void rhi_push_descriptor_heap_image(RHI_DescriptorHeap* heap, RHI_Image* image, i32 binding)
+{
+    rhi_queue_image_write(heap->set, 0, binding, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, image->image_view, image->image_layout, VK_NULL_HANDLE);
 }
 
 void rhi_push_descriptor_heap_sampler(RHI_DescriptorHeap* heap, RHI_Sampler* sampler, i32 binding)
 {
-    VkDescriptorImageInfo image_info = {0};
-    image_info.imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    image_info.imageView = VK_NULL_HANDLE;
-    image_info.sampler = sampler->sampler;
-
-    VkWriteDescriptorSet write = {0};
-    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    write.descriptorCount = 1;
-    write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
-    write.dstArrayElement = binding;
-    write.dstBinding = 0;
-    write.dstSet = heap->set;
-    write.pImageInfo = &image_info;
-
-    vkUpdateDescriptorSets(state.device, 1, &write, 0, NULL);
+    rhi_queue_image_write(heap->set, 0, binding, VK_DESCRIPTOR_TYPE_SAMPLER, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED, sampler->sampler);
 }
 
 void rhi_free_descriptor(RHI_DescriptorHeap* heap, u32 descriptor)
 {
-    heap->heap_handle[descriptor] = 0;
+    u32 bit = 1u << (descriptor % 32);
+    assert(descriptor < heap->size && (heap->allocated[descriptor / 32] & bit));
+
+    heap->allocated[descriptor / 32] &= ~bit;
+    heap->free_slots[heap->free_count++] = descriptor;
     heap->used--;
 }
 
 void rhi_free_descriptor_heap(RHI_DescriptorHeap* heap)
 {
+    rhi_flush_descriptor_writes();
     vkFreeDescriptorSets(state.device, state.descriptor_pool, 1, &heap->set);
-    free(heap->heap_handle);
+    free(heap->free_slots);
+    free(heap->allocated);
 }
 
 void rhi_init_cmd_buf(RHI_CommandBuffer* buf, u32 command_buffer_type)
@@ -1659,28 +2549,28 @@ void rhi_free_cmd_buf(RHI_CommandBuffer* buf)
     vkFreeCommandBuffers(state.device, buf->command_buffer_type == COMMAND_BUFFER_GRAPHICS ? state.graphics_pool : state.compute_pool, 1, &buf->buf);
 }
 
-void rhi_init_upload_cmd_buf(RHI_CommandBuffer* buf)
-{   
-    buf->command_buffer_type = COMMAND_BUFFER_UPLOAD;
-
-    VkCommandBufferAllocateInfo alloc_info = {0};
-    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    alloc_info.commandPool = state.upload_pool;
-    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    alloc_info.commandBufferCount = 1;
-
-    VkResult result = vkAllocateCommandBuffers(state.device, &alloc_info, &buf->buf);
-    vk_check(result);
-}
-
 void rhi_submit_cmd_buf(RHI_CommandBuffer* buf)
 {   
     rhi_end_cmd_buf(buf);
+    rhi_flush_descriptor_writes();
+
+    // Immediate submits usually consume what was just uploaded, wait for it on the GPU
+    RHI_UploadTicket upload_ticket = rhi_flush_uploads();
+    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    VkTimelineSemaphoreSubmitInfo timeline_info = { 0 };
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.waitSemaphoreValueCount = 1;
+    timeline_info.pWaitSemaphoreValues = &upload_ticket;
 
     VkQueue submit_queue = buf->command_buffer_type == COMMAND_BUFFER_GRAPHICS ? state.graphics_queue : state.compute_queue;
 
     VkSubmitInfo submit_info = { 0 };
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
+    submit_info.waitSemaphoreCount = 1;
+    submit_info.pWaitSemaphores = &state.staging.timeline;
+    submit_info.pWaitDstStageMask = &wait_stage;
     submit_info.commandBufferCount = 1;
     submit_info.pCommandBuffers = &buf->buf;
 
@@ -1698,19 +2588,6 @@ void rhi_submit_cmd_buf(RHI_CommandBuffer* buf)
     }
 }
 
-void rhi_submit_upload_cmd_buf(RHI_CommandBuffer* buf)
-{
-    VkSubmitInfo submit_info = { 0 };
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &buf->buf;
-
-    vkQueueSubmit(state.graphics_queue, 1, &submit_info, state.upload_fence);
-    vkWaitForFences(state.device, 1, &state.upload_fence, VK_TRUE, INT_MAX);
-    vkResetFences(state.device, 1, &state.upload_fence);
-    vkResetCommandPool(state.device, state.upload_pool, 0);
-}
-
 void rhi_begin_cmd_buf(RHI_CommandBuffer* buf)
 {
     VkCommandBufferBeginInfo begin_info = { 0 };
@@ -1774,6 +2651,11 @@ void rhi_cmd_set_descriptor_set(RHI_CommandBuffer* buf, RHI_Pipeline* pipeline,
     vkCmdBindDescriptorSets(buf->buf, pipeline->bind_point, pipeline->pipeline_layout, binding, 1, &set->set, 0, NULL);
 }
 
+void rhi_cmd_set_dynamic_descriptor_set(RHI_CommandBuffer* buf, RHI_Pipeline* pipeline, RHI_DescriptorSet* set, i32 binding, u32* offsets, u32 offset_count)
+{
+    vkCmdBindDescriptorSets(buf->buf, pipeline->bind_point, pipeline->pipeline_layout, binding, 1, &set->set, offset_count, offsets);
+}
+
 void rhi_cmd_set_push_constants(RHI_CommandBuffer* buf, RHI_Pipeline* pipeline, void* data, u32 size)
 {
     vkCmdPushConstants(buf->buf, pipeline->pipeline_layout, VK_SHADER_STAGE_ALL, 0, size, data);
@@ -1799,11 +2681,38 @@ void rhi_cmd_draw_meshlets(RHI_CommandBuffer* buf, u32 count)
     vkCmdDrawMeshTasksNV(buf->buf, count, 0);
 }
 
+void rhi_cmd_draw_meshlets_indirect(RHI_CommandBuffer* buf, RHI_Buffer* buffer, u64 offset, u32 draw_count, u32 stride)
+{
+    vkCmdDrawMeshTasksIndirectNV(buf->buf, buffer->buffer, offset, draw_count, stride);
+}
+
+void rhi_cmd_draw_indexed_indirect(RHI_CommandBuffer* buf, RHI_Buffer* buffer, u64 offset, u32 draw_count, u32 stride)
+{
+    vkCmdDrawIndexedIndirect(buf->buf, buffer->buffer, offset, draw_count, stride);
+}
+
+void rhi_cmd_draw_meshlets_indirect_count(RHI_CommandBuffer* buf, RHI_Buffer* buffer, u64 offset, RHI_Buffer* count_buffer, u64 count_offset, u32 max_draw_count, u32 stride)
+{
+    assert(state.draw_indirect_count);
+    vkCmdDrawMeshTasksIndirectCountNV(buf->buf, buffer->buffer, offset, count_buffer->buffer, count_offset, max_draw_count, stride);
+}
+
+void rhi_cmd_draw_indexed_indirect_count(RHI_CommandBuffer* buf, RHI_Buffer* buffer, u64 offset, RHI_Buffer* count_buffer, u64 count_offset, u32 max_draw_count, u32 stride)
+{
+    assert(state.draw_indirect_count);
+    vkCmdDrawIndexedIndirectCount(buf->buf, buffer->buffer, offset, count_buffer->buffer, count_offset, max_draw_count, stride);
+}
+
 void rhi_cmd_dispatch(RHI_CommandBuffer* buf, u32 x, u32 y, u32 z)
 {
     vkCmdDispatch(buf->buf, x, y, z);
 }
 
+void rhi_cmd_fill_buffer(RHI_CommandBuffer* buf, RHI_Buffer* buffer, u64 offset, u64 size, u32 value)
+{
+    vkCmdFillBuffer(buf->buf, buffer->buffer, offset, size, value);
+}
+
 void rhi_cmd_start_render(RHI_CommandBuffer* buf, RHI_RenderBegin info)
 {
     u32 color_iterator = info.has_depth ? info.image_count - 1 : info.image_count;
@@ -1839,7 +2748,7 @@ void rhi_cmd_start_render(RHI_CommandBuffer* buf, RHI_RenderBegin info)
         color_attachment_info.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
         color_attachment_info.resolveMode = VK_RESOLVE_MODE_NONE;
         color_attachment_info.loadOp = info.read_color == 1 ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
-        color_attachment_info.storeOp = info.read_color == 1 ? VK_ATTACHMENT_STORE_OP_NONE : VK_ATTACHMENT_STORE_OP_STORE;
+        color_attachment_info.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
         color_attachment_info.clearValue = clear_value;
 
         color_attachments[i] = color_attachment_info;
@@ -1859,10 +2768,11 @@ void rhi_cmd_start_render(RHI_CommandBuffer* buf, RHI_RenderBegin info)
         depth_attachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
         depth_attachment.resolveMode = VK_RESOLVE_MODE_NONE;
         depth_attachment.loadOp = info.read_depth == 1 ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
-        depth_attachment.storeOp = info.read_depth == 1 ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
+        depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
         depth_attachment.clearValue = depth_clear_value;
 
-        rendering_info.pStencilAttachment = &depth_attachment;
+        if (vk_get_image_aspect(image->format) & VK_IMAGE_ASPECT_STENCIL_BIT)
+            rendering_info.pStencilAttachment = &depth_attachment;
         rendering_info.pDepthAttachment = &depth_attachment;
     }
 
@@ -1899,6 +2809,31 @@ void rhi_cmd_img_transition_layout(RHI_CommandBuffer* buf, RHI_Image* img, u32 s
     vkCmdPipelineBarrier(buf->buf, src_p_stage, dst_p_stage, 0, 0, NULL, 0, NULL, 1, &barrier);
 }
 
+void rhi_cmd_buffer_barrier(RHI_CommandBuffer* buf, RHI_Buffer* buffer, u32 src_access, u32 dst_access, u32 src_p_stage, u32 dst_p_stage)
+{
+    VkBufferMemoryBarrier barrier = { 0 };
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.srcAccessMask = src_access;
+    barrier.dstAccessMask = dst_access;
+    barrier.buffer = buffer->buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+
+    vkCmdPipelineBarrier(buf->buf, src_p_stage, dst_p_stage, 0, 0, NULL, 1, &barrier, 0, NULL);
+}
+
+void rhi_cmd_memory_barrier(RHI_CommandBuffer* buf, u32 src_access, u32 dst_access, u32 src_p_stage, u32 dst_p_stage)
+{
+    VkMemoryBarrier barrier = { 0 };
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = src_access;
+    barrier.dstAccessMask = dst_access;
+
+    vkCmdPipelineBarrier(buf->buf, src_p_stage, dst_p_stage, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
 void rhi_cmd_img_blit(RHI_CommandBuffer* buf, RHI_Image* src, RHI_Image* dst, u32 srcl, u32 dstl)
 {
     VkImageBlit region = { 0 };
@@ -5,7 +5,9 @@
 
 u32 vk_get_image_aspect(u32 format)
 {
-    if (format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT || format == VK_FORMAT_D32_SFLOAT_S8_UINT)
+    if (format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_D32_SFLOAT)
+        return VK_IMAGE_ASPECT_DEPTH_BIT;
+    if (format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT)
         return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
     
     return VK_IMAGE_ASPECT_COLOR_BIT;
@@ -138,6 +140,7 @@ u32 vk_get_format_size(VkFormat format)
         case VK_FORMAT_R64G64B64A64_SFLOAT: return 32;
         case VK_FORMAT_B10G11R11_UFLOAT_PACK32: return 4;
         case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32: return 4;
+        default: break;
     }
 
     return 0;
@@ -148,12 +151,18 @@ u32 vk_get_memory_usage(VkBufferUsageFlagBits flags)
     VkBufferUsageFlagBits vertex = BUFFER_VERTEX;
     VkBufferUsageFlagBits index = BUFFER_INDEX;
     VkBufferUsageFlagBits uniform = BUFFER_UNIFORM;
+    VkBufferUsageFlagBits storage = BUFFER_STORAGE;
+    VkBufferUsageFlagBits indirect = BUFFER_INDIRECT;
 
     if (flags == vertex)
-        return VMA_MEMORY_USAGE_CPU_TO_GPU;
+        return VMA_MEMORY_USAGE_GPU_ONLY;
     if (flags == index)
-        return VMA_MEMORY_USAGE_CPU_TO_GPU;
+        return VMA_MEMORY_USAGE_GPU_ONLY;
     if (flags == uniform)
         return VMA_MEMORY_USAGE_CPU_ONLY;
+    if (flags == storage)
+        return VMA_MEMORY_USAGE_GPU_ONLY;
+    if (flags == indirect)
+        return VMA_MEMORY_USAGE_GPU_ONLY;
     return 0;
 }
\ No newline at end of file
@@ -1,8 +1,8 @@
 #include "game.h"
 
-int main()
+int main(int argc, char** argv)
 {
-    game_init();
+    game_init(argc, argv);
     game_update();
     game_exit();
     return 0;
@@ -1,4 +1,5 @@
 #include "mesh.h"
+#include "simplify.h"
 
 #include <core/platform_layer.h>
 
@@ -9,6 +10,20 @@
 #include <stdio.h>
 #include <limits.h>
 #include <float.h>
+#include <stddef.h>
+#include <string.h>
+
+// How much relative bounds growth costs against one new vertex, and how far past an exhausted patch the builder looks
+#define MESHLET_BOUNDS_WEIGHT 4.0f
+#define MESHLET_SEED_WINDOW 64
+#define MESHLET_BENCHMARK_SAMPLES 32
+
+// LRU cache the triangle order is optimized for, and the FIFO cache the statistics model
+#define MESH_VERTEX_CACHE_SIZE 32
+#define MESH_FIFO_CACHE_SIZE 16
+
+// Layout of the vertex buffers that reach the GPU and the .amesh file
+#define MESH_VERTEX_STRIDE (VERTEX_QUANTIZATION_ENABLED ? sizeof(PackedVertex) : sizeof(Vertex))
 
 #define cgltf_call(call) do { cgltf_result _result = (call); assert(_result == cgltf_result_success); } while(0)
 
@@ -16,6 +31,39 @@ internal RHI_DescriptorHeap* s_image_heap;
 internal RHI_DescriptorHeap* s_sampler_heap;
 internal RHI_DescriptorSetLayout s_descriptor_set_layout;
 internal RHI_DescriptorSetLayout s_meshlet_set_layout;
+internal MeshScene s_scene;
+
+// Scene primitive table entry, the shaders add the offsets to the primitive local meshlet offsets and group ids
+typedef struct gpu_primitive gpu_primitive;
+struct gpu_primitive
+{
+    hmm_mat4 transform;
+    hmm_vec4 position_offset;
+    hmm_vec4 position_scale;
+    hmm_vec4 bounds;
+    u32 first_vertex;
+    u32 first_meshlet;
+    u32 meshlet_count;
+    u32 first_meshlet_vertex;
+    u32 first_meshlet_index;
+    u32 first_group;
+    u32 material_index;
+    u32 vertex_format;
+};
+
+// Scene material table entry
+typedef struct gpu_material gpu_material;
+struct gpu_material
+{
+    i32 albedo_idx;
+    i32 normal_idx;
+    i32 mr_idx;
+    i32 sampler_idx;
+    hmm_vec3 bc_factor;
+    f32 m_factor;
+    f32 r_factor;
+    hmm_vec3 pad;
+};
 
 typedef struct aabb aabb;
 struct aabb
@@ -24,12 +72,31 @@ struct aabb
     hmm_vec3 max;
 };
 
+// Meshlet being filled by a builder, push_meshlet packs it into the vector
+typedef struct meshlet_build meshlet_build;
+struct meshlet_build
+{
+    u32 vertices[MAX_MESHLET_VERTICES];
+    u8 indices[MAX_MESHLET_INDICES];
+    u8 vertex_count;
+    u8 triangle_count;
+};
+
+// Meshlet headers and the vertex and micro index streams they point into
 typedef struct meshlet_vector meshlet_vector;
 struct meshlet_vector
 {
     Meshlet* meshlets;
     u32 used;
     u32 size;
+
+    u32* vertices;
+    u32 vertex_count;
+    u32 vertex_capacity;
+
+    u8* indices;
+    u32 index_size;
+    u32 index_capacity;
 };
 
 void init_meshlet_vector(meshlet_vector* vec, u32 start_size)
@@ -37,37 +104,142 @@ void init_meshlet_vector(meshlet_vector* vec, u32 start_size)
     vec->meshlets = calloc(start_size, sizeof(Meshlet));
     vec->size = start_size;
     vec->used = 0;
+
+    vec->vertex_capacity = start_size * MAX_MESHLET_VERTICES;
+    vec->vertices = malloc(vec->vertex_capacity * sizeof(u32));
+    vec->vertex_count = 0;
+
+    vec->index_capacity = start_size * MAX_MESHLET_INDICES;
+    vec->indices = malloc(vec->index_capacity);
+    vec->index_size = 0;
 }
 
 void free_meshlet_vector(meshlet_vector* vec)
 {
+    free(vec->indices);
+    free(vec->vertices);
     free(vec->meshlets);
 }
 
-void push_meshlet(meshlet_vector* vec, Meshlet m)
+void push_meshlet(meshlet_vector* vec, meshlet_build* m)
 {
     if (vec->used >= vec->size)
     {
         vec->size *= 2;
         vec->meshlets = realloc(vec->meshlets, vec->size * sizeof(Meshlet));
     }
-    vec->meshlets[vec->used++] = m;
+
+    // Micro index runs are padded to 4 bytes so the mesh shader can fetch them as uints
+    u32 index_size = (m->triangle_count * 3 + 3) & ~3u;
+
+    while (vec->vertex_count + m->vertex_count > vec->vertex_capacity)
+    {
+        vec->vertex_capacity *= 2;
+        vec->vertices = realloc(vec->vertices, vec->vertex_capacity * sizeof(u32));
+    }
+    while (vec->index_size + index_size > vec->index_capacity)
+    {
+        vec->index_capacity *= 2;
+        vec->indices = realloc(vec->indices, vec->index_capacity);
+    }
+
+    Meshlet* ml = &vec->meshlets[vec->used++];
+    memset(ml, 0, sizeof(Meshlet));
+    ml->vertex_offset = vec->vertex_count;
+    ml->triangle_offset = vec->index_size;
+    ml->vertex_count = m->vertex_count;
+    ml->triangle_count = m->triangle_count;
+    ml->group = MESHLET_GROUP_NONE;
+    ml->parent_group = MESHLET_GROUP_NONE;
+
+    memcpy(vec->vertices + vec->vertex_count, m->vertices, m->vertex_count * sizeof(u32));
+    vec->vertex_count += m->vertex_count;
+
+    memset(vec->indices + vec->index_size, 0, index_size);
+    memcpy(vec->indices + vec->index_size, m->indices, m->triangle_count * 3);
+    vec->index_size += index_size;
 }
 
-void mesh_loader_init(i32 dset_layout_binding)
+void mesh_loader_init()
 {
-    s_descriptor_set_layout.descriptors[0] = DESCRIPTOR_BUFFER;
+    s_descriptor_set_layout.descriptors[0] = DESCRIPTOR_STORAGE_BUFFER;
     s_descriptor_set_layout.descriptor_count = 1;
     rhi_init_descriptor_set_layout(&s_descriptor_set_layout);
 
     s_meshlet_set_layout.descriptors[0] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
     s_meshlet_set_layout.descriptors[1] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    s_meshlet_set_layout.descriptor_count = 2;
+    s_meshlet_set_layout.descriptors[2] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    s_meshlet_set_layout.descriptors[3] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    s_meshlet_set_layout.descriptors[4] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    s_meshlet_set_layout.descriptors[5] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    s_meshlet_set_layout.descriptors[6] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    s_meshlet_set_layout.descriptors[7] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    s_meshlet_set_layout.descriptors[8] = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    s_meshlet_set_layout.descriptor_count = 9;
     rhi_init_descriptor_set_layout(&s_meshlet_set_layout);
+
+    MeshScene* scene = &s_scene;
+    memset(scene, 0, sizeof(MeshScene));
+
+    u64 vertex_size = (u64)MESH_SCENE_MAX_VERTICES * MESH_VERTEX_STRIDE;
+    u64 meshlet_size = (u64)MESH_SCENE_MAX_MESHLETS * sizeof(Meshlet);
+    u64 meshlet_vertex_size = (u64)MESH_SCENE_MAX_MESHLET_VERTICES * sizeof(u32);
+    u64 meshlet_index_size = (u64)MESH_SCENE_MAX_MESHLET_INDEX_WORDS * sizeof(u32);
+    u64 visibility_size = (u64)MESH_SCENE_MAX_MESHLETS * sizeof(u32);
+    u64 group_size = (u64)MESH_SCENE_MAX_GROUPS * sizeof(MeshletGroup);
+    u64 primitive_size = (u64)MESH_SCENE_MAX_PRIMITIVES * sizeof(gpu_primitive);
+    u64 primitive_visibility_size = (u64)MESH_SCENE_MAX_PRIMITIVES * sizeof(u32);
+    u64 material_size = (u64)MESH_SCENE_MAX_MATERIALS * sizeof(gpu_material);
+
+    // Only the fallback path expands clusters into indices
+    u64 cluster_index_size = rhi_has_mesh_shaders() ? 4 : (u64)MESH_SCENE_MAX_MESHLETS * MAX_MESHLET_INDICES * sizeof(u32);
+
+    rhi_allocate_buffer(&scene->vertex_buffer, vertex_size, BUFFER_VERTEX);
+    rhi_allocate_buffer(&scene->meshlet_buffer, meshlet_size, BUFFER_STORAGE);
+    rhi_allocate_buffer(&scene->meshlet_vertex_buffer, meshlet_vertex_size, BUFFER_STORAGE);
+    rhi_allocate_buffer(&scene->meshlet_index_buffer, meshlet_index_size, BUFFER_STORAGE);
+    rhi_allocate_buffer(&scene->visibility_buffer, visibility_size, BUFFER_STORAGE);
+    rhi_allocate_buffer(&scene->group_buffer, group_size, BUFFER_STORAGE);
+    rhi_allocate_buffer(&scene->primitive_buffer, primitive_size, BUFFER_STORAGE);
+    rhi_allocate_buffer(&scene->primitive_visibility_buffer, primitive_visibility_size, BUFFER_STORAGE);
+    rhi_allocate_buffer(&scene->cluster_index_buffer, cluster_index_size, BUFFER_INDEX);
+    rhi_allocate_buffer(&scene->material_buffer, material_size, BUFFER_STORAGE);
+
+    rhi_begin_descriptor_writes();
+
+    rhi_init_descriptor_set(&scene->geometry_descriptor_set, &s_meshlet_set_layout);
+    rhi_descriptor_set_write_storage_buffer(&scene->geometry_descriptor_set, &scene->vertex_buffer, vertex_size, 0);
+    rhi_descriptor_set_write_storage_buffer(&scene->geometry_descriptor_set, &scene->meshlet_buffer, meshlet_size, 1);
+    rhi_descriptor_set_write_storage_buffer(&scene->geometry_descriptor_set, &scene->visibility_buffer, visibility_size, 2);
+    rhi_descriptor_set_write_storage_buffer(&scene->geometry_descriptor_set, &scene->meshlet_vertex_buffer, meshlet_vertex_size, 3);
+    rhi_descriptor_set_write_storage_buffer(&scene->geometry_descriptor_set, &scene->meshlet_index_buffer, meshlet_index_size, 4);
+    rhi_descriptor_set_write_storage_buffer(&scene->geometry_descriptor_set, &scene->group_buffer, group_size, 5);
+    rhi_descriptor_set_write_storage_buffer(&scene->geometry_descriptor_set, &scene->primitive_buffer, primitive_size, 6);
+    rhi_descriptor_set_write_storage_buffer(&scene->geometry_descriptor_set, &scene->primitive_visibility_buffer, primitive_visibility_size, 7);
+    rhi_descriptor_set_write_storage_buffer(&scene->geometry_descriptor_set, &scene->cluster_index_buffer, cluster_index_size, 8);
+
+    rhi_init_descriptor_set(&scene->material_set, &s_descriptor_set_layout);
+    rhi_descriptor_set_write_storage_buffer(&scene->material_set, &scene->material_buffer, material_size, 0);
+
+    rhi_end_descriptor_writes();
 }
 
 void mesh_loader_free()
 {
+    MeshScene* scene = &s_scene;
+    rhi_free_descriptor_set(&scene->material_set);
+    rhi_free_descriptor_set(&scene->geometry_descriptor_set);
+    rhi_free_buffer(&scene->material_buffer);
+    rhi_free_buffer(&scene->cluster_index_buffer);
+    rhi_free_buffer(&scene->primitive_visibility_buffer);
+    rhi_free_buffer(&scene->primitive_buffer);
+    rhi_free_buffer(&scene->group_buffer);
+    rhi_free_buffer(&scene->visibility_buffer);
+    rhi_free_buffer(&scene->meshlet_index_buffer);
+    rhi_free_buffer(&scene->meshlet_vertex_buffer);
+    rhi_free_buffer(&scene->meshlet_buffer);
+    rhi_free_buffer(&scene->vertex_buffer);
+
     rhi_free_descriptor_set_layout(&s_meshlet_set_layout);
     rhi_free_descriptor_set_layout(&s_descriptor_set_layout);
 }
@@ -82,6 +254,11 @@ RHI_DescriptorSetLayout* mesh_loader_get_geometry_descriptor_set_layout()
     return &s_meshlet_set_layout;
 }
 
+MeshScene* mesh_loader_get_scene()
+{
+    return &s_scene;
+}
+
 void mesh_loader_set_texture_heap(RHI_DescriptorHeap* heap)
 {
     s_image_heap = heap;
@@ -100,6 +277,8 @@ u32 cgltf_comp_size(cgltf_component_type type)
     case cgltf_component_type_r_32u:
     case cgltf_component_type_r_32f:
         return 4;
+    default:
+        break;
     }
 
     assert(0);
@@ -123,6 +302,8 @@ u32 cgltf_comp_count(cgltf_type type)
         return 9;
     case cgltf_type_mat4:
         return 16;
+    default:
+        break;
     }
 
     assert(0);
@@ -138,133 +319,97 @@ void* cgltf_get_accessor_data(cgltf_accessor* accessor, u32* component_size, u32
     return OFFSET_PTR_BYTES(void, view->buffer->data, view->offset);
 }
 
-void mesh_load_albedo(Thread* thread)
-{
-    GLTFMaterial* mat = (GLTFMaterial*)aurora_platform_get_thread_ptr(thread);
-
-    rhi_load_raw_image(&mat->raw_color, mat->albedo_path);
-}
-
-void mesh_load_normal(Thread* thread)
+typedef struct mesh_image_job mesh_image_job;
+struct mesh_image_job
 {
-    GLTFMaterial* mat = (GLTFMaterial*)aurora_platform_get_thread_ptr(thread);
-
-    rhi_load_raw_image(&mat->raw_normal, mat->normal_path);
-}
+    RHI_RawImage* image;
+    char* path;
+};
 
-void mesh_load_pbr(Thread* thread)
+// CPU side of a primitive, filled in by the parallel phase and consumed by the upload phase
+typedef struct mesh_primitive_job mesh_primitive_job;
+struct mesh_primitive_job
 {
-    GLTFMaterial* mat = (GLTFMaterial*)aurora_platform_get_thread_ptr(thread);
-
-    rhi_load_raw_image(&mat->raw_pbr, mat->mr_path);
-}
+    cgltf_primitive* source;
+    Primitive* primitive;
+    b32 valid;
+
+    Vertex* vertices;
+    PackedVertex* packed_vertices;
+    u32* indices;
+    meshlet_vector meshlets;
+    MeshletGroup* groups;
+
+    // Worst quantization error: position in model units, normal in degrees, uv in texture coordinates
+    f32 position_error;
+    f32 normal_error;
+    f32 uv_error;
+
+    // Average cache miss ratio of the index buffer and average bytes spanned by a meshlet's vertices, before and after reordering
+    f32 cache_miss_before;
+    f32 cache_miss_after;
+    f32 fetch_span_before;
+    f32 fetch_span_after;
+
+    // Cluster hierarchy shape and vertices before and after every page got its own copies
+    u32 hierarchy_levels;
+    u32 root_count;
+    u32 unpaged_vertex_count;
+};
 
-void cgltf_process_primitive(cgltf_primitive* cgltf_primitive, u32* primitive_index, Mesh* m, hmm_mat4 transform)
+typedef struct mesh_loader mesh_loader;
+struct mesh_loader
 {
-    Primitive* pri = &m->primitives[(*primitive_index)++];
-    pri->transform = transform;
-
-    if (cgltf_primitive->type != cgltf_primitive_type_triangles)
-        return;
-
-    cgltf_attribute* position_attribute = 0;
-    cgltf_attribute* texcoord_attribute = 0;
-    cgltf_attribute* normal_attribute = 0;
-
-    for (i32 attribute_index = 0; attribute_index < cgltf_primitive->attributes_count; attribute_index++)
-    {
-        cgltf_attribute* attribute = &cgltf_primitive->attributes[attribute_index];
+    Mesh* mesh;
 
-        if (strcmp(attribute->name, "POSITION") == 0) position_attribute = attribute;
-        if (strcmp(attribute->name, "TEXCOORD_0") == 0) texcoord_attribute = attribute;
-        if (strcmp(attribute->name, "NORMAL") == 0) normal_attribute = attribute;
-    }
-
-    assert(position_attribute && texcoord_attribute && normal_attribute);
-
-    u32 vertex_count = (u32)normal_attribute->data->count;
-    u64 vertices_size = vertex_count * sizeof(Vertex);
-    Vertex* vertices = (Vertex*)malloc(vertices_size);
-    memset(vertices, 0, sizeof(vertices));
-
-    {
-        u32 component_size, component_count;
-        f32* src = (f32*)cgltf_get_accessor_data(position_attribute->data, &component_size, &component_count);
-        assert(component_size == 4);
+    mesh_primitive_job primitive_jobs[MAX_PRIMITIVES];
+    u32 primitive_job_count;
 
-        if (src)
-        {
-            for (u32 vertex_index = 0; vertex_index < vertex_count; vertex_index++)
-            {
-                vertices[vertex_index].position.X = src[vertex_index * component_count + 0];
-                vertices[vertex_index].position.Y = src[vertex_index * component_count + 1];
-                vertices[vertex_index].position.Z = src[vertex_index * component_count + 2];
-            }
-        }
-    }
+    mesh_image_job image_jobs[MAX_PRIMITIVES * 3];
+    u32 image_job_count;
+};
 
+void mesh_submit_jobs(AuroraJob* jobs, u32 job_count, JobCounter* counter)
+{
+    if (MULTITHREADING_ENABLED)
     {
-        u32 component_size, component_count;
-        f32* src = (f32*)cgltf_get_accessor_data(texcoord_attribute->data, &component_size, &component_count);
-        assert(component_size == 4);
-
-        if (src)
-        {
-            for (u32 vertex_index = 0; vertex_index < vertex_count; vertex_index++)
-            {
-                vertices[vertex_index].uv.X = src[vertex_index * component_count + 0];
-                vertices[vertex_index].uv.Y = src[vertex_index * component_count + 1];
-            }
-        }
+        aurora_platform_run_jobs(jobs, job_count, counter);
     }
-
+    else
     {
-        u32 component_size, component_count;
-        f32* src = (f32*)cgltf_get_accessor_data(normal_attribute->data, &component_size, &component_count);
-        assert(component_size == 4);
-
-        if (src)
-        {
-            for (u32 vertex_index = 0; vertex_index < vertex_count; vertex_index++)
-            {
-                vertices[vertex_index].normals.X = src[vertex_index * component_count + 0];
-                vertices[vertex_index].normals.Y = src[vertex_index * component_count + 1];
-                vertices[vertex_index].normals.Z = src[vertex_index * component_count + 2];
-            }
-        }
+        for (u32 i = 0; i < job_count; i++)
+            jobs[i].entry(jobs[i].data);
     }
+}
 
-    pri->index_count = (u32)cgltf_primitive->indices->count;
-    u32 index_size = pri->index_count * sizeof(u32);
-    u32* indices = (u32*)malloc(index_size);
-    memset(indices, 0, index_size);
+void mesh_convert_attribute(cgltf_accessor* accessor, Vertex* vertices, u32 vertex_count, u32 vertex_offset, u32 dst_component_count)
+{
+    u32 component_size, component_count;
+    f32* src = (f32*)cgltf_get_accessor_data(accessor, &component_size, &component_count);
+    assert(component_size == 4);
 
+    if (src)
     {
-        if (cgltf_primitive->indices != NULL)
+        for (u32 vertex_index = 0; vertex_index < vertex_count; vertex_index++)
         {
-            for (u32 k = 0; k < (u32)cgltf_primitive->indices->count; k++)
-                indices[k] = (u32)(cgltf_accessor_read_index(cgltf_primitive->indices, k));
+            f32* dst = OFFSET_PTR_BYTES(f32, &vertices[vertex_index], vertex_offset);
+            for (u32 c = 0; c < dst_component_count; c++)
+                dst[c] = src[vertex_index * component_count + c];
         }
     }
+}
 
-    rhi_allocate_buffer(&pri->vertex_buffer, vertices_size, BUFFER_VERTEX);
-    rhi_upload_buffer(&pri->vertex_buffer, vertices, vertices_size);
-
-    rhi_allocate_buffer(&pri->index_buffer, index_size, BUFFER_INDEX);
-    rhi_upload_buffer(&pri->index_buffer, indices, index_size);
-
-    // MAKE MESHLETS
-
-    meshlet_vector vec;
-    init_meshlet_vector(&vec, 256);
+void mesh_build_meshlets(meshlet_vector* vec, u32* indices, u32 index_count, u32 vertex_count, u32 max_vertices, u32 max_triangles)
+{
+    assert(max_vertices <= MAX_MESHLET_VERTICES && max_triangles <= MAX_MESHLET_TRIANGLES);
 
     u8* meshlet_vertices = (u8*)malloc(sizeof(u8) * vertex_count);
     memset(meshlet_vertices, 0xff, sizeof(u8) * vertex_count);
 
-    Meshlet ml;
+    meshlet_build ml;
     memset(&ml, 0, sizeof(ml));
 
-    for (i64 i = 0; i < pri->index_count; i += 3)
+    for (i64 i = 0; i < index_count; i += 3)
     {
         u32 a = indices[i + 0];
         u32 b = indices[i + 1];
@@ -276,31 +421,35 @@ void cgltf_process_primitive(cgltf_primitive* cgltf_primitive, u32* primitive_in
 
         u32 used_extra = (av == 0xff) + (bv == 0xff) + (cv == 0xff);
 
-        if (ml.vertex_count + used_extra > MAX_MESHLET_VERTICES || ml.triangle_count >= MAX_MESHLET_TRIANGLES)
+        if (ml.vertex_count + used_extra > max_vertices || ml.triangle_count >= max_triangles)
         {
-            push_meshlet(&vec, ml);
+            push_meshlet(vec, &ml);
             
             for (size_t j = 0; j < ml.vertex_count; ++j)
                 meshlet_vertices[ml.vertices[j]] = 0xff;
 
             memset(&ml, 0, sizeof(ml));
+            av = bv = cv = 0xff;
         }
 
         if (av == 0xff)
         {
             av = ml.vertex_count;
+            meshlet_vertices[a] = av;
             ml.vertices[ml.vertex_count++] = a;
         }
 
         if (bv == 0xff)
         {
             bv = ml.vertex_count;
+            meshlet_vertices[b] = bv;
             ml.vertices[ml.vertex_count++] = b;
         }
 
         if (cv == 0xff)
         {
             cv = ml.vertex_count;
+            meshlet_vertices[c] = cv;
             ml.vertices[ml.vertex_count++] = c;
         }
 
@@ -311,259 +460,2120 @@ void cgltf_process_primitive(cgltf_primitive* cgltf_primitive, u32* primitive_in
     }
 
     if (ml.triangle_count)
-        push_meshlet(&vec, ml);
+        push_meshlet(vec, &ml);
 
-    // Bounding Sphere
+    free(meshlet_vertices);
+}
 
-    for (u32 i = 0; i < vec.used; i++)
+internal void mesh_aabb_add(aabb* bounds, hmm_vec3 p)
+{
+    bounds->min.X = min(bounds->min.X, p.X);
+    bounds->min.Y = min(bounds->min.Y, p.Y);
+    bounds->min.Z = min(bounds->min.Z, p.Z);
+
+    bounds->max.X = max(bounds->max.X, p.X);
+    bounds->max.Y = max(bounds->max.Y, p.Y);
+    bounds->max.Z = max(bounds->max.Z, p.Z);
+}
+
+internal f32 mesh_aabb_diagonal(aabb* bounds)
+{
+    return HMM_LengthVec3(HMM_SubtractVec3(bounds->max, bounds->min));
+}
+
+internal u16 mesh_float_to_half(f32 value)
+{
+    union { f32 f; u32 u; } bits;
+    bits.f = value;
+
+    u32 sign = (bits.u >> 16) & 0x8000;
+    i32 exponent = (i32)((bits.u >> 23) & 0xff) - 127 + 15;
+    u32 mantissa = bits.u & 0x7fffff;
+
+    if (((bits.u >> 23) & 0xff) == 0xff)
+        return (u16)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+    if (exponent >= 31)
+        return (u16)(sign | 0x7c00);
+
+    // Subnormal half, round to nearest even on the bits shifted out
+    if (exponent <= 0)
     {
-        aabb bbox;
-        memset(&bbox, 0, sizeof(aabb));
+        if (exponent < -10)
+            return (u16)sign;
+
+        mantissa |= 0x800000;
+        u32 shift = (u32)(14 - exponent);
+        u32 half = mantissa >> shift;
+        u32 rest = mantissa & ((1u << shift) - 1);
+        u32 halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1)))
+            half++;
+        return (u16)(sign | half);
+    }
 
-        bbox.min = HMM_Vec3(FLT_MAX, FLT_MAX, FLT_MAX);
-        bbox.max = HMM_Vec3(FLT_MIN, FLT_MIN, FLT_MIN);
+    // A mantissa carry rolls over into the exponent, which is still the right answer
+    u32 half = sign | ((u32)exponent << 10) | (mantissa >> 13);
+    u32 rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+    return (u16)half;
+}
 
-        for (u32 j = 0; j < vec.meshlets[i].vertex_count; ++j)
-        {
-            u32 a = vec.meshlets[i].indices[j];
-            const Vertex* va = &vertices[vec.meshlets[i].vertices[a]];
+internal f32 mesh_half_to_float(u16 value)
+{
+    u32 exponent = (value >> 10) & 0x1f;
+    f32 mantissa = (f32)(value & 0x3ff);
+
+    f32 result;
+    if (exponent == 0)
+        result = mantissa / 16777216.0f;
+    else if (exponent == 31)
+        result = mantissa != 0.0f ? NAN : INFINITY;
+    else
+        result = ldexpf(1.0f + mantissa / 1024.0f, (i32)exponent - 15);
+
+    return (value & 0x8000) ? -result : result;
+}
 
-            bbox.min.X = min(bbox.min.X, va->position.X);
-            bbox.min.Y = min(bbox.min.Y, va->position.Y);
-            bbox.min.Z = min(bbox.min.Z, va->position.Z);
+internal i16 mesh_quantize_snorm16(f32 v)
+{
+    v = HMM_Clamp(-1.0f, v, 1.0f);
+    return (i16)(v * 32767.0f + (v >= 0.0f ? 0.5f : -0.5f));
+}
 
-            bbox.max.X = max(bbox.max.X, va->position.X);
-            bbox.max.Y = max(bbox.max.Y, va->position.Y);
-            bbox.max.Z = max(bbox.max.Z, va->position.Z);
-        }
+internal void mesh_encode_octahedral(hmm_vec3 n, i16* out)
+{
+    f32 l1 = fabsf(n.X) + fabsf(n.Y) + fabsf(n.Z);
+    if (l1 == 0.0f)
+    {
+        out[0] = 0;
+        out[1] = 0;
+        return;
+    }
 
-        hmm_vec3 bbox_extent = HMM_MultiplyVec3f(HMM_SubtractVec3(bbox.max, bbox.min), 0.5f);
-        hmm_vec3 bbox_center = HMM_AddVec3(bbox.min, bbox_extent);
+    f32 x = n.X / l1;
+    f32 y = n.Y / l1;
+
+    // Fold the lower hemisphere over the diagonals
+    if (n.Z < 0.0f)
+    {
+        f32 folded_x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        f32 folded_y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = folded_x;
+        y = folded_y;
+    }
+
+    out[0] = mesh_quantize_snorm16(x);
+    out[1] = mesh_quantize_snorm16(y);
+}
+
+// Same decode as gbuffer.mesh
+internal hmm_vec3 mesh_decode_octahedral(i16* in)
+{
+    hmm_vec3 n;
+    n.X = max(in[0] / 32767.0f, -1.0f);
+    n.Y = max(in[1] / 32767.0f, -1.0f);
+    n.Z = 1.0f - fabsf(n.X) - fabsf(n.Y);
 
-        vec.meshlets[i].sphere.XYZ = bbox_center;
+    f32 t = max(-n.Z, 0.0f);
+    n.X += n.X >= 0.0f ? -t : t;
+    n.Y += n.Y >= 0.0f ? -t : t;
 
-        for (u32 j = 0; j < vec.meshlets[i].vertex_count; ++j)
+    return HMM_NormalizeVec3(n);
+}
+
+// Packs the primitive into PackedVertex and writes the decoded values back, so meshlet bounds and cones match what the GPU draws
+void mesh_quantize_vertices(mesh_primitive_job* job)
+{
+    Primitive* pri = job->primitive;
+
+    aabb bounds;
+    bounds.min = HMM_Vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    bounds.max = HMM_Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (u32 v = 0; v < pri->vertex_count; v++)
+        mesh_aabb_add(&bounds, job->vertices[v].position);
+
+    pri->vertex_format = VERTEX_FORMAT_QUANTIZED;
+    pri->position_offset = bounds.min;
+    pri->position_scale = HMM_SubtractVec3(bounds.max, bounds.min);
+
+    job->packed_vertices = calloc(pri->vertex_count, sizeof(PackedVertex));
+    job->position_error = 0.0f;
+    job->normal_error = 0.0f;
+    job->uv_error = 0.0f;
+
+    for (u32 v = 0; v < pri->vertex_count; v++)
+    {
+        Vertex* src = &job->vertices[v];
+        PackedVertex* dst = &job->packed_vertices[v];
+
+        hmm_vec3 position;
+        for (u32 c = 0; c < 3; c++)
+        {
+            f32 scale = pri->position_scale.Elements[c];
+            f32 unorm = scale > 0.0f ? (src->position.Elements[c] - pri->position_offset.Elements[c]) / scale : 0.0f;
+            dst->position[c] = (u16)(HMM_Clamp(0.0f, unorm, 1.0f) * 65535.0f + 0.5f);
+            position.Elements[c] = pri->position_offset.Elements[c] + dst->position[c] / 65535.0f * scale;
+        }
+
+        mesh_encode_octahedral(src->normals, dst->normal);
+        hmm_vec3 normal = mesh_decode_octahedral(dst->normal);
+
+        hmm_vec2 uv;
+        for (u32 c = 0; c < 2; c++)
         {
-            u32 a = vec.meshlets[i].indices[j];
-            const Vertex* va = &vertices[vec.meshlets[i].vertices[a]];
+            dst->uv[c] = mesh_float_to_half(src->uv.Elements[c]);
+            uv.Elements[c] = mesh_half_to_float(dst->uv[c]);
+        }
 
-            vec.meshlets[i].sphere.W = max(vec.meshlets[i].sphere.W, HMM_DistanceVec3(vec.meshlets[i].sphere.XYZ, va->position));
+        job->position_error = max(job->position_error, HMM_DistanceVec3(position, src->position));
+        job->uv_error = max(job->uv_error, max(fabsf(uv.X - src->uv.X), fabsf(uv.Y - src->uv.Y)));
+
+        f32 normal_length = HMM_LengthVec3(src->normals);
+        if (normal_length > 0.0f)
+        {
+            f32 cosine = HMM_Clamp(-1.0f, HMM_DotVec3(normal, HMM_DivideVec3f(src->normals, normal_length)), 1.0f);
+            job->normal_error = max(job->normal_error, acosf(cosine) * (180.0f / HMM_PI32));
         }
+
+        src->position = position;
+        src->normals = normal;
+        src->uv = uv;
     }
 
-    rhi_allocate_buffer(&pri->meshlet_buffer, vec.used * sizeof(Meshlet), BUFFER_VERTEX);
-    rhi_upload_buffer(&pri->meshlet_buffer, vec.meshlets, vec.used * sizeof(Meshlet));
+    pri->vertex_size = pri->vertex_count * sizeof(PackedVertex);
+}
+
+typedef struct meshlet_builder meshlet_builder;
+struct meshlet_builder
+{
+    u32* indices;
+    Vertex* vertices;
+    u32 triangle_count;
+
+    // Vertex to triangle adjacency, the triangles of vertex v are triangles[offsets[v]..offsets[v + 1]]
+    u32* offsets;
+    u32* triangles;
+    u32* live;
+    u8* emitted;
+    u8* meshlet_vertices;
+
+    u32 max_vertices;
+    u32 max_triangles;
+
+    meshlet_build ml;
+    aabb bounds;
+};
+
+// Lower is better: new vertices cost the most, finishing off vertices is a bonus and growing the bounds is a penalty
+internal f32 mesh_score_triangle(meshlet_builder* b, u32 triangle, u32* extra)
+{
+    u32* tri = &b->indices[triangle * 3];
 
-    rhi_init_descriptor_set(&pri->geometry_descriptor_set, &s_meshlet_set_layout);
-    rhi_descriptor_set_write_storage_buffer(&pri->geometry_descriptor_set, &pri->vertex_buffer, vertices_size, 0);
-    rhi_descriptor_set_write_storage_buffer(&pri->geometry_descriptor_set, &pri->meshlet_buffer, vec.used * sizeof(Meshlet), 1);
+    *extra = 0;
+    u32 finished = 0;
+    aabb grown = b->bounds;
 
-    typedef struct temp_mat
+    for (u32 k = 0; k < 3; k++)
     {
-        i32 albedo_idx;
-        i32 normal_idx;
-        i32 mr_idx;
-        i32 sampler_idx;
-        hmm_vec3 bc_factor;
-        f32 m_factor;
-        f32 r_factor;
-        hmm_vec3 pad;
-    } temp_mat;
+        *extra += b->meshlet_vertices[tri[k]] == 0xff;
+        finished += b->live[tri[k]] == 1;
+        mesh_aabb_add(&grown, b->vertices[tri[k]].position);
+    }
 
-    // Load textures
+    f32 growth = 0.0f;
+    if (b->ml.triangle_count > 0)
     {
-        if (cgltf_primitive->material)
-        {
-            Thread* albedo_thread = aurora_platform_new_thread(mesh_load_albedo);
-            Thread* normal_thread = aurora_platform_new_thread(mesh_load_normal);
-            Thread* pbr_thread = aurora_platform_new_thread(mesh_load_pbr);
+        f32 diagonal = mesh_aabb_diagonal(&b->bounds);
+        growth = (mesh_aabb_diagonal(&grown) - diagonal) / max(diagonal, 1e-6f);
+    }
 
-            pri->material_index = m->material_count;
+    return (f32)*extra - 0.5f * (f32)finished + MESHLET_BOUNDS_WEIGHT * growth;
+}
 
-            aurora_platform_set_thread_ptr(albedo_thread, &m->materials[pri->material_index]);
-            aurora_platform_set_thread_ptr(normal_thread, &m->materials[pri->material_index]);
-            aurora_platform_set_thread_ptr(pbr_thread, &m->materials[pri->material_index]);
+internal void mesh_builder_flush(meshlet_builder* b, meshlet_vector* vec)
+{
+    push_meshlet(vec, &b->ml);
 
-            sprintf(m->materials[pri->material_index].albedo_path, "%s%s", m->directory, cgltf_primitive->material->pbr_metallic_roughness.base_color_texture.texture->image->uri);
+    for (u32 j = 0; j < b->ml.vertex_count; j++)
+        b->meshlet_vertices[b->ml.vertices[j]] = 0xff;
 
-            if (cgltf_primitive->material->normal_texture.texture) 
-            {
-                m->materials[pri->material_index].has_normal = 1;
-                sprintf(m->materials[pri->material_index].normal_path, "%s%s", m->directory, cgltf_primitive->material->normal_texture.texture->image->uri);
-            }
-            
-            if (cgltf_primitive->material->pbr_metallic_roughness.metallic_roughness_texture.texture)
-            {
-                m->materials[pri->material_index].has_metallic = 1;
-                sprintf(m->materials[pri->material_index].mr_path, "%s%s", m->directory, cgltf_primitive->material->pbr_metallic_roughness.metallic_roughness_texture.texture->image->uri);
-            }
+    memset(&b->ml, 0, sizeof(meshlet_build));
+    b->bounds.min = HMM_Vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    b->bounds.max = HMM_Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+}
 
-            if (MULTITHREADING_ENABLED)
-            {
-                aurora_platform_execute_thread(albedo_thread);
-                if (m->materials[pri->material_index].has_normal) aurora_platform_execute_thread(normal_thread);
-                if (m->materials[pri->material_index].has_metallic) aurora_platform_execute_thread(pbr_thread);
+internal void mesh_builder_emit(meshlet_builder* b, u32 triangle)
+{
+    u32* tri = &b->indices[triangle * 3];
 
-                aurora_platform_join_thread(albedo_thread);
-                if (m->materials[pri->material_index].has_normal) aurora_platform_join_thread(normal_thread);
-                if (m->materials[pri->material_index].has_metallic) aurora_platform_join_thread(pbr_thread);
-            }
-            else
-            {
-                rhi_load_raw_image(&m->materials[pri->material_index].raw_color,  m->materials[pri->material_index].albedo_path);
-                if (m->materials[pri->material_index].has_normal) rhi_load_raw_image(&m->materials[pri->material_index].raw_normal, m->materials[pri->material_index].normal_path);
-                if (m->materials[pri->material_index].has_metallic) rhi_load_raw_image(&m->materials[pri->material_index].raw_pbr,    m->materials[pri->material_index].mr_path);
-            }
+    for (u32 k = 0; k < 3; k++)
+    {
+        u32 v = tri[k];
+        if (b->meshlet_vertices[v] == 0xff)
+        {
+            b->meshlet_vertices[v] = b->ml.vertex_count;
+            b->ml.vertices[b->ml.vertex_count++] = v;
+        }
 
-            aurora_platform_free_thread(albedo_thread);
-            aurora_platform_free_thread(normal_thread);
-            aurora_platform_free_thread(pbr_thread);
+        b->ml.indices[b->ml.triangle_count * 3 + k] = b->meshlet_vertices[v];
+        b->live[v]--;
+        mesh_aabb_add(&b->bounds, b->vertices[v].position);
+    }
 
-            rhi_upload_image(&m->materials[pri->material_index].albedo, &m->materials[pri->material_index].raw_color, 1);
-            rhi_free_raw_image(&m->materials[pri->material_index].raw_color);
-            m->materials[pri->material_index].albedo_bindless_index = rhi_find_available_descriptor(s_image_heap);
-            rhi_push_descriptor_heap_image(s_image_heap, &m->materials[pri->material_index].albedo, m->materials[pri->material_index].albedo_bindless_index);
+    b->ml.triangle_count++;
+    b->emitted[triangle] = 1;
+}
 
-            m->materials[pri->material_index].albedo_sampler.filter = VK_FILTER_LINEAR;
-            m->materials[pri->material_index].albedo_sampler.address_mode = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+// Grows every meshlet from a seed through shared vertices so meshlets are compact patches with tight bounds
+void mesh_build_meshlets_coherent(meshlet_vector* vec, u32* indices, u32 index_count, Vertex* vertices, u32 vertex_count, u32 max_vertices, u32 max_triangles)
+{
+    assert(max_vertices <= MAX_MESHLET_VERTICES && max_triangles <= MAX_MESHLET_TRIANGLES);
+
+    meshlet_builder b;
+    memset(&b, 0, sizeof(meshlet_builder));
+    b.indices = indices;
+    b.vertices = vertices;
+    b.triangle_count = index_count / 3;
+    b.max_vertices = max_vertices;
+    b.max_triangles = max_triangles;
+
+    b.offsets = calloc(vertex_count + 1, sizeof(u32));
+    b.triangles = malloc(sizeof(u32) * (b.triangle_count * 3 + 1));
+    b.live = calloc(vertex_count, sizeof(u32));
+    b.emitted = calloc(b.triangle_count + 1, sizeof(u8));
+    b.meshlet_vertices = malloc(sizeof(u8) * vertex_count);
+    memset(b.meshlet_vertices, 0xff, sizeof(u8) * vertex_count);
+
+    for (u32 i = 0; i < b.triangle_count * 3; i++)
+        b.live[indices[i]]++;
+
+    for (u32 v = 0; v < vertex_count; v++)
+        b.offsets[v + 1] = b.offsets[v] + b.live[v];
+
+    u32* cursor = malloc(sizeof(u32) * (vertex_count + 1));
+    memcpy(cursor, b.offsets, sizeof(u32) * vertex_count);
+    for (u32 i = 0; i < b.triangle_count * 3; i++)
+        b.triangles[cursor[indices[i]]++] = i / 3;
+    free(cursor);
+
+    memset(&b.ml, 0, sizeof(meshlet_build));
+    b.bounds.min = HMM_Vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    b.bounds.max = HMM_Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+    u32 seed_cursor = 0;
+    u32 emitted_count = 0;
+
+    while (emitted_count < b.triangle_count)
+    {
+        u32 best = UINT_MAX;
+        f32 best_score = FLT_MAX;
 
-            rhi_init_sampler(&m->materials[pri->material_index].albedo_sampler, m->materials[pri->material_index].albedo.mip_levels);
-            m->materials[pri->material_index].albedo_sampler_index = rhi_find_available_descriptor(s_sampler_heap);
-            rhi_push_descriptor_heap_sampler(s_sampler_heap, &m->materials[pri->material_index].albedo_sampler, m->materials[pri->material_index].albedo_sampler_index);
-            
-            m->materials[pri->material_index].base_color_factor.X = cgltf_primitive->material->pbr_metallic_roughness.base_color_factor[0];
-            m->materials[pri->material_index].base_color_factor.Y = cgltf_primitive->material->pbr_metallic_roughness.base_color_factor[1];
-            m->materials[pri->material_index].base_color_factor.Z = cgltf_primitive->material->pbr_metallic_roughness.base_color_factor[2];
-
-            if (cgltf_primitive->material->normal_texture.texture)
-            {     
-                rhi_upload_image(&m->materials[pri->material_index].normal, &m->materials[pri->material_index].raw_normal, 0);
-                rhi_free_raw_image(&m->materials[pri->material_index].raw_normal);
-                m->materials[pri->material_index].normal_bindless_index = rhi_find_available_descriptor(s_image_heap);
-                rhi_push_descriptor_heap_image(s_image_heap, &m->materials[pri->material_index].normal, m->materials[pri->material_index].normal_bindless_index);
+        // Neighbours of the meshlet first
+        for (u32 j = 0; j < b.ml.vertex_count; j++)
+        {
+            u32 v = b.ml.vertices[j];
+            for (u32 a = b.offsets[v]; a < b.offsets[v + 1]; a++)
+            {
+                u32 t = b.triangles[a];
+                if (b.emitted[t])
+                    continue;
+
+                u32 extra;
+                f32 score = mesh_score_triangle(&b, t, &extra);
+                if (b.ml.vertex_count + extra <= max_vertices && score < best_score)
+                {
+                    best = t;
+                    best_score = score;
+                }
             }
+        }
 
-            
-            if (cgltf_primitive->material->pbr_metallic_roughness.metallic_roughness_texture.texture)
-            {
-                rhi_upload_image(&m->materials[pri->material_index].metallic_roughness, &m->materials[pri->material_index].raw_pbr, 0);
-                rhi_free_raw_image(&m->materials[pri->material_index].raw_pbr);
+        // Island used up or nothing fits: look a little further in index order, nearby triangles tend to sit close in the index buffer
+        if (best == UINT_MAX)
+        {
+            while (b.emitted[seed_cursor])
+                seed_cursor++;
 
-                m->materials[pri->material_index].metallic_roughness_index = rhi_find_available_descriptor(s_image_heap);
-                rhi_push_descriptor_heap_image(s_image_heap, &m->materials[pri->material_index].metallic_roughness, m->materials[pri->material_index].metallic_roughness_index);
-            
-                m->materials[pri->material_index].metallic_factor = cgltf_primitive->material->pbr_metallic_roughness.metallic_factor;
-                m->materials[pri->material_index].roughness_factor = cgltf_primitive->material->pbr_metallic_roughness.roughness_factor;
+            u32 searched = 0;
+            for (u32 t = seed_cursor; t < b.triangle_count && searched < MESHLET_SEED_WINDOW; t++)
+            {
+                if (b.emitted[t])
+                    continue;
+                searched++;
+
+                u32 extra;
+                f32 score = mesh_score_triangle(&b, t, &extra);
+                if (b.ml.vertex_count + extra <= max_vertices && score < best_score)
+                {
+                    best = t;
+                    best_score = score;
+                }
+
+                // An empty meshlet takes the first triangle it finds
+                if (b.ml.triangle_count == 0)
+                    break;
             }
-            
-        
-            temp_mat temp;
-            temp.albedo_idx = m->materials[pri->material_index].albedo_bindless_index;
-            temp.sampler_idx = m->materials[pri->material_index].albedo_sampler_index;
-            temp.normal_idx = m->materials[pri->material_index].normal_bindless_index;
-            temp.mr_idx = m->materials[pri->material_index].metallic_roughness_index;
-            temp.bc_factor = m->materials[pri->material_index].base_color_factor;
-            temp.m_factor = m->materials[pri->material_index].metallic_factor;
-            temp.r_factor = m->materials[pri->material_index].roughness_factor;
+        }
 
-            rhi_allocate_buffer(&m->materials[pri->material_index].material_buffer, sizeof(temp_mat), BUFFER_UNIFORM);
-            rhi_upload_buffer(&m->materials[pri->material_index].material_buffer, &temp, sizeof(temp_mat));
+        if (best == UINT_MAX)
+        {
+            mesh_builder_flush(&b, vec);
+            continue;
+        }
 
-            rhi_init_descriptor_set(&m->materials[pri->material_index].material_set, &s_descriptor_set_layout);
-            rhi_descriptor_set_write_buffer(&m->materials[pri->material_index].material_set, &m->materials[pri->material_index].material_buffer, sizeof(temp_mat), 0);
+        mesh_builder_emit(&b, best);
+        emitted_count++;
 
-            m->material_count++;
-        }
+        if (b.ml.triangle_count == max_triangles)
+            mesh_builder_flush(&b, vec);
     }
 
-    pri->vertex_count = vertex_count;
-    pri->triangle_count = pri->index_count / 3;
-    pri->vertex_size = vertices_size;
-    pri->index_size = index_size;
-    pri->meshlet_count = vec.used;
+    if (b.ml.triangle_count)
+        push_meshlet(vec, &b.ml);
 
-    m->total_vertex_count += pri->vertex_count;
-    m->total_index_count += pri->index_count;
-    m->total_triangle_count += pri->triangle_count;
-
-    free_meshlet_vector(&vec);
-    free(indices);
-    free(vertices);
+    free(b.meshlet_vertices);
+    free(b.emitted);
+    free(b.live);
+    free(b.triangles);
+    free(b.offsets);
 }
 
-void cgltf_process_node(cgltf_node* node, u32* primitive_index, Mesh* m)
+void mesh_compute_bounds(meshlet_vector* vec, Vertex* vertices)
 {
-    if (node->mesh)
+    for (u32 i = 0; i < vec->used; i++)
     {
-        hmm_mat4 pri_transform = HMM_Mat4d(1.0f);
+        Meshlet* ml = &vec->meshlets[i];
+        u32* meshlet_vertices = vec->vertices + ml->vertex_offset;
 
-        if (node->has_translation)
-        {
-            hmm_vec3 translation = HMM_Vec3(node->translation[0], node->translation[1], node->translation[2]);
-            pri_transform = HMM_MultiplyMat4(pri_transform, HMM_Translate(translation));
-        }
-        if (node->has_rotation)
-        {
-            hmm_quaternion rotation = HMM_Quaternion(node->rotation[0], node->rotation[1], node->rotation[2], node->rotation[3]);
-            pri_transform = HMM_MultiplyMat4(pri_transform, HMM_QuaternionToMat4(rotation));
-        }
-        if (node->has_scale)
+        aabb bbox;
+        memset(&bbox, 0, sizeof(aabb));
+
+        bbox.min = HMM_Vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+        bbox.max = HMM_Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+        for (u32 j = 0; j < ml->vertex_count; ++j)
         {
-            hmm_vec3 scale = HMM_Vec3(node->scale[0], node->scale[1], node->scale[2]);
-            pri_transform = HMM_MultiplyMat4(pri_transform, HMM_Scale(scale));
+            const Vertex* va = &vertices[meshlet_vertices[j]];
+
+            bbox.min.X = min(bbox.min.X, va->position.X);
+            bbox.min.Y = min(bbox.min.Y, va->position.Y);
+            bbox.min.Z = min(bbox.min.Z, va->position.Z);
+
+            bbox.max.X = max(bbox.max.X, va->position.X);
+            bbox.max.Y = max(bbox.max.Y, va->position.Y);
+            bbox.max.Z = max(bbox.max.Z, va->position.Z);
         }
 
-        pri_transform = HMM_MultiplyMat4(pri_transform, HMM_Rotate(180.0f, HMM_Vec3(1.0f, 0.0f, 0.0f))); // Flip y-axis
+        hmm_vec3 bbox_extent = HMM_MultiplyVec3f(HMM_SubtractVec3(bbox.max, bbox.min), 0.5f);
+        hmm_vec3 bbox_center = HMM_AddVec3(bbox.min, bbox_extent);
+
+        ml->sphere.XYZ = bbox_center;
 
-        for (i32 p = 0; p < node->mesh->primitives_count; p++)
+        for (u32 j = 0; j < ml->vertex_count; ++j)
         {
-            cgltf_process_primitive(&node->mesh->primitives[p], primitive_index, m, pri_transform);
-            m->primitive_count++;
+            const Vertex* va = &vertices[meshlet_vertices[j]];
+
+            ml->sphere.W = max(ml->sphere.W, HMM_DistanceVec3(ml->sphere.XYZ, va->position));
         }
     }
+}
 
-    for (i32 c = 0; c < node->children_count; c++)
-        cgltf_process_node(node->children[c], primitive_index, m);
+internal i8 mesh_quantize_snorm8(f32 v)
+{
+    return (i8)(v * 127.0f + (v >= 0.0f ? 0.5f : -0.5f));
 }
 
-void mesh_load(Mesh* out, const char* path)
+void mesh_compute_cones(meshlet_vector* vec, Vertex* vertices)
 {
-    memset(out, 0, sizeof(Mesh));
+    hmm_vec3 normals[MAX_MESHLET_TRIANGLES];
 
-    cgltf_options options;
-    memset(&options, 0, sizeof(options));
-    cgltf_data* data = 0;
+    for (u32 i = 0; i < vec->used; i++)
+    {
+        Meshlet* ml = &vec->meshlets[i];
+        u32* meshlet_vertices = vec->vertices + ml->vertex_offset;
+        u8* meshlet_indices = vec->indices + ml->triangle_offset;
 
-    cgltf_call(cgltf_parse_file(&options, path, &data));
-    cgltf_call(cgltf_load_buffers(&options, data, path));
-    cgltf_scene* scene = data->scene;
-    
-    const char* ch = "/";
-    char* ptr = strstr(path, ch);
-    ptr += sizeof(char);
-    strncpy(ptr, "", strlen(ptr));
-    out->directory = (char*)path;
+        ml->cone[0] = 0;
+        ml->cone[1] = 0;
+        ml->cone[2] = 0;
+        ml->cone[3] = 127;
 
-    u32 pi = 0;
-    for (i32 ni = 0; ni < scene->nodes_count; ni++)
-        cgltf_process_node(scene->nodes[ni], &pi, out);
+        hmm_vec3 sum = HMM_Vec3(0.0f, 0.0f, 0.0f);
+        u32 normal_count = 0;
 
-    cgltf_free(data);
+        for (u32 t = 0; t < ml->triangle_count; t++)
+        {
+            hmm_vec3 a = vertices[meshlet_vertices[meshlet_indices[t * 3 + 0]]].position;
+            hmm_vec3 b = vertices[meshlet_vertices[meshlet_indices[t * 3 + 1]]].position;
+            hmm_vec3 c = vertices[meshlet_vertices[meshlet_indices[t * 3 + 2]]].position;
+
+            // Geometric normal, counter clockwise is the front face like in glTF
+            hmm_vec3 n = HMM_Cross(HMM_SubtractVec3(b, a), HMM_SubtractVec3(c, a));
+            f32 length = HMM_LengthVec3(n);
+            if (length == 0.0f)
+                continue;
+
+            normals[normal_count] = HMM_DivideVec3f(n, length);
+            sum = HMM_AddVec3(sum, normals[normal_count]);
+            normal_count++;
+        }
+
+        f32 sum_length = HMM_LengthVec3(sum);
+        if (normal_count == 0 || sum_length == 0.0f)
+            continue;
+
+        hmm_vec3 axis = HMM_DivideVec3f(sum, sum_length);
+
+        f32 min_dot = 1.0f;
+        for (u32 t = 0; t < normal_count; t++)
+            min_dot = min(min_dot, HMM_DotVec3(axis, normals[t]));
+
+        // Triangles spread over a half sphere or more, there is no direction they all face away from
+        if (min_dot <= 0.0f)
+            continue;
+
+        f32 cutoff = HMM_SquareRootF(1.0f - min_dot * min_dot);
+
+        ml->cone[0] = mesh_quantize_snorm8(axis.X);
+        ml->cone[1] = mesh_quantize_snorm8(axis.Y);
+        ml->cone[2] = mesh_quantize_snorm8(axis.Z);
+
+        // Widen the cutoff by the axis rounding error and round it up, so the 8 bit test stays conservative
+        f32 axis_error = fabsf(ml->cone[0] / 127.0f - axis.X) + fabsf(ml->cone[1] / 127.0f - axis.Y) + fabsf(ml->cone[2] / 127.0f - axis.Z);
+        i32 quantized_cutoff = (i32)(127.0f * (cutoff + axis_error) + 1.0f);
+        ml->cone[3] = (i8)min(quantized_cutoff, 127);
+    }
 }
 
-void mesh_free(Mesh* m)
+internal f32 mesh_vertex_cache_score(i32 cache_position, u32 live_triangles)
 {
-    for (i32 i = 0; i < m->primitive_count; i++)
+    // Nothing left to draw with this vertex
+    if (live_triangles == 0)
+        return -1.0f;
+
+    f32 score = 0.0f;
+    if (cache_position >= 0)
     {
-        rhi_free_buffer(&m->primitives[i].meshlet_buffer);
-        rhi_free_buffer(&m->primitives[i].index_buffer);
-        rhi_free_buffer(&m->primitives[i].vertex_buffer);
-        rhi_free_descriptor_set(&m->primitives[i].geometry_descriptor_set);
+        // The last triangle's vertices get a flat score so the next triangle doesn't always hug the same edge
+        if (cache_position < 3)
+            score = 0.75f;
+        else
+            score = powf(1.0f - (f32)(cache_position - 3) / (MESH_VERTEX_CACHE_SIZE - 3), 1.5f);
     }
 
-    for (i32 i = 0; i < m->material_count; i++)
+    // Vertices with few triangles left get a boost so they are finished off instead of left behind
+    return score + 2.0f / HMM_SquareRootF((f32)live_triangles);
+}
+
+// Forsyth's linear speed vertex cache optimization: keeps emitting the best scoring triangle around a simulated LRU cache
+void mesh_optimize_vertex_cache(u32* indices, u32 index_count, u32 vertex_count)
+{
+    u32 triangle_count = index_count / 3;
+
+    u32* offsets = calloc(vertex_count + 1, sizeof(u32));
+    u32* live = calloc(vertex_count, sizeof(u32));
+    u32* adjacency = malloc(sizeof(u32) * (index_count + 1));
+    i32* cache_position = malloc(sizeof(i32) * vertex_count);
+    f32* vertex_score = malloc(sizeof(f32) * vertex_count);
+    f32* triangle_score = malloc(sizeof(f32) * (triangle_count + 1));
+    u8* emitted = calloc(triangle_count + 1, sizeof(u8));
+    u32* output = malloc(sizeof(u32) * (index_count + 1));
+
+    for (u32 i = 0; i < triangle_count * 3; i++)
+        live[indices[i]]++;
+
+    for (u32 v = 0; v < vertex_count; v++)
+        offsets[v + 1] = offsets[v] + live[v];
+
+    u32* cursor = malloc(sizeof(u32) * (vertex_count + 1));
+    memcpy(cursor, offsets, sizeof(u32) * vertex_count);
+    for (u32 i = 0; i < triangle_count * 3; i++)
+        adjacency[cursor[indices[i]]++] = i / 3;
+    free(cursor);
+
+    for (u32 v = 0; v < vertex_count; v++)
     {
-        if (m->materials[i].albedo.image != VK_NULL_HANDLE)
+        cache_position[v] = -1;
+        vertex_score[v] = mesh_vertex_cache_score(-1, live[v]);
+    }
+
+    for (u32 t = 0; t < triangle_count; t++)
+        triangle_score[t] = vertex_score[indices[t * 3 + 0]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+
+    u32 cache[MESH_VERTEX_CACHE_SIZE + 3];
+    u32 cache_count = 0;
+    u32 scan = 0;
+
+    for (u32 out = 0; out < triangle_count; out++)
+    {
+        u32 best = UINT_MAX;
+        f32 best_score = -FLT_MAX;
+
+        for (u32 c = 0; c < cache_count; c++)
+        {
+            u32 v = cache[c];
+            for (u32 a = offsets[v]; a < offsets[v + 1]; a++)
+            {
+                u32 t = adjacency[a];
+                if (!emitted[t] && triangle_score[t] > best_score)
+                {
+                    best = t;
+                    best_score = triangle_score[t];
+                }
+            }
+        }
+
+        // Nothing in the cache has triangles left, continue with the next one in input order
+        if (best == UINT_MAX)
+        {
+            while (emitted[scan])
+                scan++;
+            best = scan;
+        }
+
+        u32* tri = &indices[best * 3];
+        emitted[best] = 1;
+        memcpy(&output[out * 3], tri, sizeof(u32) * 3);
+
+        // The triangle's vertices move to the front, the rest shift back and the tail falls out
+        u32 next_cache[MESH_VERTEX_CACHE_SIZE + 3];
+        u32 next_count = 0;
+
+        for (u32 k = 0; k < 3; k++)
+        {
+            live[tri[k]]--;
+            if (cache_position[tri[k]] != -2)
+                next_cache[next_count++] = tri[k];
+            cache_position[tri[k]] = -2;
+        }
+
+        for (u32 c = 0; c < cache_count; c++)
+        {
+            if (cache_position[cache[c]] != -2)
+                next_cache[next_count++] = cache[c];
+        }
+
+        for (u32 c = 0; c < next_count; c++)
+        {
+            u32 v = next_cache[c];
+            cache_position[v] = c < MESH_VERTEX_CACHE_SIZE ? (i32)c : -1;
+
+            f32 score = mesh_vertex_cache_score(cache_position[v], live[v]);
+            f32 delta = score - vertex_score[v];
+            vertex_score[v] = score;
+
+            for (u32 a = offsets[v]; a < offsets[v + 1]; a++)
+                triangle_score[adjacency[a]] += delta;
+        }
+
+        cache_count = min(next_count, MESH_VERTEX_CACHE_SIZE);
+        memcpy(cache, next_cache, sizeof(u32) * cache_count);
+    }
+
+    memcpy(indices, output, sizeof(u32) * triangle_count * 3);
+
+    free(output);
+    free(emitted);
+    free(triangle_score);
+    free(vertex_score);
+    free(cache_position);
+    free(adjacency);
+    free(live);
+    free(offsets);
+}
+
+// Vertices transformed per triangle through a FIFO cache, 3 is the worst case and about 0.5 the best for regular meshes
+f32 mesh_analyze_vertex_cache(u32* indices, u32 index_count, u32 vertex_count)
+{
+    if (index_count < 3)
+        return 0.0f;
+
+    u32* timestamps = calloc(vertex_count, sizeof(u32));
+    u32 time = MESH_FIFO_CACHE_SIZE + 1;
+    u32 misses = 0;
+
+    for (u32 i = 0; i < index_count; i++)
+    {
+        u32 v = indices[i];
+        if (time - timestamps[v] > MESH_FIFO_CACHE_SIZE)
+        {
+            timestamps[v] = time++;
+            misses++;
+        }
+    }
+
+    free(timestamps);
+    return (f32)misses / (f32)(index_count / 3);
+}
+
+// Average distance in bytes between the lowest and highest vertex a meshlet fetches
+f32 mesh_meshlet_fetch_span(meshlet_vector* vec)
+{
+    f64 total = 0.0;
+
+    for (u32 i = 0; i < vec->used; i++)
+    {
+        Meshlet* ml = &vec->meshlets[i];
+        u32* meshlet_vertices = vec->vertices + ml->vertex_offset;
+
+        u32 lowest = UINT_MAX;
+        u32 highest = 0;
+        for (u32 j = 0; j < ml->vertex_count; j++)
+        {
+            lowest = min(lowest, meshlet_vertices[j]);
+            highest = max(highest, meshlet_vertices[j]);
+        }
+
+        if (ml->vertex_count)
+            total += (f64)(highest - lowest + 1) * MESH_VERTEX_STRIDE;
+    }
+
+    return vec->used ? (f32)(total / vec->used) : 0.0f;
+}
+
+// Renumbers vertices in the order the meshlets first use them, so every meshlet fetches from a tight range
+void mesh_remap_vertices(mesh_primitive_job* job)
+{
+    Primitive* pri = job->primitive;
+    meshlet_vector* vec = &job->meshlets;
+
+    u32* remap = malloc(sizeof(u32) * pri->vertex_count);
+    memset(remap, 0xff, sizeof(u32) * pri->vertex_count);
+    u32 next = 0;
+
+    for (u32 i = 0; i < vec->vertex_count; i++)
+    {
+        u32 v = vec->vertices[i];
+        if (remap[v] == UINT_MAX)
+            remap[v] = next++;
+        vec->vertices[i] = remap[v];
+    }
+
+    // Vertices no triangle uses go last
+    for (u32 v = 0; v < pri->vertex_count; v++)
+    {
+        if (remap[v] == UINT_MAX)
+            remap[v] = next++;
+    }
+
+    for (u32 i = 0; i < pri->index_count; i++)
+        job->indices[i] = remap[job->indices[i]];
+
+    Vertex* vertices = malloc(sizeof(Vertex) * pri->vertex_count);
+    for (u32 v = 0; v < pri->vertex_count; v++)
+        vertices[remap[v]] = job->vertices[v];
+    free(job->vertices);
+    job->vertices = vertices;
+
+    if (job->packed_vertices)
+    {
+        PackedVertex* packed_vertices = malloc(sizeof(PackedVertex) * pri->vertex_count);
+        for (u32 v = 0; v < pri->vertex_count; v++)
+            packed_vertices[remap[v]] = job->packed_vertices[v];
+        free(job->packed_vertices);
+        job->packed_vertices = packed_vertices;
+    }
+
+    free(remap);
+}
+
+// Bounding sphere of the whole primitive, the cull pass tests it before looking at any cluster
+void mesh_compute_primitive_bounds(mesh_primitive_job* job)
+{
+    Primitive* pri = job->primitive;
+
+    aabb bounds;
+    bounds.min = HMM_Vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    bounds.max = HMM_Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (u32 v = 0; v < pri->vertex_count; v++)
+        mesh_aabb_add(&bounds, job->vertices[v].position);
+
+    hmm_vec3 center = HMM_MultiplyVec3f(HMM_AddVec3(bounds.min, bounds.max), 0.5f);
+    f32 radius = 0.0f;
+    for (u32 v = 0; v < pri->vertex_count; v++)
+        radius = max(radius, HMM_DistanceVec3(center, job->vertices[v].position));
+
+    pri->bounds = HMM_Vec4v(center, radius);
+}
+
+// Smallest sphere around two spheres
+internal hmm_vec4 mesh_merge_spheres(hmm_vec4 a, hmm_vec4 b)
+{
+    hmm_vec3 delta = HMM_SubtractVec3(b.XYZ, a.XYZ);
+    f32 distance = HMM_LengthVec3(delta);
+
+    if (distance + b.W <= a.W)
+        return a;
+    if (distance + a.W <= b.W)
+        return b;
+
+    f32 radius = (distance + a.W + b.W) * 0.5f;
+    hmm_vec3 center = HMM_AddVec3(a.XYZ, HMM_MultiplyVec3f(delta, (radius - a.W) / distance));
+    return HMM_Vec4v(center, radius);
+}
+
+// Greedily grows groups through the positions clusters share until they hold MESHLET_GROUP_SIZE full clusters worth of
+// triangles or vertices, members lists the clusters group by group and offsets gets group_count + 1 entries
+internal u32 mesh_group_clusters(meshlet_vector* vec, u32* clusters, u32 count, u32* positions, u32 vertex_count, u32* members, u32* offsets)
+{
+    // Clusters using each position
+    u32* vertex_offsets = calloc(vertex_count + 1, sizeof(u32));
+    for (u32 c = 0; c < count; c++)
+    {
+        Meshlet* ml = &vec->meshlets[clusters[c]];
+        for (u32 j = 0; j < ml->vertex_count; j++)
+            vertex_offsets[positions[vec->vertices[ml->vertex_offset + j]] + 1]++;
+    }
+    for (u32 v = 0; v < vertex_count; v++)
+        vertex_offsets[v + 1] += vertex_offsets[v];
+
+    u32* vertex_clusters = malloc(sizeof(u32) * max(vertex_offsets[vertex_count], 1));
+    u32* cursor = malloc(sizeof(u32) * vertex_count);
+    memcpy(cursor, vertex_offsets, sizeof(u32) * vertex_count);
+    for (u32 c = 0; c < count; c++)
+    {
+        Meshlet* ml = &vec->meshlets[clusters[c]];
+        for (u32 j = 0; j < ml->vertex_count; j++)
+            vertex_clusters[cursor[positions[vec->vertices[ml->vertex_offset + j]]]++] = c;
+    }
+
+    u8* grouped = calloc(count, 1);
+    u32* shared = calloc(count, sizeof(u32));
+    u32* candidates = malloc(sizeof(u32) * count);
+
+    u32 group_count = 0;
+    u32 member_count = 0;
+    u32 seed = 0;
+
+    while (member_count < count)
+    {
+        while (grouped[seed])
+            seed++;
+
+        offsets[group_count++] = member_count;
+        u32 candidate_count = 0;
+        u32 current = seed;
+        u32 triangle_total = 0;
+        u32 vertex_total = 0;
+
+        for (;;)
+        {
+            grouped[current] = 1;
+            members[member_count++] = clusters[current];
+            triangle_total += vec->meshlets[clusters[current]].triangle_count;
+            vertex_total += vec->meshlets[clusters[current]].vertex_count;
+
+            // Neighbours score by how many positions they share with the group so far
+            Meshlet* ml = &vec->meshlets[clusters[current]];
+            for (u32 j = 0; j < ml->vertex_count; j++)
+            {
+                u32 v = positions[vec->vertices[ml->vertex_offset + j]];
+                for (u32 k = vertex_offsets[v]; k < vertex_offsets[v + 1]; k++)
+                {
+                    u32 neighbour = vertex_clusters[k];
+                    if (grouped[neighbour])
+                        continue;
+                    if (shared[neighbour]++ == 0)
+                        candidates[candidate_count++] = neighbour;
+                }
+            }
+
+            current = UINT_MAX;
+            u32 best = 0;
+            for (u32 k = 0; k < candidate_count; k++)
+            {
+                u32 neighbour = candidates[k];
+                Meshlet* candidate = &vec->meshlets[clusters[neighbour]];
+                if (grouped[neighbour] ||
+                    triangle_total + candidate->triangle_count > MESHLET_GROUP_SIZE * MESHLET_TRIANGLE_BUDGET ||
+                    vertex_total + candidate->vertex_count > MESHLET_GROUP_SIZE * MESHLET_VERTEX_BUDGET)
+                    continue;
+
+                if (shared[neighbour] > best)
+                {
+                    best = shared[neighbour];
+                    current = neighbour;
+                }
+            }
+
+            if (current == UINT_MAX)
+                break;
+        }
+
+        for (u32 k = 0; k < candidate_count; k++)
+            shared[candidates[k]] = 0;
+    }
+
+    offsets[group_count] = member_count;
+
+    free(candidates);
+    free(shared);
+    free(grouped);
+    free(cursor);
+    free(vertex_clusters);
+    free(vertex_offsets);
+
+    return group_count;
+}
+
+// Every level groups neighbouring clusters, simplifies each group to half its triangles and splits the result into new
+// clusters. Group borders are open edges to the simplifier and stay locked, so any cut that takes all or none of a
+// group's clusters is crack free
+void mesh_build_cluster_hierarchy(mesh_primitive_job* job)
+{
+    Primitive* pri = job->primitive;
+    meshlet_vector* vec = &job->meshlets;
+
+    u32 group_capacity = 64;
+    job->groups = calloc(group_capacity, sizeof(MeshletGroup));
+    pri->group_count = 0;
+
+    u32* positions = malloc(sizeof(u32) * pri->vertex_count);
+    // Canonical vertex for every position, clusters split by a uv seam are still neighbours
+    simplify_build_positions(positions, 0, job->vertices, pri->vertex_count);
+
+    // Groups are simplified in their own small vertex space, local_index maps into it and is reset after each group
+    u32 max_group_vertices = MESHLET_GROUP_SIZE * MAX_MESHLET_VERTICES;
+    u32 max_group_indices = MESHLET_GROUP_SIZE * MAX_MESHLET_TRIANGLES * 3;
+    u32* local_index = malloc(sizeof(u32) * pri->vertex_count);
+    memset(local_index, 0xff, sizeof(u32) * pri->vertex_count);
+    Vertex* group_vertices = malloc(sizeof(Vertex) * max_group_vertices);
+    u32* group_sources = malloc(sizeof(u32) * max_group_vertices);
+    u32* group_indices = malloc(sizeof(u32) * max_group_indices);
+    u32* simplified = malloc(sizeof(u32) * max_group_indices);
+
+    // Clusters still waiting for a parent, the ones a level fails to simplify get another try with the next
+    u32 pending_count = vec->used;
+    u32* pending = malloc(sizeof(u32) * pending_count);
+    for (u32 i = 0; i < pending_count; i++)
+        pending[i] = i;
+
+    job->hierarchy_levels = 1;
+
+    while (pending_count > 1)
+    {
+        mesh_compute_bounds(vec, job->vertices);
+
+        u32* members = malloc(sizeof(u32) * pending_count);
+        u32* offsets = malloc(sizeof(u32) * (pending_count + 1));
+        u32 group_count = mesh_group_clusters(vec, pending, pending_count, positions, pri->vertex_count, members, offsets);
+
+        u32 first_meshlet = vec->used;
+        u32 retry_count = 0;
+        u32* retry = malloc(sizeof(u32) * pending_count);
+
+        for (u32 g = 0; g < group_count; g++)
+        {
+            u32 vertex_count = 0;
+            u32 index_count = 0;
+            hmm_vec4 bounds = HMM_Vec4(0.0f, 0.0f, 0.0f, 0.0f);
+            f32 child_error = 0.0f;
+
+            for (u32 k = offsets[g]; k < offsets[g + 1]; k++)
+            {
+                Meshlet* ml = &vec->meshlets[members[k]];
+
+                // Parents cover their children's bounds and error, so a parent never projects smaller than a child
+                hmm_vec4 child_bounds = ml->group == MESHLET_GROUP_NONE ? ml->sphere : job->groups[ml->group].bounds;
+                bounds = k == offsets[g] ? child_bounds : mesh_merge_spheres(bounds, child_bounds);
+                if (ml->group != MESHLET_GROUP_NONE)
+                    child_error = max(child_error, job->groups[ml->group].error);
+
+                for (u32 i = 0; i < ml->triangle_count * 3u; i++)
+                {
+                    u32 v = vec->vertices[ml->vertex_offset + vec->indices[ml->triangle_offset + i]];
+                    if (local_index[v] == UINT_MAX)
+                    {
+                        local_index[v] = vertex_count;
+                        group_vertices[vertex_count] = job->vertices[v];
+                        group_sources[vertex_count++] = v;
+                    }
+                    group_indices[index_count++] = local_index[v];
+                }
+            }
+
+            for (u32 v = 0; v < vertex_count; v++)
+                local_index[group_sources[v]] = UINT_MAX;
+
+            f32 error;
+            u32 count = simplify_mesh(simplified, group_indices, index_count, group_vertices, vertex_count, index_count / 6 * 3, &error);
+
+            if (count > index_count * MESH_LOD_MIN_REDUCTION)
+            {
+                for (u32 k = offsets[g]; k < offsets[g + 1]; k++)
+                    retry[retry_count++] = members[k];
+                continue;
+            }
+
+            if (pri->group_count == group_capacity)
+            {
+                group_capacity *= 2;
+                job->groups = realloc(job->groups, sizeof(MeshletGroup) * group_capacity);
+            }
+
+            u32 group = pri->group_count++;
+            memset(&job->groups[group], 0, sizeof(MeshletGroup));
+            job->groups[group].bounds = bounds;
+            job->groups[group].error = child_error + error;
+
+            for (u32 k = offsets[g]; k < offsets[g + 1]; k++)
+                vec->meshlets[members[k]].parent_group = group;
+
+            u32 group_meshlet = vec->used;
+            u32 group_vertex = vec->vertex_count;
+            mesh_build_meshlets_coherent(vec, simplified, count, group_vertices, vertex_count, MESHLET_VERTEX_BUDGET, MESHLET_TRIANGLE_BUDGET);
+
+            for (u32 i = group_vertex; i < vec->vertex_count; i++)
+                vec->vertices[i] = group_sources[vec->vertices[i]];
+            for (u32 i = group_meshlet; i < vec->used; i++)
+                vec->meshlets[i].group = group;
+        }
+
+        free(offsets);
+        free(members);
+
+        // Nothing simplified any more, whatever is left are the roots
+        if (vec->used == first_meshlet)
+        {
+            free(retry);
+            break;
+        }
+
+        job->hierarchy_levels++;
+        free(pending);
+        pending_count = vec->used - first_meshlet + retry_count;
+        pending = malloc(sizeof(u32) * pending_count);
+        memcpy(pending, retry, sizeof(u32) * retry_count);
+        for (u32 i = 0; i < vec->used - first_meshlet; i++)
+            pending[retry_count + i] = first_meshlet + i;
+        free(retry);
+    }
+
+    job->root_count = 0;
+    for (u32 i = 0; i < vec->used; i++)
+    {
+        if (vec->meshlets[i].parent_group == MESHLET_GROUP_NONE)
+            job->root_count++;
+    }
+
+    free(pending);
+    free(simplified);
+    free(group_indices);
+    free(group_sources);
+    free(group_vertices);
+    free(local_index);
+    free(positions);
+}
+
+// Lays the clusters out coarse to fine in pages of about MESHLET_PAGE_SIZE bytes. Clusters made from the same group
+// never straddle pages and every page stores its own copy of the vertices it uses, so pages load independently
+void mesh_build_pages(mesh_primitive_job* job)
+{
+    Primitive* pri = job->primitive;
+    meshlet_vector* src = &job->meshlets;
+
+    // Levels were appended finest first, walking runs of siblings backwards puts the roots up front
+    u32* order = malloc(sizeof(u32) * src->used);
+    u32 order_count = 0;
+    for (u32 end = src->used; end > 0; )
+    {
+        u32 begin = end - 1;
+        u32 group = src->meshlets[begin].group;
+        if (group != MESHLET_GROUP_NONE)
+        {
+            while (begin > 0 && src->meshlets[begin - 1].group == group)
+                begin--;
+        }
+
+        for (u32 i = begin; i < end; i++)
+            order[order_count++] = i;
+        end = begin;
+    }
+
+    meshlet_vector dst;
+    init_meshlet_vector(&dst, max(src->used, 1));
+
+    u32 page_capacity = 16;
+    MeshletPage* pages = calloc(page_capacity, sizeof(MeshletPage));
+    u32 page_count = 0;
+    u32 page_bytes = 0;
+
+    // Copies of every vertex in the current page, sources maps copies back for the reset
+    u32 vertex_capacity = pri->vertex_count * 2;
+    Vertex* vertices = malloc(sizeof(Vertex) * vertex_capacity);
+    PackedVertex* packed_vertices = job->packed_vertices ? malloc(sizeof(PackedVertex) * vertex_capacity) : 0;
+    u32* sources = malloc(sizeof(u32) * vertex_capacity);
+    u32 vertex_count = 0;
+
+    u32* page_copy = malloc(sizeof(u32) * pri->vertex_count);
+    memset(page_copy, 0xff, sizeof(u32) * pri->vertex_count);
+
+    for (u32 r = 0; r < order_count; )
+    {
+        u32 group = src->meshlets[order[r]].group;
+        u32 run_end = r + 1;
+        if (group != MESHLET_GROUP_NONE)
+        {
+            while (run_end < order_count && src->meshlets[order[run_end]].group == group)
+                run_end++;
+        }
+
+        // Upper bound, vertices shared inside a page are only stored once
+        u32 run_bytes = 0;
+        for (u32 i = r; i < run_end; i++)
+        {
+            Meshlet* ml = &src->meshlets[order[i]];
+            run_bytes += sizeof(Meshlet) + ml->vertex_count * (sizeof(u32) + MESH_VERTEX_STRIDE) + ((ml->triangle_count * 3u + 3) & ~3u);
+        }
+
+        if (page_count == 0 || (page_bytes + run_bytes > MESHLET_PAGE_SIZE && pages[page_count - 1].meshlet_count))
+        {
+            if (page_count)
+            {
+                for (u32 v = pages[page_count - 1].vertex_offset; v < vertex_count; v++)
+                    page_copy[sources[v]] = UINT_MAX;
+            }
+
+            if (page_count == page_capacity)
+            {
+                page_capacity *= 2;
+                pages = realloc(pages, sizeof(MeshletPage) * page_capacity);
+            }
+
+            MeshletPage* page = &pages[page_count++];
+            memset(page, 0, sizeof(MeshletPage));
+            page->meshlet_offset = dst.used;
+            page->vertex_offset = vertex_count;
+            page->meshlet_vertex_offset = dst.vertex_count;
+            page->meshlet_index_offset = dst.index_size;
+            page_bytes = 0;
+        }
+
+        page_bytes += run_bytes;
+
+        for (u32 i = r; i < run_end; i++)
+        {
+            Meshlet* ml = &src->meshlets[order[i]];
+
+            meshlet_build b;
+            b.vertex_count = ml->vertex_count;
+            b.triangle_count = ml->triangle_count;
+            memcpy(b.indices, src->indices + ml->triangle_offset, ml->triangle_count * 3);
+
+            for (u32 j = 0; j < ml->vertex_count; j++)
+            {
+                u32 v = src->vertices[ml->vertex_offset + j];
+                if (page_copy[v] == UINT_MAX)
+                {
+                    if (vertex_count == vertex_capacity)
+                    {
+                        vertex_capacity *= 2;
+                        vertices = realloc(vertices, sizeof(Vertex) * vertex_capacity);
+                        sources = realloc(sources, sizeof(u32) * vertex_capacity);
+                        if (packed_vertices)
+                            packed_vertices = realloc(packed_vertices, sizeof(PackedVertex) * vertex_capacity);
+                    }
+
+                    vertices[vertex_count] = job->vertices[v];
+                    if (packed_vertices)
+                        packed_vertices[vertex_count] = job->packed_vertices[v];
+                    sources[vertex_count] = v;
+                    page_copy[v] = vertex_count++;
+                }
+                b.vertices[j] = page_copy[v];
+            }
+
+            push_meshlet(&dst, &b);
+
+            Meshlet* out = &dst.meshlets[dst.used - 1];
+            out->sphere = ml->sphere;
+            memcpy(out->cone, ml->cone, sizeof(out->cone));
+            out->group = ml->group;
+            out->parent_group = ml->parent_group;
+            out->page = page_count - 1;
+        }
+
+        MeshletPage* page = &pages[page_count - 1];
+        page->meshlet_count = dst.used - page->meshlet_offset;
+        page->vertex_count = vertex_count - page->vertex_offset;
+        page->meshlet_vertex_count = dst.vertex_count - page->meshlet_vertex_offset;
+        page->meshlet_index_size = dst.index_size - page->meshlet_index_offset;
+
+        r = run_end;
+    }
+
+    free_meshlet_vector(src);
+    job->meshlets = dst;
+
+    free(job->vertices);
+    job->vertices = vertices;
+    if (packed_vertices)
+    {
+        free(job->packed_vertices);
+        job->packed_vertices = packed_vertices;
+    }
+
+    job->unpaged_vertex_count = pri->vertex_count;
+    pri->vertex_count = vertex_count;
+    pri->vertex_size = vertex_count * MESH_VERTEX_STRIDE;
+    pri->pages = pages;
+    pri->page_count = page_count;
+
+    free(page_copy);
+    free(sources);
+    free(order);
+}
+
+void mesh_job_load_image(void* ptr)
+{
+    mesh_image_job* job = (mesh_image_job*)ptr;
+
+    rhi_load_raw_image(job->image, job->path);
+}
+
+// Reads the primitive and optimizes its indices for the vertex cache, everything up to building meshlets.
+// Returns 0 for primitives that are not triangle lists
+b32 mesh_prepare_primitive(mesh_primitive_job* job)
+{
+    cgltf_primitive* cgltf_primitive = job->source;
+    Primitive* pri = job->primitive;
+
+    if (cgltf_primitive->type != cgltf_primitive_type_triangles)
+        return 0;
+
+    cgltf_attribute* position_attribute = 0;
+    cgltf_attribute* texcoord_attribute = 0;
+    cgltf_attribute* normal_attribute = 0;
+
+    for (u32 attribute_index = 0; attribute_index < cgltf_primitive->attributes_count; attribute_index++)
+    {
+        cgltf_attribute* attribute = &cgltf_primitive->attributes[attribute_index];
+
+        if (strcmp(attribute->name, "POSITION") == 0) position_attribute = attribute;
+        if (strcmp(attribute->name, "TEXCOORD_0") == 0) texcoord_attribute = attribute;
+        if (strcmp(attribute->name, "NORMAL") == 0) normal_attribute = attribute;
+    }
+
+    assert(position_attribute && texcoord_attribute && normal_attribute);
+
+    pri->vertex_count = (u32)normal_attribute->data->count;
+    pri->vertex_size = pri->vertex_count * sizeof(Vertex);
+    job->vertices = (Vertex*)malloc(pri->vertex_size);
+    memset(job->vertices, 0, pri->vertex_size);
+
+    mesh_convert_attribute(position_attribute->data, job->vertices, pri->vertex_count, offsetof(Vertex, position), 3);
+    mesh_convert_attribute(texcoord_attribute->data, job->vertices, pri->vertex_count, offsetof(Vertex, uv), 2);
+    mesh_convert_attribute(normal_attribute->data, job->vertices, pri->vertex_count, offsetof(Vertex, normals), 3);
+
+    pri->index_count = (u32)cgltf_primitive->indices->count;
+    pri->index_size = pri->index_count * sizeof(u32);
+    job->indices = (u32*)malloc(pri->index_size);
+    memset(job->indices, 0, pri->index_size);
+
+    for (u32 k = 0; k < pri->index_count; k++)
+        job->indices[k] = (u32)(cgltf_accessor_read_index(cgltf_primitive->indices, k));
+
+    if (VERTEX_QUANTIZATION_ENABLED)
+        mesh_quantize_vertices(job);
+
+    mesh_compute_primitive_bounds(job);
+
+    // The statistics cost a pass over the whole primitive each, only the report reads them
+    if (MESH_REPORTS_ENABLED)
+        job->cache_miss_before = mesh_analyze_vertex_cache(job->indices, pri->index_count, pri->vertex_count);
+    mesh_optimize_vertex_cache(job->indices, pri->index_count, pri->vertex_count);
+    if (MESH_REPORTS_ENABLED)
+        job->cache_miss_after = mesh_analyze_vertex_cache(job->indices, pri->index_count, pri->vertex_count);
+
+    pri->triangle_count = pri->index_count / 3;
+    return 1;
+}
+
+void mesh_job_process_primitive(void* ptr)
+{
+    mesh_primitive_job* job = (mesh_primitive_job*)ptr;
+    Primitive* pri = job->primitive;
+
+    if (!mesh_prepare_primitive(job))
+        return;
+
+    init_meshlet_vector(&job->meshlets, 256);
+    mesh_build_meshlets_coherent(&job->meshlets, job->indices, pri->index_count, job->vertices, pri->vertex_count, MESHLET_VERTEX_BUDGET, MESHLET_TRIANGLE_BUDGET);
+    mesh_build_cluster_hierarchy(job);
+
+    mesh_compute_bounds(&job->meshlets, job->vertices);
+    mesh_compute_cones(&job->meshlets, job->vertices);
+
+    if (MESH_REPORTS_ENABLED)
+        job->fetch_span_before = mesh_meshlet_fetch_span(&job->meshlets);
+    mesh_remap_vertices(job);
+    if (MESH_REPORTS_ENABLED)
+        job->fetch_span_after = mesh_meshlet_fetch_span(&job->meshlets);
+
+    // Pages duplicate every vertex a page shares with another, that only pays off once something streams them
+    if (MESHLET_PAGING_ENABLED)
+    {
+        mesh_build_pages(job);
+    }
+    else
+    {
+        job->unpaged_vertex_count = pri->vertex_count;
+        pri->pages = 0;
+        pri->page_count = 0;
+    }
+
+    pri->meshlet_count = job->meshlets.used;
+    pri->meshlet_vertex_count = job->meshlets.vertex_count;
+    pri->meshlet_index_size = job->meshlets.index_size;
+    job->valid = 1;
+}
+
+void mesh_queue_image(mesh_loader* loader, RHI_RawImage* image, char* path)
+{
+    mesh_image_job* job = &loader->image_jobs[loader->image_job_count++];
+    job->image = image;
+    job->path = path;
+}
+
+void cgltf_queue_primitive(cgltf_primitive* cgltf_primitive, mesh_loader* loader, hmm_mat4 transform)
+{
+    Mesh* m = loader->mesh;
+
+    mesh_primitive_job* job = &loader->primitive_jobs[loader->primitive_job_count++];
+    job->source = cgltf_primitive;
+    job->primitive = &m->primitives[m->primitive_count++];
+    job->primitive->transform = transform;
+
+    if (cgltf_primitive->type != cgltf_primitive_type_triangles || !cgltf_primitive->material)
+        return;
+
+    job->primitive->material_index = m->material_count;
+    GLTFMaterial* material = &m->materials[m->material_count++];
+    cgltf_material* source = cgltf_primitive->material;
+
+    sprintf(material->albedo_path, "%s%s", m->directory, source->pbr_metallic_roughness.base_color_texture.texture->image->uri);
+    mesh_queue_image(loader, &material->raw_color, material->albedo_path);
+
+    material->base_color_factor.X = source->pbr_metallic_roughness.base_color_factor[0];
+    material->base_color_factor.Y = source->pbr_metallic_roughness.base_color_factor[1];
+    material->base_color_factor.Z = source->pbr_metallic_roughness.base_color_factor[2];
+
+    if (source->normal_texture.texture) 
+    {
+        material->has_normal = 1;
+        sprintf(material->normal_path, "%s%s", m->directory, source->normal_texture.texture->image->uri);
+        mesh_queue_image(loader, &material->raw_normal, material->normal_path);
+    }
+    
+    if (source->pbr_metallic_roughness.metallic_roughness_texture.texture)
+    {
+        material->has_metallic = 1;
+        sprintf(material->mr_path, "%s%s", m->directory, source->pbr_metallic_roughness.metallic_roughness_texture.texture->image->uri);
+        mesh_queue_image(loader, &material->raw_pbr, material->mr_path);
+
+        material->metallic_factor = source->pbr_metallic_roughness.metallic_factor;
+        material->roughness_factor = source->pbr_metallic_roughness.roughness_factor;
+    }
+}
+
+void cgltf_queue_node(cgltf_node* node, mesh_loader* loader)
+{
+    if (node->mesh)
+    {
+        hmm_mat4 pri_transform = HMM_Mat4d(1.0f);
+
+        if (node->has_translation)
+        {
+            hmm_vec3 translation = HMM_Vec3(node->translation[0], node->translation[1], node->translation[2]);
+            pri_transform = HMM_MultiplyMat4(pri_transform, HMM_Translate(translation));
+        }
+        if (node->has_rotation)
+        {
+            hmm_quaternion rotation = HMM_Quaternion(node->rotation[0], node->rotation[1], node->rotation[2], node->rotation[3]);
+            pri_transform = HMM_MultiplyMat4(pri_transform, HMM_QuaternionToMat4(rotation));
+        }
+        if (node->has_scale)
+        {
+            hmm_vec3 scale = HMM_Vec3(node->scale[0], node->scale[1], node->scale[2]);
+            pri_transform = HMM_MultiplyMat4(pri_transform, HMM_Scale(scale));
+        }
+
+        pri_transform = HMM_MultiplyMat4(pri_transform, HMM_Rotate(180.0f, HMM_Vec3(1.0f, 0.0f, 0.0f))); // Flip y-axis
+
+        for (u32 p = 0; p < node->mesh->primitives_count; p++)
+            cgltf_queue_primitive(&node->mesh->primitives[p], loader, pri_transform);
+    }
+
+    for (u32 c = 0; c < node->children_count; c++)
+        cgltf_queue_node(node->children[c], loader);
+}
+
+// Sub-allocates every primitive from the scene buffers and adds the mesh's entries to the scene primitive table
+void mesh_upload_geometry(mesh_loader* loader, Mesh* m)
+{
+    MeshScene* scene = &s_scene;
+
+    m->first_primitive = scene->primitive_count;
+    m->first_material = scene->material_count;
+
+    for (u32 i = 0; i < loader->primitive_job_count; i++)
+    {
+        mesh_primitive_job* job = &loader->primitive_jobs[i];
+        if (!job->valid)
+            continue;
+
+        Primitive* pri = job->primitive;
+        pri->first_vertex = scene->vertex_count;
+        pri->first_meshlet = scene->meshlet_count;
+        pri->first_meshlet_vertex = scene->meshlet_vertex_count;
+        pri->first_meshlet_index = scene->meshlet_index_words;
+        pri->first_group = scene->group_count;
+
+        scene->vertex_count += pri->vertex_count;
+        scene->meshlet_count += pri->meshlet_count;
+        scene->meshlet_vertex_count += pri->meshlet_vertex_count;
+        scene->meshlet_index_words += (pri->meshlet_index_size + 3) / 4;
+        scene->group_count += pri->group_count;
+        scene->max_primitive_meshlet_count = max(scene->max_primitive_meshlet_count, pri->meshlet_count);
+
+        m->total_vertex_count += pri->vertex_count;
+        m->total_triangle_count += pri->triangle_count;
+        m->total_meshlet_count += pri->meshlet_count;
+        m->total_meshlet_size += pri->meshlet_count * sizeof(Meshlet) + pri->meshlet_vertex_count * sizeof(u32) + pri->meshlet_index_size;
+    }
+
+    // Primitives without geometry still take their table slot so primitive i stays entry first_primitive + i
+    scene->primitive_count += m->primitive_count;
+    scene->material_count += m->material_count;
+    scene->mesh_count++;
+
+    assert(scene->vertex_count <= MESH_SCENE_MAX_VERTICES);
+    assert(scene->meshlet_count <= MESH_SCENE_MAX_MESHLETS);
+    assert(scene->meshlet_vertex_count <= MESH_SCENE_MAX_MESHLET_VERTICES);
+    assert(scene->meshlet_index_words <= MESH_SCENE_MAX_MESHLET_INDEX_WORDS);
+    assert(scene->group_count <= MESH_SCENE_MAX_GROUPS);
+    assert(scene->primitive_count <= MESH_SCENE_MAX_PRIMITIVES);
+    assert(scene->material_count <= MESH_SCENE_MAX_MATERIALS);
+
+    gpu_primitive* table = calloc(max(m->primitive_count, 1), sizeof(gpu_primitive));
+    for (u32 i = 0; i < loader->primitive_job_count; i++)
+    {
+        mesh_primitive_job* job = &loader->primitive_jobs[i];
+        if (!job->valid)
+            continue;
+
+        Primitive* pri = job->primitive;
+        void* vertex_data = pri->vertex_format == VERTEX_FORMAT_QUANTIZED ? (void*)job->packed_vertices : (void*)job->vertices;
+        if (pri->vertex_count)
+            rhi_upload_buffer_range(&scene->vertex_buffer, vertex_data, (u64)pri->first_vertex * MESH_VERTEX_STRIDE, pri->vertex_size);
+        if (pri->meshlet_count)
+        {
+            rhi_upload_buffer_range(&scene->meshlet_buffer, job->meshlets.meshlets, (u64)pri->first_meshlet * sizeof(Meshlet), pri->meshlet_count * sizeof(Meshlet));
+            rhi_upload_buffer_range(&scene->meshlet_vertex_buffer, job->meshlets.vertices, (u64)pri->first_meshlet_vertex * sizeof(u32), pri->meshlet_vertex_count * sizeof(u32));
+            rhi_upload_buffer_range(&scene->meshlet_index_buffer, job->meshlets.indices, (u64)pri->first_meshlet_index * sizeof(u32), pri->meshlet_index_size);
+        }
+        if (pri->group_count)
+            rhi_upload_buffer_range(&scene->group_buffer, job->groups, (u64)pri->first_group * sizeof(MeshletGroup), pri->group_count * sizeof(MeshletGroup));
+
+        // Meshlet offsets and group ids stay local to the primitive, the shaders add the bases from this table
+        gpu_primitive* entry = &table[pri - m->primitives];
+        entry->transform = pri->transform;
+        entry->position_offset = HMM_Vec4v(pri->position_offset, 0.0f);
+        entry->position_scale = HMM_Vec4v(pri->position_scale, 0.0f);
+        entry->bounds = pri->bounds;
+        entry->first_vertex = pri->first_vertex;
+        entry->first_meshlet = pri->first_meshlet;
+        entry->meshlet_count = pri->meshlet_count;
+        entry->first_meshlet_vertex = pri->first_meshlet_vertex;
+        entry->first_meshlet_index = pri->first_meshlet_index;
+        entry->first_group = pri->first_group;
+        entry->material_index = m->first_material + pri->material_index;
+        entry->vertex_format = pri->vertex_format;
+    }
+
+    if (m->primitive_count)
+        rhi_upload_buffer_range(&scene->primitive_buffer, table, (u64)m->first_primitive * sizeof(gpu_primitive), (u64)m->primitive_count * sizeof(gpu_primitive));
+    free(table);
+
+    // Nothing was visible before the first frame, the late cull pass fills it in
+    u32* visibility = calloc(max(max(m->total_meshlet_count, (u32)m->primitive_count), 1), sizeof(u32));
+    if (m->total_meshlet_count)
+        rhi_upload_buffer_range(&scene->visibility_buffer, visibility, (u64)(scene->meshlet_count - m->total_meshlet_count) * sizeof(u32), (u64)m->total_meshlet_count * sizeof(u32));
+    if (m->primitive_count)
+        rhi_upload_buffer_range(&scene->primitive_visibility_buffer, visibility, (u64)m->first_primitive * sizeof(u32), (u64)m->primitive_count * sizeof(u32));
+    free(visibility);
+}
+
+void mesh_upload_material(GLTFMaterial* material)
+{
+    rhi_upload_image(&material->albedo, &material->raw_color, 1);
+    rhi_free_raw_image(&material->raw_color);
+    material->albedo_bindless_index = rhi_find_available_descriptor(s_image_heap);
+    rhi_push_descriptor_heap_image(s_image_heap, &material->albedo, material->albedo_bindless_index);
+
+    material->albedo_sampler.filter = VK_FILTER_LINEAR;
+    material->albedo_sampler.address_mode = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+
+    rhi_init_sampler(&material->albedo_sampler, material->albedo.mip_levels);
+    material->albedo_sampler_index = rhi_find_available_descriptor(s_sampler_heap);
+    rhi_push_descriptor_heap_sampler(s_sampler_heap, &material->albedo_sampler, material->albedo_sampler_index);
+
+    if (material->has_normal)
+    {     
+        rhi_upload_image(&material->normal, &material->raw_normal, 0);
+        rhi_free_raw_image(&material->raw_normal);
+        material->normal_bindless_index = rhi_find_available_descriptor(s_image_heap);
+        rhi_push_descriptor_heap_image(s_image_heap, &material->normal, material->normal_bindless_index);
+    }
+
+    if (material->has_metallic)
+    {
+        rhi_upload_image(&material->metallic_roughness, &material->raw_pbr, 0);
+        rhi_free_raw_image(&material->raw_pbr);
+
+        material->metallic_roughness_index = rhi_find_available_descriptor(s_image_heap);
+        rhi_push_descriptor_heap_image(s_image_heap, &material->metallic_roughness, material->metallic_roughness_index);
+    }
+}
+
+// The mesh's materials go to the scene material table, fragments index it with the primitive's scene material
+void mesh_upload_material_table(Mesh* m)
+{
+    if (m->material_count == 0)
+        return;
+
+    u64 table_size = (u64)m->material_count * sizeof(gpu_material);
+    gpu_material* table = calloc(1, table_size);
+    for (i32 i = 0; i < m->material_count; i++)
+    {
+        GLTFMaterial* material = &m->materials[i];
+        table[i].albedo_idx = material->albedo_bindless_index;
+        table[i].sampler_idx = material->albedo_sampler_index;
+        table[i].normal_idx = material->normal_bindless_index;
+        table[i].mr_idx = material->metallic_roughness_index;
+        table[i].bc_factor = material->base_color_factor;
+        table[i].m_factor = material->metallic_factor;
+        table[i].r_factor = material->roughness_factor;
+    }
+
+    rhi_upload_buffer_range(&s_scene.material_buffer, table, (u64)m->first_material * sizeof(gpu_material), table_size);
+    free(table);
+}
+
+void mesh_print_quantization_report(mesh_loader* loader)
+{
+    printf("Vertex quantization (%u -> %u bytes per vertex), worst errors per primitive:\n", (u32)sizeof(Vertex), (u32)sizeof(PackedVertex));
+    for (u32 i = 0; i < loader->primitive_job_count; i++)
+    {
+        mesh_primitive_job* job = &loader->primitive_jobs[i];
+        if (!job->valid)
+            continue;
+
+        f32 extent = HMM_LengthVec3(job->primitive->position_scale);
+        printf("  primitive %3u: %6u vertices, position %.6f (%.5f%% of bounds), normal %.4f deg, uv %.6f\n",
+               i, job->primitive->vertex_count, job->position_error, extent > 0.0f ? 100.0f * job->position_error / extent : 0.0f,
+               job->normal_error, job->uv_error);
+    }
+}
+
+void mesh_print_reorder_report(mesh_loader* loader)
+{
+    printf("Vertex reordering, cache miss ratio (FIFO %u) and bytes spanned per meshlet before -> after:\n", MESH_FIFO_CACHE_SIZE);
+    for (u32 i = 0; i < loader->primitive_job_count; i++)
+    {
+        mesh_primitive_job* job = &loader->primitive_jobs[i];
+        if (!job->valid)
+            continue;
+
+        printf("  primitive %3u: ACMR %.3f -> %.3f, meshlet span %.0f -> %.0f bytes\n",
+               i, job->cache_miss_before, job->cache_miss_after, job->fetch_span_before, job->fetch_span_after);
+    }
+}
+
+void mesh_print_hierarchy_report(mesh_loader* loader)
+{
+    printf("Cluster hierarchies (%u KB pages):\n", MESHLET_PAGE_SIZE / 1024);
+    for (u32 i = 0; i < loader->primitive_job_count; i++)
+    {
+        mesh_primitive_job* job = &loader->primitive_jobs[i];
+        if (!job->valid)
+            continue;
+
+        Primitive* pri = job->primitive;
+        f32 root_error = 0.0f;
+        for (u32 g = 0; g < pri->group_count; g++)
+            root_error = max(root_error, job->groups[g].error);
+
+        printf("  primitive %3u: %5u clusters in %u levels, %u roots (error %.4f), %u groups, %u pages, %u -> %u vertices\n",
+               i, pri->meshlet_count, job->hierarchy_levels, job->root_count, root_error, pri->group_count, pri->page_count,
+               job->unpaged_vertex_count, pri->vertex_count);
+    }
+}
+
+void mesh_loader_process(mesh_loader* loader, b32 process_geometry, b32 decode_textures)
+{
+    u32 primitive_job_count = process_geometry ? loader->primitive_job_count : 0;
+    u32 image_job_count = decode_textures ? loader->image_job_count : 0;
+
+    AuroraJob* jobs = malloc(sizeof(AuroraJob) * (image_job_count + primitive_job_count + 1));
+    u32 job_count = 0;
+    JobCounter counter = {0};
+
+    // Textures go first, they are by far the longest jobs
+    for (u32 i = 0; i < image_job_count; i++)
+    {
+        jobs[job_count].entry = mesh_job_load_image;
+        jobs[job_count].data = &loader->image_jobs[i];
+        job_count++;
+    }
+
+    for (u32 i = 0; i < primitive_job_count; i++)
+    {
+        jobs[job_count].entry = mesh_job_process_primitive;
+        jobs[job_count].data = &loader->primitive_jobs[i];
+        job_count++;
+    }
+
+    mesh_submit_jobs(jobs, job_count, &counter);
+    aurora_platform_wait_for_counter(&counter);
+    free(jobs);
+
+    if (MESH_REPORTS_ENABLED && VERTEX_QUANTIZATION_ENABLED && process_geometry)
+        mesh_print_quantization_report(loader);
+    if (MESH_REPORTS_ENABLED && process_geometry)
+    {
+        mesh_print_reorder_report(loader);
+        mesh_print_hierarchy_report(loader);
+    }
+}
+
+void mesh_loader_upload(mesh_loader* loader)
+{
+    Mesh* m = loader->mesh;
+
+    // Geometry set, material set and heap slots all go to the driver in one update
+    rhi_begin_descriptor_writes();
+
+    mesh_upload_geometry(loader, m);
+
+    for (i32 i = 0; i < m->material_count; i++)
+        mesh_upload_material(&m->materials[i]);
+    mesh_upload_material_table(m);
+
+    rhi_end_descriptor_writes();
+
+    m->upload_ticket = rhi_flush_uploads();
+}
+
+void mesh_loader_free_geometry(mesh_loader* loader)
+{
+    for (u32 i = 0; i < loader->primitive_job_count; i++)
+    {
+        mesh_primitive_job* job = &loader->primitive_jobs[i];
+
+        if (job->valid)
+        {
+            free_meshlet_vector(&job->meshlets);
+            free(job->groups);
+            free(job->packed_vertices);
+            free(job->indices);
+            free(job->vertices);
+        }
+    }
+}
+
+void mesh_set_directory(Mesh* m, const char* path)
+{
+    strncpy(m->directory, path, sizeof(m->directory) - 1);
+
+    char* separator = strrchr(m->directory, '/');
+    if (separator)
+        separator[1] = '\0';
+    else
+        m->directory[0] = '\0';
+}
+
+cgltf_data* mesh_loader_parse(mesh_loader* loader, const char* path)
+{
+    cgltf_options options;
+    memset(&options, 0, sizeof(options));
+    cgltf_data* data = 0;
+
+    cgltf_call(cgltf_parse_file(&options, path, &data));
+    cgltf_call(cgltf_load_buffers(&options, data, path));
+    cgltf_scene* scene = data->scene;
+
+    mesh_set_directory(loader->mesh, path);
+
+    for (u32 ni = 0; ni < scene->nodes_count; ni++)
+        cgltf_queue_node(scene->nodes[ni], loader);
+
+    return data;
+}
+
+void mesh_print_load_report(Mesh* m, const char* path)
+{
+    printf("Mesh load report for %s (%u workers): parse %.3fs, process %.3fs, upload %.3fs\n",
+           path, m->load_report.worker_count,
+           m->load_report.parse_time, m->load_report.process_time, m->load_report.upload_time);
+    printf("%u meshlets in %.1f KB, %.1f bytes per meshlet\n", m->total_meshlet_count, m->total_meshlet_size / 1024.0,
+           m->total_meshlet_count ? (f64)m->total_meshlet_size / m->total_meshlet_count : 0.0);
+}
+
+void mesh_load(Mesh* out, const char* path)
+{
+    memset(out, 0, sizeof(Mesh));
+
+    f32 start = aurora_platform_get_time();
+
+    mesh_loader* loader = calloc(1, sizeof(mesh_loader));
+    loader->mesh = out;
+
+    cgltf_data* data = mesh_loader_parse(loader, path);
+
+    f32 parse_end = aurora_platform_get_time();
+
+    // Phase 1: geometry processing and texture decoding for every primitive at once
+    mesh_loader_process(loader, 1, 1);
+
+    f32 process_end = aurora_platform_get_time();
+
+    // Phase 2: RHI resource creation has to stay on this thread
+    mesh_loader_upload(loader);
+
+    f32 upload_end = aurora_platform_get_time();
+
+    out->load_report.parse_time = parse_end - start;
+    out->load_report.process_time = process_end - parse_end;
+    out->load_report.upload_time = upload_end - process_end;
+    out->load_report.worker_count = MULTITHREADING_ENABLED ? aurora_platform_get_job_worker_count() : 1;
+    mesh_print_load_report(out, path);
+
+    mesh_loader_free_geometry(loader);
+    free(loader);
+    cgltf_free(data);
+}
+
+internal u64 amesh_align(u64 offset)
+{
+    return (offset + AMESH_ALIGNMENT - 1) & ~(u64)(AMESH_ALIGNMENT - 1);
+}
+
+// Returns 0 when the path doesn't fit, a truncated path would point at a different texture
+internal b32 amesh_copy_texture_path(char* dst, const char* path, Mesh* m)
+{
+    // Texture paths are stored relative to the .amesh directory
+    u64 directory_length = strlen(m->directory);
+    if (strncmp(path, m->directory, directory_length) == 0)
+        path += directory_length;
+
+    if (strlen(path) >= AMESH_MAX_PATH)
+        return 0;
+
+    strcpy(dst, path);
+    return 1;
+}
+
+// Inverse of amesh_copy_texture_path, fails the same way
+internal b32 amesh_resolve_texture_path(char* dst, u64 dst_size, const char* directory, const char* path)
+{
+    i32 length = snprintf(dst, dst_size, "%s%s", directory, path);
+    return length >= 0 && (u64)length < dst_size;
+}
+
+internal b32 amesh_range_valid(u64 offset, u64 size, u64 file_size)
+{
+    return offset <= file_size && size <= file_size - offset;
+}
+
+// Everything the GPU indexes with has to stay inside the primitive: clusters inside the meshlet vertex and micro
+// index streams, vertex ids inside the vertex buffer, groups and the material inside their tables
+internal b32 amesh_validate_primitive(u8* file, AMeshPrimitive* p, u32 material_count)
+{
+    if (p->material_index >= material_count || p->index_count % 3 != 0)
+        return 0;
+
+    Meshlet* meshlets = (Meshlet*)(file + p->meshlet_offset);
+    u32* meshlet_vertices = (u32*)(file + p->meshlet_vertex_offset);
+    u8* meshlet_indices = file + p->meshlet_index_offset;
+
+    u64 full_detail_triangles = 0;
+    for (u32 i = 0; i < p->meshlet_count; i++)
+    {
+        Meshlet* meshlet = &meshlets[i];
+        if (meshlet->vertex_count > MAX_MESHLET_VERTICES ||
+            meshlet->triangle_count > MAX_MESHLET_TRIANGLES ||
+            (u64)meshlet->vertex_offset + meshlet->vertex_count > p->meshlet_vertex_count ||
+            (u64)meshlet->triangle_offset + meshlet->triangle_count * 3 > p->meshlet_index_size ||
+            (meshlet->group != MESHLET_GROUP_NONE && meshlet->group >= p->group_count) ||
+            (meshlet->parent_group != MESHLET_GROUP_NONE && meshlet->parent_group >= p->group_count))
+            return 0;
+
+        for (u32 k = 0; k < meshlet->triangle_count * 3; k++)
+        {
+            if (meshlet_indices[meshlet->triangle_offset + k] >= meshlet->vertex_count)
+                return 0;
+        }
+
+        if (meshlet->group == MESHLET_GROUP_NONE)
+            full_detail_triangles += meshlet->triangle_count;
+    }
+
+    for (u32 i = 0; i < p->meshlet_vertex_count; i++)
+    {
+        if (meshlet_vertices[i] >= p->vertex_count)
+            return 0;
+    }
+
+    // The full detail clusters partition the source triangles
+    return full_detail_triangles * 3 == p->index_count;
+}
+
+// Every array the loader reads has to lie inside the mapping, every string has to end inside its field and every
+// primitive has to pass amesh_validate_primitive
+internal b32 amesh_validate(u8* file, u64 size)
+{
+    AMeshHeader* header = (AMeshHeader*)file;
+    if (header->source_path[AMESH_MAX_PATH - 1] != 0 ||
+        !amesh_range_valid(header->primitive_table_offset, (u64)header->primitive_count * sizeof(AMeshPrimitive), size) ||
+        !amesh_range_valid(header->material_table_offset, (u64)header->material_count * sizeof(AMeshMaterial), size))
+        return 0;
+
+    AMeshPrimitive* primitives = (AMeshPrimitive*)(file + header->primitive_table_offset);
+    for (u32 i = 0; i < header->primitive_count; i++)
+    {
+        AMeshPrimitive* p = &primitives[i];
+        if (p->vertex_count == 0)
+            continue;
+
+        if (!amesh_range_valid(p->vertex_offset, (u64)p->vertex_count * MESH_VERTEX_STRIDE, size) ||
+            !amesh_range_valid(p->meshlet_offset, (u64)p->meshlet_count * sizeof(Meshlet), size) ||
+            !amesh_range_valid(p->meshlet_vertex_offset, (u64)p->meshlet_vertex_count * sizeof(u32), size) ||
+            !amesh_range_valid(p->meshlet_index_offset, p->meshlet_index_size, size) ||
+            !amesh_range_valid(p->group_offset, (u64)p->group_count * sizeof(MeshletGroup), size) ||
+            !amesh_range_valid(p->page_offset, (u64)p->page_count * sizeof(MeshletPage), size) ||
+            !amesh_validate_primitive(file, p, header->material_count))
+            return 0;
+    }
+
+    AMeshMaterial* materials = (AMeshMaterial*)(file + header->material_table_offset);
+    for (u32 i = 0; i < header->material_count; i++)
+    {
+        AMeshMaterial* m = &materials[i];
+        if (m->albedo_path[AMESH_MAX_PATH - 1] != 0 || m->normal_path[AMESH_MAX_PATH - 1] != 0 || m->mr_path[AMESH_MAX_PATH - 1] != 0)
+            return 0;
+    }
+
+    // Cooked files shipped without their source are taken as they are
+    u64 source_size, source_time;
+    if (header->source_path[0] && aurora_platform_get_file_stamp(header->source_path, &source_size, &source_time))
+    {
+        if (source_size != header->source_size || source_time != header->source_time)
+            return 0;
+    }
+
+    return 1;
+}
+
+b32 mesh_cook(const char* gltf_path, const char* out_path)
+{
+    Mesh* m = calloc(1, sizeof(Mesh));
+    mesh_loader* loader = calloc(1, sizeof(mesh_loader));
+    loader->mesh = m;
+
+    cgltf_data* data = mesh_loader_parse(loader, gltf_path);
+    mesh_loader_process(loader, 1, 0);
+
+    AMeshHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = AMESH_MAGIC;
+    header.version = AMESH_VERSION;
+    header.vertex_stride = MESH_VERTEX_STRIDE;
+    header.meshlet_stride = sizeof(Meshlet);
+    header.primitive_count = loader->primitive_job_count;
+    header.material_count = m->material_count;
+    // Paths are written whole or not at all, the cook fails rather than storing a truncated one
+    b32 paths_fit = strlen(gltf_path) < AMESH_MAX_PATH;
+    if (paths_fit && aurora_platform_get_file_stamp(gltf_path, &header.source_size, &header.source_time))
+        strcpy(header.source_path, gltf_path);
+
+    AMeshPrimitive* primitives = calloc(header.primitive_count + 1, sizeof(AMeshPrimitive));
+
+    // Lay out the file first, then copy everything into one blob
+    u64 offset = amesh_align(sizeof(AMeshHeader));
+    header.primitive_table_offset = offset;
+    offset = amesh_align(offset + sizeof(AMeshPrimitive) * header.primitive_count);
+    header.material_table_offset = offset;
+    offset = amesh_align(offset + sizeof(AMeshMaterial) * header.material_count);
+
+    for (u32 i = 0; i < loader->primitive_job_count; i++)
+    {
+        mesh_primitive_job* job = &loader->primitive_jobs[i];
+        AMeshPrimitive* dst = &primitives[i];
+
+        dst->transform = job->primitive->transform;
+        dst->material_index = job->primitive->material_index;
+
+        // Non triangle primitives keep their slot but carry no geometry
+        if (!job->valid)
+            continue;
+
+        dst->vertex_count = job->primitive->vertex_count;
+        dst->position_offset = HMM_Vec4v(job->primitive->position_offset, 0.0f);
+        dst->position_scale = HMM_Vec4v(job->primitive->position_scale, 0.0f);
+        dst->bounds = job->primitive->bounds;
+        dst->index_count = job->primitive->index_count;
+        dst->meshlet_count = job->primitive->meshlet_count;
+        dst->meshlet_vertex_count = job->primitive->meshlet_vertex_count;
+        dst->meshlet_index_size = job->primitive->meshlet_index_size;
+        dst->group_count = job->primitive->group_count;
+        dst->page_count = job->primitive->page_count;
+
+        dst->vertex_offset = offset;
+        offset = amesh_align(offset + (u64)dst->vertex_count * MESH_VERTEX_STRIDE);
+        dst->meshlet_offset = offset;
+        offset = amesh_align(offset + (u64)dst->meshlet_count * sizeof(Meshlet));
+        dst->meshlet_vertex_offset = offset;
+        offset = amesh_align(offset + (u64)dst->meshlet_vertex_count * sizeof(u32));
+        dst->meshlet_index_offset = offset;
+        offset = amesh_align(offset + dst->meshlet_index_size);
+        dst->group_offset = offset;
+        offset = amesh_align(offset + (u64)dst->group_count * sizeof(MeshletGroup));
+        dst->page_offset = offset;
+        offset = amesh_align(offset + (u64)dst->page_count * sizeof(MeshletPage));
+    }
+
+    header.file_size = offset;
+
+    u8* blob = calloc(1, header.file_size);
+    memcpy(blob, &header, sizeof(AMeshHeader));
+    memcpy(blob + header.primitive_table_offset, primitives, sizeof(AMeshPrimitive) * header.primitive_count);
+
+    AMeshMaterial* materials = (AMeshMaterial*)(blob + header.material_table_offset);
+    for (i32 i = 0; i < m->material_count; i++)
+    {
+        GLTFMaterial* src = &m->materials[i];
+        AMeshMaterial* dst = &materials[i];
+
+        if (!amesh_copy_texture_path(dst->albedo_path, src->albedo_path, m) ||
+            !amesh_copy_texture_path(dst->normal_path, src->normal_path, m) ||
+            !amesh_copy_texture_path(dst->mr_path, src->mr_path, m))
+            paths_fit = 0;
+        dst->has_normal = src->has_normal;
+        dst->has_metallic = src->has_metallic;
+        dst->base_color_factor = src->base_color_factor;
+        dst->metallic_factor = src->metallic_factor;
+        dst->roughness_factor = src->roughness_factor;
+    }
+
+    for (u32 i = 0; i < loader->primitive_job_count; i++)
+    {
+        mesh_primitive_job* job = &loader->primitive_jobs[i];
+        AMeshPrimitive* dst = &primitives[i];
+
+        if (!job->valid)
+            continue;
+
+        void* vertex_data = VERTEX_QUANTIZATION_ENABLED ? (void*)job->packed_vertices : (void*)job->vertices;
+        memcpy(blob + dst->vertex_offset, vertex_data, (u64)dst->vertex_count * MESH_VERTEX_STRIDE);
+        memcpy(blob + dst->meshlet_offset, job->meshlets.meshlets, (u64)dst->meshlet_count * sizeof(Meshlet));
+        memcpy(blob + dst->meshlet_vertex_offset, job->meshlets.vertices, (u64)dst->meshlet_vertex_count * sizeof(u32));
+        memcpy(blob + dst->meshlet_index_offset, job->meshlets.indices, dst->meshlet_index_size);
+        memcpy(blob + dst->group_offset, job->groups, (u64)dst->group_count * sizeof(MeshletGroup));
+        if (dst->page_count)
+            memcpy(blob + dst->page_offset, job->primitive->pages, (u64)dst->page_count * sizeof(MeshletPage));
+    }
+
+    b32 result = 0;
+    FILE* file = paths_fit ? fopen(out_path, "wb") : 0;
+    if (file)
+    {
+        result = fwrite(blob, 1, header.file_size, file) == header.file_size;
+        fclose(file);
+    }
+
+    free(blob);
+    free(primitives);
+    mesh_loader_free_geometry(loader);
+    for (u32 i = 0; i < loader->primitive_job_count; i++)
+        free(m->primitives[i].pages);
+    free(loader);
+    free(m);
+    cgltf_free(data);
+
+    return result;
+}
+
+b32 mesh_load_cooked(Mesh* out, const char* path)
+{
+    f32 start = aurora_platform_get_time();
+
+    u64 size = 0;
+    u8* file = (u8*)aurora_platform_map_file(path, &size);
+    if (!file)
+        return 0;
+
+    AMeshHeader* header = (AMeshHeader*)file;
+    if (size < sizeof(AMeshHeader) ||
+        header->magic != AMESH_MAGIC ||
+        header->version != AMESH_VERSION ||
+        header->vertex_stride != MESH_VERTEX_STRIDE ||
+        header->meshlet_stride != sizeof(Meshlet) ||
+        header->file_size > size ||
+        header->primitive_count > MAX_PRIMITIVES ||
+        header->material_count > MAX_PRIMITIVES ||
+        !amesh_validate(file, size))
+    {
+        aurora_platform_unmap_file(file, size);
+        return 0;
+    }
+
+    memset(out, 0, sizeof(Mesh));
+    mesh_set_directory(out, path);
+
+    AMeshPrimitive* primitives = (AMeshPrimitive*)(file + header->primitive_table_offset);
+    AMeshMaterial* materials = (AMeshMaterial*)(file + header->material_table_offset);
+
+    // Texture paths are resolved before anything is allocated, one that doesn't fit rejects the file
+    for (u32 i = 0; i < header->material_count; i++)
+    {
+        AMeshMaterial* src = &materials[i];
+        GLTFMaterial* material = &out->materials[i];
+
+        if (!amesh_resolve_texture_path(material->albedo_path, sizeof(material->albedo_path), out->directory, src->albedo_path) ||
+            (src->has_normal && !amesh_resolve_texture_path(material->normal_path, sizeof(material->normal_path), out->directory, src->normal_path)) ||
+            (src->has_metallic && !amesh_resolve_texture_path(material->mr_path, sizeof(material->mr_path), out->directory, src->mr_path)))
+        {
+            aurora_platform_unmap_file(file, size);
+            return 0;
+        }
+    }
+
+    mesh_loader* loader = calloc(1, sizeof(mesh_loader));
+    loader->mesh = out;
+
+    // Geometry is uploaded straight from the mapped file
+    for (u32 i = 0; i < header->primitive_count; i++)
+    {
+        AMeshPrimitive* src = &primitives[i];
+        mesh_primitive_job* job = &loader->primitive_jobs[loader->primitive_job_count++];
+        Primitive* pri = &out->primitives[out->primitive_count++];
+
+        job->primitive = pri;
+        pri->transform = src->transform;
+        pri->material_index = src->material_index;
+
+        if (src->vertex_count == 0)
+            continue;
+
+        pri->vertex_count = src->vertex_count;
+        pri->vertex_size = src->vertex_count * MESH_VERTEX_STRIDE;
+        pri->index_count = src->index_count;
+        pri->index_size = src->index_count * sizeof(u32);
+        pri->triangle_count = src->index_count / 3;
+        pri->meshlet_count = src->meshlet_count;
+        pri->bounds = src->bounds;
+        pri->meshlet_vertex_count = src->meshlet_vertex_count;
+        pri->meshlet_index_size = src->meshlet_index_size;
+        pri->group_count = src->group_count;
+
+        // The page table outlives the mapping, a streamer reads it at runtime
+        pri->page_count = src->page_count;
+        pri->pages = malloc(sizeof(MeshletPage) * max(src->page_count, 1));
+        memcpy(pri->pages, file + src->page_offset, sizeof(MeshletPage) * src->page_count);
+
+        // Cooked vertices are already in the GPU layout
+        if (VERTEX_QUANTIZATION_ENABLED)
+        {
+            pri->vertex_format = VERTEX_FORMAT_QUANTIZED;
+            pri->position_offset = src->position_offset.XYZ;
+            pri->position_scale = src->position_scale.XYZ;
+            job->packed_vertices = (PackedVertex*)(file + src->vertex_offset);
+        }
+        else
+        {
+            job->vertices = (Vertex*)(file + src->vertex_offset);
+        }
+        job->meshlets.meshlets = (Meshlet*)(file + src->meshlet_offset);
+        job->meshlets.used = src->meshlet_count;
+        job->meshlets.vertices = (u32*)(file + src->meshlet_vertex_offset);
+        job->meshlets.vertex_count = src->meshlet_vertex_count;
+        job->meshlets.indices = file + src->meshlet_index_offset;
+        job->meshlets.index_size = src->meshlet_index_size;
+        job->groups = (MeshletGroup*)(file + src->group_offset);
+        job->valid = 1;
+    }
+
+    for (u32 i = 0; i < header->material_count; i++)
+    {
+        AMeshMaterial* src = &materials[i];
+        GLTFMaterial* material = &out->materials[out->material_count++];
+
+        mesh_queue_image(loader, &material->raw_color, material->albedo_path);
+
+        if (src->has_normal)
+        {
+            material->has_normal = 1;
+            mesh_queue_image(loader, &material->raw_normal, material->normal_path);
+        }
+
+        if (src->has_metallic)
+        {
+            material->has_metallic = 1;
+            mesh_queue_image(loader, &material->raw_pbr, material->mr_path);
+        }
+
+        material->base_color_factor = src->base_color_factor;
+        material->metallic_factor = src->metallic_factor;
+        material->roughness_factor = src->roughness_factor;
+    }
+
+    f32 parse_end = aurora_platform_get_time();
+
+    mesh_loader_process(loader, 0, 1);
+
+    f32 process_end = aurora_platform_get_time();
+
+    mesh_loader_upload(loader);
+
+    f32 upload_end = aurora_platform_get_time();
+
+    out->load_report.parse_time = parse_end - start;
+    out->load_report.process_time = process_end - parse_end;
+    out->load_report.upload_time = upload_end - process_end;
+    out->load_report.worker_count = MULTITHREADING_ENABLED ? aurora_platform_get_job_worker_count() : 1;
+    mesh_print_load_report(out, path);
+
+    free(loader);
+    aurora_platform_unmap_file(file, size);
+
+    return 1;
+}
+
+void mesh_free(Mesh* m)
+{
+    for (i32 i = 0; i < m->primitive_count; i++)
+        free(m->primitives[i].pages);
+
+    // Freed ranges aren't reused on their own, the scene buffers start over once no mesh is left
+    MeshScene* scene = &s_scene;
+    assert(scene->mesh_count > 0);
+    if (--scene->mesh_count == 0)
+    {
+        scene->vertex_count = 0;
+        scene->meshlet_count = 0;
+        scene->meshlet_vertex_count = 0;
+        scene->meshlet_index_words = 0;
+        scene->group_count = 0;
+        scene->primitive_count = 0;
+        scene->material_count = 0;
+        scene->max_primitive_meshlet_count = 0;
+    }
+
+    for (i32 i = 0; i < m->material_count; i++)
+    {
+        if (m->materials[i].albedo.image != VK_NULL_HANDLE)
         {
             rhi_free_image(&m->materials[i].albedo);
             rhi_free_sampler(&m->materials[i].albedo_sampler);
@@ -572,12 +2582,170 @@ void mesh_free(Mesh* m)
             rhi_free_image(&m->materials[i].normal);
         if (m->materials[i].metallic_roughness.image != VK_NULL_HANDLE)
             rhi_free_image(&m->materials[i].metallic_roughness);
-        rhi_free_buffer(&m->materials[i].material_buffer);
-        rhi_free_descriptor_set(&m->materials[i].material_set);
     }
 }
 
 void mesh_loader_set_sampler_heap(RHI_DescriptorHeap* heap)
 {
     s_sampler_heap = heap;
-}
\ No newline at end of file
+}
+
+#if MESHLET_BENCHMARK_ENABLED
+typedef struct meshlet_benchmark_stats meshlet_benchmark_stats;
+struct meshlet_benchmark_stats
+{
+    u32 meshlets;
+    u32 triangles;
+    f64 radius_sum;
+    f64 build_time;
+
+    // Triangles culled through their meshlet against triangles an exact per triangle test culls
+    u64 plane_culled;
+    u64 plane_ideal;
+    u64 cone_culled;
+    u64 cone_ideal;
+};
+
+internal f32 mesh_benchmark_random(u32* state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return (f32)(*state >> 8) / (f32)(1 << 24);
+}
+
+internal hmm_vec3 mesh_benchmark_direction(u32* state)
+{
+    f32 z = mesh_benchmark_random(state) * 2.0f - 1.0f;
+    f32 angle = mesh_benchmark_random(state) * 6.2831853f;
+    f32 r = HMM_SquareRootF(1.0f - z * z);
+    return HMM_Vec3(r * HMM_CosF(angle), r * HMM_SinF(angle), z);
+}
+
+internal void mesh_benchmark_builder(meshlet_benchmark_stats* stats, mesh_primitive_job* job, b32 coherent)
+{
+    Primitive* pri = job->primitive;
+
+    meshlet_vector vec;
+    init_meshlet_vector(&vec, 256);
+
+    f64 start = aurora_platform_get_time();
+    if (coherent)
+        mesh_build_meshlets_coherent(&vec, job->indices, pri->index_count, job->vertices, pri->vertex_count, MESHLET_VERTEX_BUDGET, MESHLET_TRIANGLE_BUDGET);
+    else
+        mesh_build_meshlets(&vec, job->indices, pri->index_count, pri->vertex_count, MESHLET_VERTEX_BUDGET, MESHLET_TRIANGLE_BUDGET);
+    stats->build_time += aurora_platform_get_time() - start;
+
+    mesh_compute_bounds(&vec, job->vertices);
+    mesh_compute_cones(&vec, job->vertices);
+
+    aabb bounds;
+    bounds.min = HMM_Vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    bounds.max = HMM_Vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (u32 v = 0; v < pri->vertex_count; v++)
+        mesh_aabb_add(&bounds, job->vertices[v].position);
+
+    hmm_vec3 center = HMM_MultiplyVec3f(HMM_AddVec3(bounds.min, bounds.max), 0.5f);
+    f32 extent = mesh_aabb_diagonal(&bounds) * 0.5f;
+
+    // Same seed for both builders so they see the same planes and cameras
+    u32 seed = 0x12345678u;
+    for (u32 s = 0; s < MESHLET_BENCHMARK_SAMPLES; s++)
+    {
+        // A plane through the mesh bounds stands in for one frustum plane
+        hmm_vec3 normal = mesh_benchmark_direction(&seed);
+        hmm_vec3 point = HMM_Vec3(bounds.min.X + (bounds.max.X - bounds.min.X) * mesh_benchmark_random(&seed),
+                                  bounds.min.Y + (bounds.max.Y - bounds.min.Y) * mesh_benchmark_random(&seed),
+                                  bounds.min.Z + (bounds.max.Z - bounds.min.Z) * mesh_benchmark_random(&seed));
+        f32 d = HMM_DotVec3(normal, point);
+
+        // A camera around the mesh for the cone test
+        hmm_vec3 camera = HMM_AddVec3(center, HMM_MultiplyVec3f(mesh_benchmark_direction(&seed), extent * 2.0f));
+
+        for (u32 i = 0; i < vec.used; i++)
+        {
+            Meshlet* ml = &vec.meshlets[i];
+            u32* meshlet_vertices = vec.vertices + ml->vertex_offset;
+            u8* meshlet_indices = vec.indices + ml->triangle_offset;
+
+            b32 plane_culled = HMM_DotVec3(normal, ml->sphere.XYZ) - d < -ml->sphere.W;
+
+            hmm_vec3 axis = HMM_Vec3(ml->cone[0] / 127.0f, ml->cone[1] / 127.0f, ml->cone[2] / 127.0f);
+            hmm_vec3 view = HMM_SubtractVec3(ml->sphere.XYZ, camera);
+            b32 cone_culled = ml->cone[3] < 127 && HMM_DotVec3(view, axis) >= ml->cone[3] / 127.0f * HMM_LengthVec3(view) + ml->sphere.W;
+
+            for (u32 t = 0; t < ml->triangle_count; t++)
+            {
+                hmm_vec3 a = job->vertices[meshlet_vertices[meshlet_indices[t * 3 + 0]]].position;
+                hmm_vec3 b = job->vertices[meshlet_vertices[meshlet_indices[t * 3 + 1]]].position;
+                hmm_vec3 c = job->vertices[meshlet_vertices[meshlet_indices[t * 3 + 2]]].position;
+
+                b32 behind = HMM_DotVec3(normal, a) < d && HMM_DotVec3(normal, b) < d && HMM_DotVec3(normal, c) < d;
+                hmm_vec3 n = HMM_Cross(HMM_SubtractVec3(b, a), HMM_SubtractVec3(c, a));
+                b32 backfacing = HMM_DotVec3(HMM_SubtractVec3(a, camera), n) >= 0.0f;
+
+                stats->plane_ideal += behind;
+                stats->plane_culled += plane_culled;
+                stats->cone_ideal += backfacing;
+                stats->cone_culled += cone_culled;
+            }
+        }
+    }
+
+    stats->meshlets += vec.used;
+    stats->triangles += pri->triangle_count;
+    for (u32 i = 0; i < vec.used; i++)
+        stats->radius_sum += vec.meshlets[i].sphere.W;
+
+    free_meshlet_vector(&vec);
+}
+
+internal void mesh_benchmark_print(const char* name, meshlet_benchmark_stats* stats)
+{
+    printf("%-10s %9u %8.1f %11.4f %10.1f%% %10.1f%% %9.2f\n", name, stats->meshlets,
+           stats->meshlets ? (f64)stats->triangles / stats->meshlets : 0.0,
+           stats->meshlets ? stats->radius_sum / stats->meshlets : 0.0,
+           stats->plane_ideal ? 100.0 * stats->plane_culled / stats->plane_ideal : 0.0,
+           stats->cone_ideal ? 100.0 * stats->cone_culled / stats->cone_ideal : 0.0,
+           stats->build_time * 1000.0);
+}
+
+// Builds every primitive with both builders and compares bounds tightness and how much of the ideal culling each one gets
+void mesh_benchmark_meshlet_builders(const char* path)
+{
+    Mesh* m = calloc(1, sizeof(Mesh));
+    mesh_loader* loader = calloc(1, sizeof(mesh_loader));
+    loader->mesh = m;
+
+    cgltf_data* data = mesh_loader_parse(loader, path);
+
+    // Both builders get what the loader hands its own builder, the hierarchy, remap and paging after it change the vertices
+    for (u32 i = 0; i < loader->primitive_job_count; i++)
+    {
+        mesh_primitive_job* job = &loader->primitive_jobs[i];
+        job->valid = mesh_prepare_primitive(job);
+    }
+
+    meshlet_benchmark_stats greedy, coherent;
+    memset(&greedy, 0, sizeof(greedy));
+    memset(&coherent, 0, sizeof(coherent));
+
+    for (u32 i = 0; i < loader->primitive_job_count; i++)
+    {
+        mesh_primitive_job* job = &loader->primitive_jobs[i];
+        if (!job->valid)
+            continue;
+
+        mesh_benchmark_builder(&greedy, job, 0);
+        mesh_benchmark_builder(&coherent, job, 1);
+    }
+
+    printf("Meshlet builder benchmark for %s (%u triangles, budget %u vertices %u triangles)\n", path, greedy.triangles, MESHLET_VERTEX_BUDGET, MESHLET_TRIANGLE_BUDGET);
+    printf("%-10s %9s %8s %11s %11s %11s %9s\n", "builder", "meshlets", "tris/ml", "avg radius", "plane cull", "cone cull", "build ms");
+    mesh_benchmark_print("greedy", &greedy);
+    mesh_benchmark_print("coherent", &coherent);
+
+    mesh_loader_free_geometry(loader);
+    free(loader);
+    free(m);
+    cgltf_free(data);
+}
+#endif
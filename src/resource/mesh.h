@@ -7,11 +7,41 @@
 #include <HandmadeMath.h>
 
 #define MULTITHREADING_ENABLED 1
+#define MESHLET_BENCHMARK_ENABLED 0
+// Per primitive statistics printed after every load and cook
+#define MESH_REPORTS_ENABLED 0
+#define VERTEX_QUANTIZATION_ENABLED 1
 #define MAX_PRIMITIVES 128
 #define MAX_MESHLET_VERTICES 64
 #define MAX_MESHLET_INDICES 372
 #define MAX_MESHLET_TRIANGLES 124
 
+// Budgets the builder fills meshlets up to, at most the MAX_MESHLET_* storage limits
+#define MESHLET_VERTEX_BUDGET 64
+#define MESHLET_TRIANGLE_BUDGET 124
+
+// Every hierarchy level aims for half the triangles of the groups it simplifies, a group that shrinks by less than
+// MESH_LOD_MIN_REDUCTION is kept for the next level
+#define MESH_LOD_MIN_REDUCTION 0.85f
+#define MESH_LOD_PIXEL_ERROR 1.0f
+
+// Cluster hierarchy: neighbouring clusters worth up to MESHLET_GROUP_SIZE full ones are simplified together into their parents.
+// With paging enabled clusters are stored in pages of at most MESHLET_PAGE_SIZE bytes a streamer can load on their own
+#define MESHLET_GROUP_SIZE 4
+#define MESHLET_GROUP_NONE 0xFFFFFFFF
+#define MESHLET_PAGING_ENABLED 0
+#define MESHLET_PAGE_SIZE (32 * 1024)
+
+// Every loaded mesh is sub-allocated from one set of scene wide buffers, so a pass binds the geometry, the primitive
+// table and the material table once however many meshes there are. The capacities are fixed, running out asserts
+#define MESH_SCENE_MAX_VERTICES (4 * 1024 * 1024)
+#define MESH_SCENE_MAX_MESHLETS (64 * 1024)
+#define MESH_SCENE_MAX_MESHLET_VERTICES (MESH_SCENE_MAX_MESHLETS * MAX_MESHLET_VERTICES)
+#define MESH_SCENE_MAX_MESHLET_INDEX_WORDS (MESH_SCENE_MAX_MESHLETS * MAX_MESHLET_INDICES / 4)
+#define MESH_SCENE_MAX_GROUPS MESH_SCENE_MAX_MESHLETS
+#define MESH_SCENE_MAX_PRIMITIVES 4096
+#define MESH_SCENE_MAX_MATERIALS 4096
+
 typedef struct Vertex Vertex;
 struct Vertex
 {
@@ -20,19 +50,94 @@ struct Vertex
     hmm_vec3 normals;
 };
 
+#define VERTEX_FORMAT_FLOAT 0
+#define VERTEX_FORMAT_QUANTIZED 1
+
+// Compressed vertex, 16 bytes instead of 32
+typedef struct PackedVertex PackedVertex;
+struct PackedVertex
+{
+    // unorm16 inside the primitive bounds, w unused
+    u16 position[4];
+    // Octahedral snorm16
+    i16 normal[2];
+    // Half floats
+    u16 uv[2];
+};
+
 #pragma pack(push, 16)
 typedef struct Meshlet Meshlet;
 struct Meshlet
 {
     hmm_vec4 sphere;
+    // Normal cone as snorm8: xyz axis, w cutoff, 127 never culls
+    i8 cone[4];
 
-    u32 vertices[MAX_MESHLET_VERTICES];
-    u8 indices[MAX_MESHLET_INDICES];
+    // Into the primitive's meshlet vertex and micro index buffers, the triangle offset is in bytes and 4 byte aligned
+    u32 vertex_offset;
+    u32 triangle_offset;
     u8 vertex_count;
     u8 triangle_count;
+    u16 pad;
+
+    // Group the cluster was simplified from and group it is simplified in, MESHLET_GROUP_NONE for full detail and roots
+    u32 group;
+    u32 parent_group;
+    u32 page;
+    u32 pad1;
+};
+
+// Clusters made by simplifying the same group share its bounds and error, so they always switch together
+typedef struct MeshletGroup MeshletGroup;
+struct MeshletGroup
+{
+    hmm_vec4 bounds;
+    // Distance in model units the group's clusters may be off from the full detail surface
+    f32 error;
+    u32 pad[3];
 };
 #pragma pack(pop)
 
+// Self contained run of clusters: their headers, streams and a private copy of every vertex they use
+typedef struct MeshletPage MeshletPage;
+struct MeshletPage
+{
+    u32 meshlet_offset;
+    u32 meshlet_count;
+    u32 vertex_offset;
+    u32 vertex_count;
+    u32 meshlet_vertex_offset;
+    u32 meshlet_vertex_count;
+    u32 meshlet_index_offset;
+    u32 meshlet_index_size;
+};
+
+// Task dispatch the cull pass writes for every primitive that survives, laid out as VkDrawMeshTasksIndirectCommandNV
+// followed by what the task shader needs to find the primitive. The draw count sits in front of the first command
+typedef struct MeshDrawCommand MeshDrawCommand;
+struct MeshDrawCommand
+{
+    u32 task_count;
+    u32 first_task;
+    u32 primitive_index;
+    // Set when the early phase drew the primitive, the late phase only trusts cluster visibility then
+    u32 drawn_early;
+};
+
+#define MESH_DRAW_COUNT_SIZE 16
+
+// Same draw for the vertex pipeline fallback, laid out as VkDrawIndexedIndirectCommand. The cull pass reserves
+// MAX_MESHLET_INDICES per cluster starting at first_index and first_instance carries the primitive index
+typedef struct MeshIndexedDrawCommand MeshIndexedDrawCommand;
+struct MeshIndexedDrawCommand
+{
+    u32 index_count;
+    u32 instance_count;
+    u32 first_index;
+    i32 vertex_offset;
+    u32 first_instance;
+};
+
 typedef struct GLTFMaterial GLTFMaterial;
 struct GLTFMaterial
 {
@@ -61,18 +166,18 @@ struct GLTFMaterial
     hmm_vec3 base_color_factor;
     f32 metallic_factor;
     f32 roughness_factor;
-
-    RHI_Buffer material_buffer;
-    RHI_DescriptorSet material_set;
 };
 
 typedef struct Primitive Primitive;
 struct Primitive
 {
-    RHI_Buffer vertex_buffer;
-    RHI_Buffer index_buffer;
-    RHI_Buffer meshlet_buffer;
-    RHI_DescriptorSet geometry_descriptor_set;
+    // Where the primitive's data starts in the scene buffers, in elements of each buffer. The micro index offset is in
+    // 4 byte words and the vertex offset in the primitive's own vertex stride
+    u32 first_vertex;
+    u32 first_meshlet;
+    u32 first_meshlet_vertex;
+    u32 first_meshlet_index;
+    u32 first_group;
 
     u32 vertex_size;
     u32 index_size;
@@ -81,9 +186,133 @@ struct Primitive
     u32 index_count;
     u32 triangle_count;
     u32 meshlet_count;
+    u32 meshlet_vertex_count;
+    u32 meshlet_index_size;
+    u32 group_count;
     u32 material_index;
 
+    // Quantized positions decode to position_offset + unorm * position_scale
+    u32 vertex_format;
+    hmm_vec3 position_offset;
+    hmm_vec3 position_scale;
+
+    // Level of detail comes from the cluster hierarchy, the source indices are only kept on the CPU to build it
+    hmm_vec4 bounds;
+
+    // Empty unless MESHLET_PAGING_ENABLED
+    MeshletPage* pages;
+    u32 page_count;
+
+    hmm_mat4 transform;
+};
+
+// .amesh: cooked mesh container meant to be memory mapped. Every array starts on an
+// AMESH_ALIGNMENT boundary and all offsets are relative to the start of the file.
+#define AMESH_MAGIC 0x48534D41 // "AMSH"
+#define AMESH_VERSION 8
+#define AMESH_ALIGNMENT 64
+#define AMESH_MAX_PATH 256
+
+typedef struct AMeshHeader AMeshHeader;
+struct AMeshHeader
+{
+    u32 magic;
+    u32 version;
+    u32 vertex_stride;
+    u32 meshlet_stride;
+    u32 primitive_count;
+    u32 material_count;
+    u64 primitive_table_offset;
+    u64 material_table_offset;
+    u64 file_size;
+
+    // Stamp of the glTF the file was cooked from, a cooked file whose source changed since is rejected
+    u64 source_size;
+    u64 source_time;
+    char source_path[AMESH_MAX_PATH];
+};
+
+typedef struct AMeshPrimitive AMeshPrimitive;
+struct AMeshPrimitive
+{
     hmm_mat4 transform;
+    u32 material_index;
+    u32 vertex_count;
+    u32 index_count;
+    u32 meshlet_count;
+    u32 meshlet_vertex_count;
+    u32 meshlet_index_size;
+    u32 group_count;
+    u32 page_count;
+    u64 vertex_offset;
+    u64 meshlet_offset;
+    u64 meshlet_vertex_offset;
+    u64 meshlet_index_offset;
+    u64 group_offset;
+    u64 page_offset;
+    hmm_vec4 position_offset;
+    hmm_vec4 position_scale;
+    hmm_vec4 bounds;
+};
+
+typedef struct AMeshMaterial AMeshMaterial;
+struct AMeshMaterial
+{
+    char albedo_path[AMESH_MAX_PATH];
+    char normal_path[AMESH_MAX_PATH];
+    char mr_path[AMESH_MAX_PATH];
+
+    b32 has_normal;
+    b32 has_metallic;
+
+    hmm_vec3 base_color_factor;
+    f32 metallic_factor;
+    f32 roughness_factor;
+    f32 pad[3];
+};
+
+// Shared by every loaded mesh. primitive_buffer holds each primitive's offsets, transform and scene material index,
+// so one geometry set and one material set cover the whole scene
+typedef struct MeshScene MeshScene;
+struct MeshScene
+{
+    RHI_Buffer vertex_buffer;
+    RHI_Buffer meshlet_buffer;
+    RHI_Buffer meshlet_vertex_buffer;
+    RHI_Buffer meshlet_index_buffer;
+    RHI_Buffer visibility_buffer;
+    RHI_Buffer group_buffer;
+    RHI_Buffer primitive_buffer;
+    RHI_Buffer material_buffer;
+
+    // Filled on the GPU by the late phase, one word per primitive
+    RHI_Buffer primitive_visibility_buffer;
+
+    // Vertex pipeline fallback: room for the indices of every cluster at once, each primitive's run starts at its first meshlet
+    RHI_Buffer cluster_index_buffer;
+
+    // Used part of each buffer, in elements. Space is only reclaimed once every mesh has been freed
+    u32 vertex_count;
+    u32 meshlet_count;
+    u32 meshlet_vertex_count;
+    u32 meshlet_index_words;
+    u32 group_count;
+    u32 primitive_count;
+    u32 material_count;
+    u32 max_primitive_meshlet_count;
+    u32 mesh_count;
+
+    RHI_DescriptorSet geometry_descriptor_set;
+    RHI_DescriptorSet material_set;
+};
+
+typedef struct MeshLoadReport MeshLoadReport;
+struct MeshLoadReport
+{
+    f32 parse_time;
+    f32 process_time;
+    f32 upload_time;
+    u32 worker_count;
 };
 
 typedef struct Mesh Mesh;
@@ -96,20 +325,34 @@ struct Mesh
     i32 material_count;
 
     u32 total_vertex_count;
-    u32 total_index_count;
     u32 total_triangle_count;
     u32 total_meshlet_count;
+    u64 total_meshlet_size;
+
+    // Where the mesh's primitives and materials start in the scene tables, primitive i is entry first_primitive + i
+    u32 first_primitive;
+    u32 first_material;
+
+    char directory[512];
+    MeshLoadReport load_report;
 
-    char* directory;
+    // Buffers and textures are only safe to use on the GPU once this has been reached
+    RHI_UploadTicket upload_ticket;
 };
 
-void mesh_loader_init(i32 dset_layout_binding);
+void mesh_loader_init();
 void mesh_loader_free();
 RHI_DescriptorSetLayout* mesh_loader_get_descriptor_set_layout();
 RHI_DescriptorSetLayout* mesh_loader_get_geometry_descriptor_set_layout();
+MeshScene* mesh_loader_get_scene();
 void mesh_loader_set_texture_heap(RHI_DescriptorHeap* heap);
 void mesh_loader_set_sampler_heap(RHI_DescriptorHeap* heap);
 void mesh_load(Mesh* out, const char* path);
+b32 mesh_load_cooked(Mesh* out, const char* path);
+b32 mesh_cook(const char* gltf_path, const char* out_path);
 void mesh_free(Mesh* m);
+#if MESHLET_BENCHMARK_ENABLED
+void mesh_benchmark_meshlet_builders(const char* path);
+#endif
 
 #endif
\ No newline at end of file
@@ -0,0 +1,459 @@
+#include "simplify.h"
+
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A collapse may not turn a triangle further than this, as the cosine between its old and new normal
+#define SIMPLIFY_FLIP_THRESHOLD 0.25f
+// Seam vertices with more copies than this stay put
+#define SIMPLIFY_MAX_COPIES 8
+
+typedef struct simplify_quadric simplify_quadric;
+struct simplify_quadric
+{
+    // Sum of the area weighted plane equations as a symmetric 4x4 matrix
+    f64 a2, b2, c2, d2;
+    f64 ab, ac, ad;
+    f64 bc, bd;
+    f64 cd;
+    f64 weight;
+};
+
+typedef struct simplify_collapse simplify_collapse;
+struct simplify_collapse
+{
+    u32 from;
+    u32 to;
+    f64 cost;
+};
+
+// Triangles around v are adjacency[offsets[v]..offsets[v + 1]]
+typedef struct simplify_adjacency simplify_adjacency;
+struct simplify_adjacency
+{
+    u32* offsets;
+    u32* triangles;
+};
+
+// Vertices that only differ in their attributes share a position, every copy links to the next in a ring
+typedef struct simplify_positions simplify_positions;
+struct simplify_positions
+{
+    u32* id;
+    u32* next;
+};
+
+internal u32 simplify_hash_position(hmm_vec3 p)
+{
+    union { f32 f; u32 u; } x, y, z;
+    x.f = p.X;
+    y.f = p.Y;
+    z.f = p.Z;
+    return (x.u * 73856093u) ^ (y.u * 19349663u) ^ (z.u * 83492791u);
+}
+
+void simplify_build_positions(u32* id, u32* next, Vertex* vertices, u32 vertex_count)
+{
+    u32 table_size = 1;
+    while (table_size < vertex_count * 2)
+        table_size *= 2;
+
+    u32* table = malloc(sizeof(u32) * table_size);
+    memset(table, 0xff, sizeof(u32) * table_size);
+
+    for (u32 v = 0; v < vertex_count; v++)
+    {
+        hmm_vec3 p = vertices[v].position;
+        u32 slot = simplify_hash_position(p) & (table_size - 1);
+
+        while (table[slot] != UINT_MAX && memcmp(&vertices[table[slot]].position, &p, sizeof(hmm_vec3)) != 0)
+            slot = (slot + 1) & (table_size - 1);
+
+        if (table[slot] == UINT_MAX)
+        {
+            table[slot] = v;
+            id[v] = v;
+            if (next)
+                next[v] = v;
+        }
+        else
+        {
+            u32 first = table[slot];
+            id[v] = first;
+            if (next)
+            {
+                next[v] = next[first];
+                next[first] = v;
+            }
+        }
+    }
+
+    free(table);
+}
+
+internal void simplify_quadric_add_triangle(simplify_quadric* q, hmm_vec3 a, hmm_vec3 b, hmm_vec3 c)
+{
+    hmm_vec3 n = HMM_Cross(HMM_SubtractVec3(b, a), HMM_SubtractVec3(c, a));
+    f64 length = HMM_LengthVec3(n);
+    if (length == 0.0)
+        return;
+
+    f64 nx = n.X / length;
+    f64 ny = n.Y / length;
+    f64 nz = n.Z / length;
+    f64 d = -(nx * a.X + ny * a.Y + nz * a.Z);
+    f64 w = length * 0.5;
+
+    q->a2 += w * nx * nx;
+    q->b2 += w * ny * ny;
+    q->c2 += w * nz * nz;
+    q->d2 += w * d * d;
+    q->ab += w * nx * ny;
+    q->ac += w * nx * nz;
+    q->ad += w * nx * d;
+    q->bc += w * ny * nz;
+    q->bd += w * ny * d;
+    q->cd += w * nz * d;
+    q->weight += w;
+}
+
+internal void simplify_quadric_accumulate(simplify_quadric* q, simplify_quadric* other)
+{
+    q->a2 += other->a2;
+    q->b2 += other->b2;
+    q->c2 += other->c2;
+    q->d2 += other->d2;
+    q->ab += other->ab;
+    q->ac += other->ac;
+    q->ad += other->ad;
+    q->bc += other->bc;
+    q->bd += other->bd;
+    q->cd += other->cd;
+    q->weight += other->weight;
+}
+
+// Area weighted sum of squared distances from p to the planes
+internal f64 simplify_quadric_error(simplify_quadric* q, hmm_vec3 p)
+{
+    f64 x = p.X;
+    f64 y = p.Y;
+    f64 z = p.Z;
+
+    f64 error = q->a2 * x * x + q->b2 * y * y + q->c2 * z * z + q->d2
+              + 2.0 * (q->ab * x * y + q->ac * x * z + q->bc * y * z)
+              + 2.0 * (q->ad * x + q->bd * y + q->cd * z);
+
+    return fabs(error);
+}
+
+internal void simplify_build_adjacency(simplify_adjacency* adjacency, u32* indices, u32 index_count, u32 vertex_count)
+{
+    memset(adjacency->offsets, 0, sizeof(u32) * (vertex_count + 1));
+
+    for (u32 i = 0; i < index_count; i++)
+        adjacency->offsets[indices[i] + 1]++;
+
+    for (u32 v = 0; v < vertex_count; v++)
+        adjacency->offsets[v + 1] += adjacency->offsets[v];
+
+    u32* cursor = malloc(sizeof(u32) * (vertex_count + 1));
+    memcpy(cursor, adjacency->offsets, sizeof(u32) * vertex_count);
+    for (u32 i = 0; i < index_count; i++)
+        adjacency->triangles[cursor[indices[i]]++] = i / 3;
+    free(cursor);
+}
+
+// True if a triangle around a has the edge a -> b in its winding
+internal b32 simplify_has_edge(simplify_adjacency* adjacency, u32* indices, u32 a, u32 b)
+{
+    for (u32 i = adjacency->offsets[a]; i < adjacency->offsets[a + 1]; i++)
+    {
+        u32* tri = &indices[adjacency->triangles[i] * 3];
+        for (u32 k = 0; k < 3; k++)
+        {
+            if (tri[k] == a && tri[(k + 1) % 3] == b)
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+internal b32 simplify_shares_edge(simplify_adjacency* adjacency, u32* indices, u32 a, u32 b)
+{
+    return simplify_has_edge(adjacency, indices, a, b) || simplify_has_edge(adjacency, indices, b, a);
+}
+
+// The triangles that survive collapsing from onto to must not fold over
+internal b32 simplify_collapse_flips(simplify_adjacency* adjacency, u32* indices, Vertex* vertices, u32 from, u32 to)
+{
+    for (u32 i = adjacency->offsets[from]; i < adjacency->offsets[from + 1]; i++)
+    {
+        u32* tri = &indices[adjacency->triangles[i] * 3];
+        if (tri[0] == to || tri[1] == to || tri[2] == to)
+            continue;
+
+        hmm_vec3 before[3];
+        hmm_vec3 after[3];
+        for (u32 k = 0; k < 3; k++)
+        {
+            before[k] = vertices[tri[k]].position;
+            after[k] = tri[k] == from ? vertices[to].position : before[k];
+        }
+
+        hmm_vec3 n0 = HMM_Cross(HMM_SubtractVec3(before[1], before[0]), HMM_SubtractVec3(before[2], before[0]));
+        hmm_vec3 n1 = HMM_Cross(HMM_SubtractVec3(after[1], after[0]), HMM_SubtractVec3(after[2], after[0]));
+
+        if (HMM_DotVec3(n0, n1) < SIMPLIFY_FLIP_THRESHOLD * HMM_LengthVec3(n0) * HMM_LengthVec3(n1))
+            return 1;
+    }
+
+    return 0;
+}
+
+internal int simplify_compare_collapses(const void* a, const void* b)
+{
+    f64 ca = ((simplify_collapse*)a)->cost;
+    f64 cb = ((simplify_collapse*)b)->cost;
+    return (ca > cb) - (ca < cb);
+}
+
+// Pairs every copy of from with a copy of to it shares an edge with, so a seam collapses the same way on both sides
+internal u32 simplify_match_copies(simplify_adjacency* adjacency, simplify_positions* positions, u32* indices, u32 from, u32 to, u32* pairs)
+{
+    u32 pair_count = 0;
+    u32 f = from;
+    do
+    {
+        // Copies without triangles left have nothing to move
+        if (adjacency->offsets[f] != adjacency->offsets[f + 1])
+        {
+            if (pair_count == SIMPLIFY_MAX_COPIES)
+                return 0;
+
+            u32 match = UINT_MAX;
+            u32 t = to;
+            do
+            {
+                if (simplify_shares_edge(adjacency, indices, f, t))
+                    match = t;
+                t = positions->next[t];
+            } while (t != to && match == UINT_MAX);
+
+            if (match == UINT_MAX)
+                return 0;
+
+            pairs[pair_count * 2 + 0] = f;
+            pairs[pair_count * 2 + 1] = match;
+            pair_count++;
+        }
+
+        f = positions->next[f];
+    } while (f != from);
+
+    return pair_count;
+}
+
+u32 simplify_mesh(u32* destination, u32* indices, u32 index_count, Vertex* vertices, u32 vertex_count, u32 target_index_count, f32* out_error)
+{
+    memcpy(destination, indices, sizeof(u32) * index_count);
+    *out_error = 0.0f;
+
+    // Quadrics and locks live on the first vertex of each position
+    simplify_quadric* quadrics = calloc(vertex_count, sizeof(simplify_quadric));
+    u8* locked = calloc(vertex_count, sizeof(u8));
+    u8* touched = malloc(sizeof(u8) * vertex_count);
+    u32* remap = malloc(sizeof(u32) * vertex_count);
+    simplify_collapse* collapses = malloc(sizeof(simplify_collapse) * (index_count + 1));
+
+    simplify_positions positions;
+    positions.id = malloc(sizeof(u32) * vertex_count);
+    positions.next = malloc(sizeof(u32) * vertex_count);
+    simplify_build_positions(positions.id, positions.next, vertices, vertex_count);
+
+    simplify_adjacency adjacency;
+    adjacency.offsets = malloc(sizeof(u32) * (vertex_count + 1));
+    adjacency.triangles = malloc(sizeof(u32) * (index_count + 1));
+
+    for (u32 i = 0; i < index_count; i += 3)
+    {
+        hmm_vec3 a = vertices[destination[i + 0]].position;
+        hmm_vec3 b = vertices[destination[i + 1]].position;
+        hmm_vec3 c = vertices[destination[i + 2]].position;
+
+        for (u32 k = 0; k < 3; k++)
+            simplify_quadric_add_triangle(&quadrics[positions.id[destination[i + k]]], a, b, c);
+    }
+
+    simplify_build_adjacency(&adjacency, destination, index_count, vertex_count);
+
+    // An open edge is an attribute seam if copies of its vertices close it from the other side, otherwise it's a border.
+    // Border vertices stay put so neighbouring primitives don't crack.
+    for (u32 i = 0; i < index_count; i += 3)
+    {
+        for (u32 k = 0; k < 3; k++)
+        {
+            u32 a = destination[i + k];
+            u32 b = destination[i + (k + 1) % 3];
+            if (simplify_has_edge(&adjacency, destination, b, a))
+                continue;
+
+            b32 seam = 0;
+            u32 copy_a = a;
+            do
+            {
+                u32 copy_b = b;
+                do
+                {
+                    seam |= (copy_a != a || copy_b != b) && simplify_has_edge(&adjacency, destination, copy_b, copy_a);
+                    copy_b = positions.next[copy_b];
+                } while (copy_b != b);
+
+                copy_a = positions.next[copy_a];
+            } while (copy_a != a);
+
+            if (!seam)
+            {
+                locked[positions.id[a]] = 1;
+                locked[positions.id[b]] = 1;
+            }
+        }
+    }
+
+    f64 max_error = 0.0;
+    u32 pairs[SIMPLIFY_MAX_COPIES * 2];
+    b32 limited = 1;
+
+    while (index_count > target_index_count)
+    {
+        // Every edge shows up once per direction, the collapse goes from its first vertex onto its second
+        u32 collapse_count = 0;
+        for (u32 i = 0; i < index_count; i += 3)
+        {
+            for (u32 k = 0; k < 3; k++)
+            {
+                u32 from = destination[i + k];
+                u32 to = destination[i + (k + 1) % 3];
+                u32 from_id = positions.id[from];
+                u32 to_id = positions.id[to];
+                if (locked[from_id] || from_id == to_id)
+                    continue;
+
+                // Seam collapses that can't move every copy never become valid, keep them from pinning the cost limit
+                if (positions.next[from] != from && !simplify_match_copies(&adjacency, &positions, destination, from, to, pairs))
+                    continue;
+
+                hmm_vec3 p = vertices[to].position;
+                f64 weight = quadrics[from_id].weight + quadrics[to_id].weight;
+
+                simplify_collapse* collapse = &collapses[collapse_count++];
+                collapse->from = from;
+                collapse->to = to;
+                collapse->cost = (simplify_quadric_error(&quadrics[from_id], p) + simplify_quadric_error(&quadrics[to_id], p)) / max(weight, 1e-12);
+            }
+        }
+
+        if (collapse_count == 0)
+            break;
+
+        qsort(collapses, collapse_count, sizeof(simplify_collapse), simplify_compare_collapses);
+
+        // A collapse removes about two triangles, only take collapses as cheap as the ones this pass needs.
+        // Rejected collapses can pin that limit, a pass that gets nothing done runs the next one without it.
+        u32 triangles_needed = (index_count - target_index_count) / 3;
+        f64 cost_limit = collapses[min(collapse_count - 1, triangles_needed / 2)].cost;
+
+        memset(touched, 0, sizeof(u8) * vertex_count);
+        for (u32 v = 0; v < vertex_count; v++)
+            remap[v] = v;
+
+        u32 removed = 0;
+        for (u32 c = 0; c < collapse_count && removed < triangles_needed; c++)
+        {
+            simplify_collapse* collapse = &collapses[c];
+            if (limited && collapse->cost > cost_limit)
+                break;
+
+            u32 pair_count = simplify_match_copies(&adjacency, &positions, destination, collapse->from, collapse->to, pairs);
+            if (pair_count == 0)
+                continue;
+
+            // Neighbourhoods of earlier collapses this pass are stale until the indices are rewritten
+            b32 valid = 1;
+            for (u32 p = 0; p < pair_count && valid; p++)
+            {
+                valid = !touched[pairs[p * 2 + 0]] && !touched[pairs[p * 2 + 1]] &&
+                        !simplify_collapse_flips(&adjacency, destination, vertices, pairs[p * 2 + 0], pairs[p * 2 + 1]);
+            }
+
+            if (!valid)
+                continue;
+
+            for (u32 p = 0; p < pair_count; p++)
+            {
+                u32 from = pairs[p * 2 + 0];
+                u32 to = pairs[p * 2 + 1];
+                remap[from] = to;
+
+                for (u32 i = adjacency.offsets[from]; i < adjacency.offsets[from + 1]; i++)
+                {
+                    u32* tri = &destination[adjacency.triangles[i] * 3];
+                    removed += tri[0] == to || tri[1] == to || tri[2] == to;
+
+                    for (u32 k = 0; k < 3; k++)
+                        touched[tri[k]] = 1;
+                }
+            }
+
+            simplify_quadric_accumulate(&quadrics[positions.id[collapse->to]], &quadrics[positions.id[collapse->from]]);
+            max_error = max(max_error, collapse->cost);
+        }
+
+        if (removed == 0)
+        {
+            if (!limited)
+                break;
+
+            limited = 0;
+            continue;
+        }
+
+        limited = 1;
+
+        // Rewrite the indices and drop the triangles that collapsed into a line
+        u32 write = 0;
+        for (u32 i = 0; i < index_count; i += 3)
+        {
+            u32 a = remap[destination[i + 0]];
+            u32 b = remap[destination[i + 1]];
+            u32 c = remap[destination[i + 2]];
+
+            if (a == b || b == c || a == c)
+                continue;
+
+            destination[write++] = a;
+            destination[write++] = b;
+            destination[write++] = c;
+        }
+
+        index_count = write;
+        simplify_build_adjacency(&adjacency, destination, index_count, vertex_count);
+    }
+
+    *out_error = (f32)sqrt(max_error);
+
+    free(adjacency.triangles);
+    free(adjacency.offsets);
+    free(positions.next);
+    free(positions.id);
+    free(collapses);
+    free(remap);
+    free(touched);
+    free(locked);
+    free(quadrics);
+
+    return index_count;
+}
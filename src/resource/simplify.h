@@ -0,0 +1,15 @@
+#ifndef SIMPLIFY_H_INCLUDED
+#define SIMPLIFY_H_INCLUDED
+
+#include <resource/mesh.h>
+
+// Edge collapse simplification with quadric error metrics (Garland, Heckbert). Vertices only ever collapse onto a
+// neighbour, so the result indexes the same vertex buffer. Border vertices never move, attribute seam vertices collapse
+// together with every copy at their position so the seam stays closed, and ones with too many copies stay put.
+// destination needs room for index_count indices, returns the simplified index count and the error in model units.
+u32 simplify_mesh(u32* destination, u32* indices, u32 index_count, Vertex* vertices, u32 vertex_count, u32 target_index_count, f32* out_error);
+
+// id gets the first vertex with the same position as each vertex, next is optional and links those copies into a ring
+void simplify_build_positions(u32* id, u32* next, Vertex* vertices, u32 vertex_count);
+
+#endif